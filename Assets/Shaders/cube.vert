@@ -1,19 +1,16 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(location = 0) in vec3 inPosition;
+// Resource::PackedVertex, converted to floats by the vertex fetch
+layout(location = 0) in vec4 inPosition;
 layout(location = 1) in vec2 inUV;
-layout(location = 2) in vec3 inColor;
-layout(location = 3) in vec3 inNormal;
-
-struct Object {
-    vec3 position;
-	float padding0;
-    vec3 velocity;
-	float padding1;
-	vec3 accel;
-	float padding2;
-    vec4 rotation;
+layout(location = 2) in vec2 inNormal;
+
+// Written by sim1, see INSTANCE_UINT_COUNT in shaderSimData.h
+struct Instance {
+	vec3 position;
+	uint rotation0;
+	uvec4 rotation1;
 };
 
 layout(binding = 0) uniform UniformBufferObject
@@ -21,43 +18,62 @@ layout(binding = 0) uniform UniformBufferObject
     mat4 vp;
 } ubo;
 
-layout(binding = 1) readonly buffer ObjectBuffer
+layout(binding = 1) readonly buffer InstanceBuffer
 {
-	Object objects[];
+	Instance instances[];
 };
 
-layout (location = 0) out vec2 fragUV;
-layout (location = 1) out vec3 fragColor;
-layout (location = 2) out vec3 fragNormal;
+// Objects that passed cull.comp, one per instance. The list of the LOD being drawn, bound at a dynamic offset.
+layout(binding = 3) readonly buffer VisibleObjects
+{
+	uint visibleObjects[];
+};
 
+layout (location = 0) out vec2 fragUV;
+layout (location = 1) out vec3 fragNormal;
 
 
-vec4 QuatMul(vec4 a, vec4 other)
-{
-	return vec4(other.xyz * a.w + a.xyz * other.w + cross(a.xyz, other.xyz), a.w*other.w - dot(a.xyz, other.xyz));
-}
 
-vec4 QuatInverse(vec4 a)
+mat3 UnpackRotation(Instance instance)
 {
-	return normalize(vec4(-a.xyz, a.w));
+	const vec2 a = unpackSnorm2x16(instance.rotation0);
+	const vec2 b = unpackSnorm2x16(instance.rotation1.x);
+	const vec2 c = unpackSnorm2x16(instance.rotation1.y);
+	const vec2 d = unpackSnorm2x16(instance.rotation1.z);
+	const vec2 e = unpackSnorm2x16(instance.rotation1.w);
+	return mat3(a, b.x, b.y, c, d, e.x);
 }
 
-vec3 QuatMul(vec4 a, vec3 other)
+// Inverse of Mesh.cpp EncodeOctahedral, the lower half of the octahedron is unfolded
+vec3 DecodeOctahedral(vec2 e)
 {
-	vec4 tmp = QuatMul(QuatMul(a, vec4(other, 0.0)), QuatInverse(a));
-	return tmp.xyz;
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
 }
 
 void main()
 {
-	Object data = objects[gl_InstanceIndex];
-	vec3 dest = QuatMul(data.rotation, inPosition);
-	dest += data.position;
+	const Instance instance = instances[visibleObjects[gl_InstanceIndex]];
+	vec3 dest;
+	if (inPosition.w == 0.0)
+	{
+		// Impostor corner, in the plane facing the camera. vp is transposed, its columns are the rows of the
+		// view projection: the first one is the camera right axis scaled, the last one its forward axis.
+		const vec3 right = normalize(ubo.vp[0].xyz);
+		const vec3 back = -normalize(ubo.vp[3].xyz);
+		dest = right * inPosition.x + cross(back, right) * inPosition.y;
+		fragNormal = back;
+	}
+	else
+	{
+		const mat3 rotation = UnpackRotation(instance);
+		dest = rotation * inPosition.xyz;
+		fragNormal = rotation * DecodeOctahedral(inNormal);
+	}
+	dest += instance.position;
 	gl_Position = vec4(dest, 1.0) * ubo.vp;
 
 	fragUV = inUV;
-	//float c = clamp(data.padding2 / 5.0, 0.0, 1.0);
-	//fragColor = vec3(c,c,c);
-	fragColor = inColor;
-	fragNormal = QuatMul(data.rotation, inNormal);
 }
@@ -1,17 +1,114 @@
+#ifndef SHADER_SIM_DATA_H
+#define SHADER_SIM_DATA_H
 
-const uint OBJECT_COUNT = 65536;
-const uint WORLD_SIZE = 500;
-const uint MAX_GROUP_COUNT = 1024;
-const uint CHUNK_COUNT_SIDE = 32;
-const uint CHUNK_COUNT = CHUNK_COUNT_SIDE * CHUNK_COUNT_SIDE * CHUNK_COUNT_SIDE;
-const uint MAX_OBJECTS_PER_CHUNK = OBJECT_COUNT * 4 / CHUNK_COUNT + 1;
-const uint SORT_THREAD_COUNT = 64;
-const uint SORT_OBJECT_COUNT = (OBJECT_COUNT + SORT_THREAD_COUNT - 1) / SORT_THREAD_COUNT;
-const uint SORT_THREAD_OBJECT_PER_CHUNK = MAX_OBJECTS_PER_CHUNK / 4 + 1;
-const uint OBJECT_UPDATE_COUNT = (OBJECT_COUNT + CHUNK_COUNT - 1) / CHUNK_COUNT;
-const uint BLOCK_SIZE_Z = (CHUNK_COUNT + MAX_GROUP_COUNT - 1) / MAX_GROUP_COUNT;
-const uint CHUNK_COUNT_SIDE_Z = CHUNK_COUNT_SIDE / BLOCK_SIZE_Z;
+// Shared by the compute shaders and the C++ code (which defines uint as u32 before including it).
+// SPEC_CONST values are Vulkan specialization constants: the values here are only defaults, the renderer
+// overrides them when creating the pipelines. Simulation::SimulationSizes computes the derived values on
+// the CPU side and must keep the same formulas.
+#ifdef VULKAN
+#define SPEC_CONST(type, id, name, value) layout(constant_id = id) const type name = value
+#else
+#define SPEC_CONST(type, id, name, value) const type name = value
+#endif
 
 const float BOID_DIST_MAX = 31.0f;
 const float BOID_DIST_MIN = 8.0f;
 const float BOID_MAX_SPEED = 50.0f;
+// Fixed step of sim0 and sim1, the frame time is not sent to the compute shaders
+const float SIM_DELTA_TIME = 1 / 144.0f;
+
+SPEC_CONST(uint, 0, OBJECT_COUNT, 65536);
+SPEC_CONST(uint, 1, WORLD_SIZE, 500);
+// Chunks must be at least BOID_DIST_MAX wide, otherwise the 3x3x3 neighbourhood misses interacting boids
+SPEC_CONST(uint, 2, CHUNK_COUNT_SIDE, 16);
+// 1 stores the velocities and accelerations as half floats, 0 as floats
+SPEC_CONST(uint, 3, STATE_HALF, 0);
+
+const uint CHUNK_COUNT = CHUNK_COUNT_SIDE * CHUNK_COUNT_SIDE * CHUNK_COUNT_SIDE;
+
+// Layout of the object state, one stream per field, in uints. Each pass binds only the streams it reads:
+// - the positions, a vec4 per object whose w holds the raw bits of its stable id, as the reorder pass moves the objects
+// - the velocities and the accelerations, STATE_VECTOR_UINT_COUNT uints per object: three floats, or with STATE_HALF
+//   a packHalf2x16 pair and the z packed with a 0
+// - the rotations, a unit quaternion per object
+// Streams are sized for STATE_STREAM_COUNT objects, so they all start on a multiple of 256 bytes and can be bound on their own.
+const uint STATE_STREAM_COUNT = (OBJECT_COUNT + 63) / 64 * 64;
+const uint STATE_VECTOR_UINT_COUNT = 3 - STATE_HALF;
+const uint STATE_POSITION_OFFSET = 0;
+const uint STATE_VELOCITY_OFFSET = STATE_STREAM_COUNT * 4;
+const uint STATE_ACCEL_OFFSET = STATE_VELOCITY_OFFSET + STATE_STREAM_COUNT * STATE_VECTOR_UINT_COUNT;
+const uint STATE_ROTATION_OFFSET = STATE_ACCEL_OFFSET + STATE_STREAM_COUNT * STATE_VECTOR_UINT_COUNT;
+const uint STATE_UINT_COUNT = STATE_ROTATION_OFFSET + STATE_STREAM_COUNT * 4;
+// Largest finite half float, the stored vectors are clamped to it instead of becoming infinite
+const float STATE_HALF_MAX = 65504.0f;
+
+// Layout of the binning buffer, filled by bin0 (histogram), bin1 (prefix sum) and bin2 (scatter).
+// The objects of chunk 'c' are sorted[cellStart[c]] .. sorted[cellStart[c] + cellCount[c] - 1].
+// objectCell and objectSlot keep the chunk of each object and its rank in it between bin0 and bin2.
+const uint BIN_CELL_COUNT_OFFSET = 0;
+const uint BIN_CELL_START_OFFSET = CHUNK_COUNT;
+const uint BIN_SORTED_OFFSET = CHUNK_COUNT * 2;
+const uint BIN_OBJECT_CELL_OFFSET = CHUNK_COUNT * 2 + OBJECT_COUNT;
+const uint BIN_OBJECT_SLOT_OFFSET = CHUNK_COUNT * 2 + OBJECT_COUNT * 2;
+const uint BIN_BUFFER_COUNT = CHUNK_COUNT * 2 + OBJECT_COUNT * 3;
+
+// Compact copy of each object written by sim1 for the vertex shader, INSTANCE_UINT_COUNT uints instead of the 8 of its
+// position and rotation: the position, then the 3x3 rotation matrix in column order as snorm16 pairs (packSnorm2x16), the last
+// pair padded with 0. Indexed like the objects, the reorder pass does not move it as sim1 rewrites it every frame.
+const uint INSTANCE_UINT_COUNT = 8;
+
+// Levels of detail of the boids, in the order of the sub meshes of Resource::Mesh
+const uint LOD_MESH = 0;
+const uint LOD_IMPOSTOR = 1;
+const uint LOD_COUNT = 2;
+// Projected side of the boid box, in pixels, under which it becomes an impostor, and over which it gets its mesh back.
+// In between it keeps the LOD of the previous frame, so boids at the limit do not switch every frame.
+const float LOD_IMPOSTOR_PIXELS = 8.0f;
+const float LOD_MESH_PIXELS = 10.0f;
+
+// Layout of the culling buffer, written by cull.comp and read by the indirect draws, in uints:
+// - a header of CULL_HEADER_COUNT uints, with the VkDrawIndexedIndirectCommand of each LOD every CULL_COMMAND_STRIDE uints
+// - the indices of the visible objects of each LOD, in lists of CULL_LIST_COUNT
+// - the LOD of each object, one bit per stable id, set for the impostors. Kept from frame to frame.
+// The header and the lists are multiples of 256 bytes, the largest minStorageBufferOffsetAlignment,
+// so the vertex shader binds each list on its own.
+const uint CULL_HEADER_COUNT = 64;
+const uint CULL_COMMAND_STRIDE = 8;
+const uint CULL_LIST_COUNT = (OBJECT_COUNT + 63) / 64 * 64;
+const uint CULL_LOD_STATE_OFFSET = CULL_HEADER_COUNT + CULL_LIST_COUNT * LOD_COUNT;
+const uint CULL_BUFFER_COUNT = CULL_LOD_STATE_OFFSET + (OBJECT_COUNT + 31) / 32;
+// Half side of the box around the cube model: its vertices are at +-1, moved by up to 0.003 in Mesh::CreateDefaultCube
+const float OBJECT_HALF_EXTENT = 1.01f;
+
+// Work group size of every dispatch but bin1, which runs as a single group of SCAN_GROUP_SIZE invocations
+const uint COMPUTE_GROUP_SIZE = 64;
+// The minimum maxComputeWorkGroupInvocations guaranteed by vulkan
+const uint SCAN_GROUP_SIZE = 128;
+// Dispatches can need more than the 65535 groups guaranteed on x, they wrap onto y
+const uint MAX_DISPATCH_GROUPS_X = 32768;
+
+#ifdef VULKAN
+#define FLAT_INVOCATION_ID (gl_GlobalInvocationID.x + gl_GlobalInvocationID.y * gl_NumWorkGroups.x * gl_WorkGroupSize.x)
+#define FLAT_WORK_GROUP_ID (gl_WorkGroupID.x + gl_WorkGroupID.y * gl_NumWorkGroups.x)
+// Velocity or acceleration of object 'id' in 'stream', a uint array laid out as described with STATE_HALF
+#define LOAD_STATE_VECTOR(stream, id) (STATE_HALF != 0 ? \
+	vec3(unpackHalf2x16(stream[(id) * 2]), unpackHalf2x16(stream[(id) * 2 + 1]).x) : \
+	uintBitsToFloat(uvec3(stream[(id) * 3], stream[(id) * 3 + 1], stream[(id) * 3 + 2])))
+#define STORE_STATE_VECTOR(stream, id, value) do { \
+	const vec3 stateValue = (value); \
+	if (STATE_HALF != 0) \
+	{ \
+		const vec3 clamped = clamp(stateValue, -STATE_HALF_MAX, STATE_HALF_MAX); \
+		stream[(id) * 2] = packHalf2x16(clamped.xy); \
+		stream[(id) * 2 + 1] = packHalf2x16(vec2(clamped.z, 0.0)); \
+	} \
+	else \
+	{ \
+		stream[(id) * 3] = floatBitsToUint(stateValue.x); \
+		stream[(id) * 3 + 1] = floatBitsToUint(stateValue.y); \
+		stream[(id) * 3 + 2] = floatBitsToUint(stateValue.z); \
+	} \
+} while (false)
+#endif
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef SIM_NEIGHBOURS_H
+#define SIM_NEIGHBOURS_H
+
+#include "shaderSimData.h"
+
+// Flocking rules of the sim0 variants, which only differ in how they walk the neighbour chunks.
+// Simulation::ComputeReference mirrors them on the CPU.
+
+// Sums over the neighbours of one boid
+struct NeighbourSums
+{
+	vec3 globalPos;
+	vec3 globalRot;
+	vec3 avoidDir;
+	uint count;
+	uint avoidCount;
+};
+
+NeighbourSums EmptyNeighbourSums()
+{
+	return NeighbourSums(vec3(0), vec3(0), vec3(0), 0u, 0u);
+}
+
+ivec3 GetChunkPos(uint cell)
+{
+	return ivec3(cell % CHUNK_COUNT_SIDE, (cell / CHUNK_COUNT_SIDE) % CHUNK_COUNT_SIDE, cell / (CHUNK_COUNT_SIDE * CHUNK_COUNT_SIDE));
+}
+
+// Index of the chunk at 'pos', wrapped around the world. 'dt' is the offset to add to the positions of its boids
+int GetCell(ivec3 pos, out vec3 dt)
+{
+	int side = int(CHUNK_COUNT_SIDE);
+	float size = float(WORLD_SIZE);
+	dt = ivec3(0,0,0);
+	if (pos.x < 0)
+	{
+		pos.x += side;
+		dt.x = -size;
+	}
+	else if (pos.x >= side)
+	{
+		pos.x -= side;
+		dt.x = size;
+	}
+	if (pos.y < 0)
+	{
+		pos.y += side;
+		dt.y = -size;
+	}
+	else if (pos.y >= side)
+	{
+		pos.y -= side;
+		dt.y = size;
+	}
+	if (pos.z < 0)
+	{
+		pos.z += side;
+		dt.z = -size;
+	}
+	else if (pos.z >= side)
+	{
+		pos.z -= side;
+		dt.z = size;
+	}
+	return pos.x + ((pos.z * side) + pos.y) * side;
+}
+
+// 'delta' goes from the boid to the other one. Tested before AccumulateNeighbour so that the velocity
+// of the other boid is only loaded when it counts.
+bool IsNeighbour(vec3 delta)
+{
+	return !(dot(delta, delta) > BOID_DIST_MAX * BOID_DIST_MAX);
+}
+
+void AccumulateNeighbour(inout NeighbourSums sums, vec3 delta, vec3 velocity)
+{
+	float distSqr = dot(delta, delta);
+	sums.globalPos += delta;
+	sums.globalRot += velocity;
+	sums.count++;
+
+	if (distSqr < BOID_DIST_MIN * BOID_DIST_MIN && distSqr > 0)
+	{
+		float dist = sqrt(distSqr);
+		sums.avoidCount++;
+		sums.avoidDir -= delta / (dist * dist * dist) * BOID_DIST_MIN * BOID_DIST_MIN * BOID_DIST_MIN;
+	}
+}
+
+// Acceleration of the boid over one step, a boid without neighbours keeps going along 'velocity'
+vec3 ComputeAccel(NeighbourSums sums, vec3 velocity)
+{
+	if (sums.count == 0)
+		return normalize(velocity) * SIM_DELTA_TIME;
+	vec3 accel = (sums.globalPos / float(sums.count)) * 700 + (sums.globalRot / float(sums.count)) * 2500;
+	if (sums.avoidCount != 0)
+		accel += (sums.avoidDir / float(sums.avoidCount)) * 9000;
+	return accel * SIM_DELTA_TIME;
+}
+
+#endif
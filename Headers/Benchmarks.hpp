@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+
+#include "Types.hpp"
+
+namespace Benchmarks
+{
+	// Runs the benchmark with the given name, results are written on stdout.
+	// Returns false if the benchmark does not exist.
+	bool Run(const std::string &name);
+
+	// Compares the job system with the mutex guarded task vector previously used by the game thread.
+	void RunJobSystem();
+
+	// Times every neighbour kernel the CPU supports against the scalar one, on the same grid.
+	void RunNeighbourKernels();
+
+	// Times each stage of the CPU version of the GPU simulation pipeline, single threaded and on every core,
+	// with the per chunk and the per boid neighbour pass, and with the objects reordered every 10 frames.
+	void RunComputeReference();
+
+	// Compares the counting sort binning of the compute shaders with the 64 bucket lists it replaced:
+	// time, memory and dropped objects, on a uniform and a clustered distribution.
+	void RunBinning();
+
+	// Times the SIMD Mat4 and Vec4 operators against the scalar loops they replaced, and checks that both give the same bits.
+	void RunMaths();
+}
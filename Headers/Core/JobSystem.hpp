@@ -0,0 +1,103 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <memory>
+
+#include "Types.hpp"
+
+namespace Core
+{
+	// Jobs receive a [begin, end) range so that a single job can process a whole batch of items.
+	typedef void (*JobFunc)(void *data, u32 begin, u32 end);
+
+	const u32 JOB_DEQUE_SIZE = 4096;
+	const u32 JOB_POOL_SIZE = 4096;
+	const u32 JOB_SPIN_COUNT = 64;
+
+	// Counts the jobs that are still running in a batch. Use JobSystem::Wait to join on it.
+	struct JobCounter
+	{
+		std::atomic_uint32_t value = 0;
+
+		bool IsDone() const { return value.load(std::memory_order_acquire) == 0; }
+	};
+
+	struct Job
+	{
+		JobFunc func = nullptr;
+		void *data = nullptr;
+		u32 begin = 0;
+		u32 end = 0;
+		JobCounter *counter = nullptr;
+		std::atomic_bool finished = true;
+	};
+
+	// Chase-Lev work stealing deque (Le, Pop, Cohen, Zappa Nardelli 2013).
+	// Only the owner pushes and pops from the bottom, any thread can steal from the top.
+	class JobDeque
+	{
+	public:
+		JobDeque() = default;
+		~JobDeque() = default;
+
+		bool Push(Job *job);
+		Job *Pop();
+		Job *Steal();
+		bool IsEmpty() const;
+
+	private:
+		alignas(64) std::atomic<s64> top = 0;
+		alignas(64) std::atomic<s64> bottom = 0;
+		std::atomic<Job *> buffer[JOB_DEQUE_SIZE] = {};
+	};
+
+	// Per thread data: the deque other threads steal from, and a ring of jobs to avoid any allocation.
+	struct JobContext
+	{
+		JobDeque deque;
+		Job pool[JOB_POOL_SIZE];
+		u32 poolIndex = 0;
+		u32 stealSeed = 0;
+	};
+
+	class JobSystem
+	{
+	public:
+		JobSystem() = default;
+		~JobSystem();
+
+		// Spawns 'workerCount' worker threads. The calling thread becomes the owner of the system:
+		// it may submit jobs and help executing them in Wait, like the worker threads.
+		void Init(u32 workerCount);
+		void Shutdown();
+		bool IsRunning() const;
+		u32 GetWorkerCount() const;
+
+		// Jobs may only be submitted from the owner thread or from inside another job.
+		void Submit(JobCounter &counter, JobFunc func, void *data, u32 begin = 0, u32 end = 0);
+
+		// Splits [0, count) in ranges of at most 'grainSize' items, one job per range.
+		void ParallelFor(JobCounter &counter, u32 count, u32 grainSize, JobFunc func, void *data);
+
+		// Executes pending jobs until the counter reaches zero, instead of blocking the thread.
+		void Wait(JobCounter &counter);
+
+	private:
+		std::vector<std::thread> workers;
+		std::vector<std::unique_ptr<JobContext>> contexts;
+		std::atomic_bool exit = false;
+		std::atomic_uint32_t wakeEpoch = 0;
+		std::atomic_uint32_t sleepingCount = 0;
+		bool running = false;
+
+		void WorkerFunc(u32 index);
+		JobContext *GetContext();
+		Job *AllocateJob(JobContext *ctx);
+		Job *FindJob(JobContext *ctx);
+		bool RunOne(JobContext *ctx);
+		void Execute(Job *job);
+		void WakeWorkers(u32 count);
+	};
+}
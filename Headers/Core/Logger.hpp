@@ -0,0 +1,171 @@
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "Types.hpp"
+
+namespace Core
+{
+	enum LogLevel : u8
+	{
+		LOG_LEVEL_DEBUG = 0,
+		LOG_LEVEL_INFO,
+		LOG_LEVEL_WARNING,
+		LOG_LEVEL_ERROR,
+		LOG_LEVEL_NONE
+	};
+}
+
+// Levels below this one are removed at compile time, with their arguments
+#ifndef LOG_COMPILE_LEVEL
+#ifdef NDEBUG
+#define LOG_COMPILE_LEVEL Core::LOG_LEVEL_INFO
+#else
+#define LOG_COMPILE_LEVEL Core::LOG_LEVEL_DEBUG
+#endif
+#endif
+
+// The format must be a string literal, '{}' is replaced by the next argument. '{:spec}' formats it with the
+// printf flags, width, precision and conversion of 'spec' (e.g. '{:7.3f}', '{:08x}').
+// The arguments are not evaluated when the level is filtered out.
+#define LOG_WRITE(level, ...) do { if constexpr ((level) >= LOG_COMPILE_LEVEL) { if (Core::Logger::IsEnabled(level)) Core::Logger::Write((level), __VA_ARGS__); } } while (0)
+#define LOG_DEBUG(...) LOG_WRITE(Core::LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) LOG_WRITE(Core::LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARNING(...) LOG_WRITE(Core::LOG_LEVEL_WARNING, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_WRITE(Core::LOG_LEVEL_ERROR, __VA_ARGS__)
+
+namespace Core
+{
+	// Ring of each logging thread. Messages that do not fit are dropped and counted, writers never wait.
+	const u32 LOG_BUFFER_SIZE = 1 << 16;
+	// Longer string arguments are truncated
+	const u32 LOG_MAX_STRING_LENGTH = 1024;
+	const u32 LOG_FLUSH_INTERVAL_MS = 10;
+
+	enum LogArgType : u8
+	{
+		LOG_ARG_SIGNED = 0,
+		LOG_ARG_UNSIGNED,
+		LOG_ARG_FLOAT,
+		LOG_ARG_STRING
+	};
+
+	// Header of a message in a ring, followed by its arguments: a LogArgType, then 8 bytes for the numbers,
+	// or a u16 length and the characters for the strings.
+	struct LogRecord
+	{
+		// Header and arguments, rounded up to 8 bytes
+		u32 size;
+		LogLevel level;
+		u8 argCount;
+		// nullptr marks the unused end of the ring, skipped when a record does not fit before it
+		const char *format;
+		// Nanoseconds since the start of the application
+		u64 time;
+	};
+
+	// Single producer, single consumer: only its thread advances the head, only the flush thread the tail.
+	struct LogThreadBuffer
+	{
+		alignas(64) std::atomic_uint64_t head = 0;
+		alignas(64) std::atomic_uint64_t tail = 0;
+		std::atomic_uint32_t dropped = 0;
+		LogThreadBuffer *next = nullptr;
+		alignas(8) u8 data[LOG_BUFFER_SIZE];
+	};
+
+	struct LoggerSettings
+	{
+		LogLevel level = LOG_LEVEL_INFO;
+		// Standard output
+		bool console = false;
+		// OutputDebugString, on windows only
+		bool debugOutput = true;
+		// Empty for no file
+		std::string filePath;
+	};
+
+	inline std::string_view LogStringView(const char *text) { return text ? std::string_view(text) : std::string_view("(null)"); }
+	inline std::string_view LogStringView(std::string_view text) { return text; }
+
+	template<typename T>
+	u32 LogArgSize(const T &value)
+	{
+		if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>)
+			return 1 + sizeof(u64);
+		else
+		{
+			const size_t length = LogStringView(value).size();
+			return 1 + sizeof(u16) + (u32)(length < LOG_MAX_STRING_LENGTH ? length : LOG_MAX_STRING_LENGTH);
+		}
+	}
+
+	template<typename T>
+	void LogArgEncode(u8 *&out, const T &value)
+	{
+		if constexpr (std::is_floating_point_v<T>)
+		{
+			const f64 number = value;
+			*out++ = LOG_ARG_FLOAT;
+			memcpy(out, &number, sizeof(number));
+			out += sizeof(number);
+		}
+		else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>)
+		{
+			constexpr bool isSigned = std::is_signed_v<T>;
+			const u64 number = isSigned ? (u64)((s64)(value)) : (u64)(value);
+			*out++ = isSigned ? LOG_ARG_SIGNED : LOG_ARG_UNSIGNED;
+			memcpy(out, &number, sizeof(number));
+			out += sizeof(number);
+		}
+		else
+		{
+			const std::string_view text = LogStringView(value);
+			const u16 length = (u16)(text.size() < LOG_MAX_STRING_LENGTH ? text.size() : LOG_MAX_STRING_LENGTH);
+			*out++ = LOG_ARG_STRING;
+			memcpy(out, &length, sizeof(length));
+			out += sizeof(length);
+			memcpy(out, text.data(), length);
+			out += length;
+		}
+	}
+
+	// Asynchronous logger: the calling thread only copies the format pointer and its arguments into its own ring,
+	// a background thread formats the messages and writes them to the sinks.
+	class Logger
+	{
+	public:
+		// Starts the flush thread. Messages logged before are kept and written by its first flush.
+		static void Init(const LoggerSettings &settings);
+		// Writes every pending message, then stops the flush thread and closes the file.
+		static void Shutdown();
+
+		static bool IsEnabled(LogLevel level) { return level >= minLevel.load(std::memory_order_relaxed); }
+		static void SetLevel(LogLevel level);
+		// Recognizes debug, info, warning, error and none.
+		static bool ParseLevel(const std::string &text, LogLevel &out);
+
+		template<typename... Args>
+		static void Write(LogLevel level, const char *format, const Args &...args)
+		{
+			static_assert(sizeof...(Args) < 256, "too many log arguments");
+			u8 *out = BeginRecord(level, format, (u8)(sizeof...(Args)), (0 + ... + LogArgSize(args)));
+			if (!out)
+				return;
+			(LogArgEncode(out, args), ...);
+			EndRecord();
+		}
+
+	private:
+		static inline std::atomic_uint8_t minLevel = LOG_LEVEL_INFO;
+
+		// Returns where the arguments go, or nullptr if the ring of the calling thread is full
+		static u8 *BeginRecord(LogLevel level, const char *format, u8 argCount, u32 argSize);
+		static void EndRecord();
+		static void FlushThreadFunc();
+	};
+}
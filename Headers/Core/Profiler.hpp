@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "Types.hpp"
+
+// Scoped CPU profiler. Every macro expands to nothing unless PROFILER_ENABLED is defined for the whole build,
+// so the zones can stay in the hot paths of the release build.
+#ifdef PROFILER_ENABLED
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+// Records the time spent until the end of the enclosing scope. 'name' must be a string literal.
+#define PROFILE_ZONE(name) Core::ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+// Names the calling thread in the trace.
+#define PROFILE_THREAD(name) Core::Profiler::SetThreadName(name)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_THREAD(name)
+#endif
+
+namespace Core
+{
+	// Events are stored in blocks allocated by the recording thread when the previous one is full
+	const u32 PROFILER_BLOCK_SIZE = 4096;
+	// 4M events per thread at most, later events are counted as dropped
+	const u32 PROFILER_MAX_BLOCKS = 1024;
+
+	struct ProfileEvent
+	{
+		// Static string, only the pointer is recorded
+		const char *name;
+		// Nanoseconds since the start of the profiler
+		u64 begin;
+		u64 end;
+	};
+
+	// Written only by its thread, read by WriteChromeTrace: the count is published once the event is complete,
+	// so neither side ever takes a lock.
+	struct ProfileThreadBuffer
+	{
+		std::atomic<ProfileEvent *> blocks[PROFILER_MAX_BLOCKS] = {};
+		std::atomic_uint32_t count = 0;
+		std::atomic_uint32_t dropped = 0;
+		u32 threadId = 0;
+		char name[64] = {};
+		ProfileThreadBuffer *next = nullptr;
+	};
+
+	class Profiler
+	{
+	public:
+		static u64 Now();
+		static void Record(const char *name, u64 begin, u64 end);
+		static void SetThreadName(const std::string &name);
+
+		// Writes every recorded event in the Chrome trace format, readable by chrome://tracing and Perfetto.
+		// Events still being recorded by other threads while writing are skipped. Returns false on failure.
+		static bool WriteChromeTrace(const std::string &path);
+	};
+
+	class ProfileZone
+	{
+	public:
+		explicit ProfileZone(const char *zoneName) : name(zoneName), begin(Profiler::Now()) {}
+		~ProfileZone() { Profiler::Record(name, begin, Profiler::Now()); }
+
+		ProfileZone(const ProfileZone &) = delete;
+		ProfileZone &operator=(const ProfileZone &) = delete;
+
+	private:
+		const char *name;
+		u64 begin;
+	};
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+
+#include "Types.hpp"
+
+namespace Core
+{
+	// Keeps the last samples of a measure, for averages and percentiles over a sliding window.
+	class RollingStats
+	{
+	public:
+		RollingStats() = default;
+		~RollingStats() = default;
+
+		// Drops every sample, the window holds the last 'capacity' ones.
+		void Init(u32 capacity);
+		void Add(f64 value);
+
+		u32 GetCount() const;
+		f64 GetAverage() const;
+		// Nearest rank percentile, 'fraction' between 0 and 1 (0.5 is the median). 0 without samples.
+		f64 GetPercentile(f64 fraction) const;
+
+	private:
+		std::vector<f64> samples;
+		mutable std::vector<f64> sorted;
+		u32 next = 0;
+		u32 count = 0;
+	};
+}
@@ -1,6 +1,15 @@
 #pragma once
 
+#ifdef _WIN32
 #include <Windows.h>
+#else
+// Virtual key codes of the keys read by the game thread, matching winuser.h
+#define VK_SHIFT 0x10
+#define VK_ESCAPE 0x1B
+#define VK_UP 0x26
+#define VK_DOWN 0x28
+#define VK_F11 0x7A
+#endif
 
 #include <thread>
 #include <vector>
@@ -10,22 +19,11 @@
 #include <atomic>
 
 #include "Maths/Maths.hpp"
+#include "Simulation/SimulationSizes.hpp"
 
 typedef u32 uint;
 #include "../Assets/Shaders/shaderSimData.h"
 
-const u32 CELL_SIZE = 64;
-const u32 BOID_CHUNK = 512;
-const float BOID_CURSOR_DIST = 256.0f;
-
-struct PoolTask
-{
-	u32 taskID;
-	u32 cellX;
-	u32 cellY;
-	float deltaTime;
-};
-
 enum WindowMessage : u32
 {
 	NONE = 0,
@@ -40,29 +38,38 @@ public:
 	GameThread() = default;
 	~GameThread() = default;
 
-	void Init(HWND hwnd, u32 customMsg, Maths::IVec2 res, bool isUnitTest);
+#ifdef _WIN32
+	// Window receiving the WindowMessage values, without one they are dropped and EXIT_WINDOW only sets HasRequestedExit
+	void SetWindow(HWND hwnd, u32 customMsg);
+#endif
+	void Init(Maths::IVec2 res, const Simulation::SimulationSizes &simSizes, bool isUnitTest);
 	void Resize(s32 x, s32 y);
 	bool HasFinished() const;
+	bool HasRequestedExit() const;
 	void Quit();
 	void MoveMouse(Maths::Vec2 delta);
 	void SetKeyState(u8 key, u8 scanCode, bool state);
 	void SendWindowMessage(WindowMessage msg, u64 payload = 0);
 	std::vector<Maths::Vec4> GetInitialSimulationData();
+	const Simulation::SimulationSizes &GetSimulationSizes() const;
 	const Maths::Mat4 &GetViewProjectionMatrix() const;
 
+#ifdef _WIN32
 	static void SendErrorPopup(const std::wstring &err);
+#endif
 	static void SendErrorPopup(const std::string &err);
-	static void LogMessage(const std::wstring &msg);
-	static void LogMessage(const std::string &msg);
 	static bool HasCrashed();
 
 private:
+#ifdef _WIN32
 	static HWND hWnd;
+#endif
 	static std::atomic_bool crashed;
 	static bool isUnitTest;
 	std::thread thread;
 	std::chrono::system_clock::duration start = std::chrono::system_clock::duration();
 	std::atomic_bool exit;
+	std::atomic_bool exitRequested = false;
 	std::mutex mouseLock;
 	std::mutex keyLock;
 	std::bitset<256> keyDown = 0;
@@ -72,7 +79,6 @@ private:
 	std::bitset<256> keyCodesPress = 0;
 	std::bitset<256> keyCodesToggle = 0;
 	Maths::IVec2 res;
-	Maths::IVec2 cellCount;
 	std::atomic<u64> storedRes;
 	Maths::Vec2 storedDelta;
 	Maths::Vec3 position = Maths::Vec3(0,3,0);
@@ -84,37 +90,16 @@ private:
 	Maths::Vec2 cursorPos;
 	std::atomic_bool mousePressed = false;
 
-	std::vector<Maths::Vec2> positions;
-	std::vector<Maths::Vec2> velocities;
-	std::vector<Maths::Vec2> accels;
-	std::vector<float> rotations;
-
-	std::vector<std::vector<u32>> cells;
+	Simulation::SimulationSizes simSizes;
 
 	Maths::Mat4 vpA;
 	Maths::Mat4 vpB;
-	std::vector<Maths::Vec4> bufferA;
-	std::vector<Maths::Vec4> bufferB;
 	std::atomic_bool currentBuf = false;
 
-	std::vector<std::thread> threadPool;
-	std::vector<PoolTask> tasks;
-	std::atomic_uint32_t taskCounter;
-	std::atomic_bool poolExit;
-	std::mutex taskLock;
-
 	void ThreadFunc();
 	void HandleResize();
 	void InitThread();
-	void PreUpdate();
-	void Update(float deltaTime);
-	void PostUpdate(float deltaTime);
 	void UpdateBuffers(const Maths::Mat4 &mat);
 	float NextFloat01();
 	Maths::Vec3 NextUnitVector();
-	s32 GetCell(Maths::IVec2 pos, Maths::IVec2 &dt);
-	void ThreadPoolFunc();
-	bool ThreadPoolUpdate();
-	void ProcessCellUpdate(u32 x, u32 y, float deltaTime);
-	void ProcessPostUpdate(u32 start, u32 end, float deltaTime);
 };
@@ -5,6 +5,7 @@
 #include <string>
 
 #include "Types.hpp"
+#include "Maths/Simd.hpp"
 
 namespace Maths
 {
@@ -343,7 +344,7 @@ namespace Maths
 		inline Color4 operator+(const Color4& a) const;
 	};
 
-	class Vec4
+	class MATHS_SIMD_ALIGN Vec4
 	{
 	public:
 		f32 x;
@@ -365,6 +366,9 @@ namespace Maths
 
 		inline Vec4(const Color4& in) : x(in.r / 255.0f), y(in.g / 255.0f), z(in.b / 255.0f), w(in.a / 255.0f) {}
 
+		// Return a new Vec4 with the lanes of 'in'
+		inline explicit Vec4(Simd::Float4 in) { Simd::Store(&x, in); }
+
 
 		// Print the Vec4
 		void print() const;
@@ -449,7 +453,7 @@ namespace Maths
 
 	class Mat3;
 
-	class Mat4
+	class MATHS_SIMD_ALIGN Mat4
 	{
 	public:
 		/* data of the matrix : content[y][x]
@@ -473,9 +477,9 @@ namespace Maths
 
 		Mat4(const f32* data);
 
-		Mat4 operator*(const Mat4& a) const;
+		inline Mat4 operator*(const Mat4& a) const;
 
-		Vec4 operator*(const Vec4& a) const;
+		inline Vec4 operator*(const Vec4& a) const;
 
 		static Mat4 Identity();
 
@@ -689,12 +693,17 @@ namespace Maths
 #endif
 	};
 
+	// Planes as (normal, distance), the inside is where normal.Dot(point) >= distance
 	class Frustum
 	{
 	public:
 		Frustum() {}
 		~Frustum() {}
 
+		// Normalized planes of the volume clipped by vulkan: -w <= x, y <= w and 0 <= z <= w,
+		// with clip = viewProjection * point
+		static Frustum FromViewProjection(const Mat4& viewProjection);
+
 		Vec4 top;
 		Vec4 bottom;
 		Vec4 right;
@@ -791,6 +800,9 @@ namespace Maths
 
 		inline u64 ReadHex(const std::string& input);
 
+		// Bits of the nearest half float, round to nearest even, no denormals: values under 2^-14 become 0
+		u16 FloatToHalf(f32 value);
+
 		// Set of functions used to generate some shapes
 		// TODO is this still relevant ?
 
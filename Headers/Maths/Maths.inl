@@ -3,7 +3,9 @@
 #include "Maths.hpp"
 
 #include <assert.h>
+#ifdef _WIN32
 #include <corecrt_math_defines.h>
+#endif
 
 namespace Maths
 {
@@ -696,57 +698,45 @@ namespace Maths
 
 	inline Vec4 Vec4::operator+(const Vec4& a) const
 	{
-		return Vec4(x + a.x, y + a.y, z + a.z, w + a.w);
+		return Vec4(Simd::Add(Simd::Load(&x), Simd::Load(&a.x)));
 	}
 
 	inline Vec4 Vec4::operator+(const f32 a) const
 	{
-		return Vec4(x + a, y + a, z + a, w + a);
+		return Vec4(Simd::Add(Simd::Load(&x), Simd::Splat(a)));
 	}
 
 	inline Vec4& Vec4::operator+=(const Vec4& a)
 	{
-		x += a.x;
-		y += a.y;
-		z += a.z;
-		w += a.w;
+		Simd::Store(&x, Simd::Add(Simd::Load(&x), Simd::Load(&a.x)));
 		return *this;
 	}
 
 	inline Vec4& Vec4::operator+=(const f32 a)
 	{
-		x += a;
-		y += a;
-		z += a;
-		w += a;
+		Simd::Store(&x, Simd::Add(Simd::Load(&x), Simd::Splat(a)));
 		return *this;
 	}
 
 	inline Vec4 Vec4::operator-(const Vec4& a) const
 	{
-		return Vec4(x - a.x, y - a.y, z - a.z, w - a.w);
+		return Vec4(Simd::Sub(Simd::Load(&x), Simd::Load(&a.x)));
 	}
 
 	inline Vec4 Vec4::operator-(const f32 a) const
 	{
-		return Vec4(x - a, y - a, z - a, w - a);
+		return Vec4(Simd::Sub(Simd::Load(&x), Simd::Splat(a)));
 	}
 
 	inline Vec4& Vec4::operator-=(const Vec4& a)
 	{
-		x -= a.x;
-		y -= a.y;
-		z -= a.z;
-		w -= a.w;
+		Simd::Store(&x, Simd::Sub(Simd::Load(&x), Simd::Load(&a.x)));
 		return *this;
 	}
 
 	inline Vec4& Vec4::operator-=(const f32 a)
 	{
-		x -= a;
-		y -= a;
-		z -= a;
-		w -= a;
+		Simd::Store(&x, Simd::Sub(Simd::Load(&x), Simd::Splat(a)));
 		return *this;
 	}
 
@@ -757,29 +747,23 @@ namespace Maths
 
 	inline Vec4 Vec4::operator*(const Vec4& a) const
 	{
-		return Vec4(x * a.x, y * a.y, z * a.z, w * a.w);
+		return Vec4(Simd::Mul(Simd::Load(&x), Simd::Load(&a.x)));
 	}
 
 	inline Vec4 Vec4::operator*(const f32 a) const
 	{
-		return Vec4(x * a, y * a, z * a, w * a);
+		return Vec4(Simd::Mul(Simd::Load(&x), Simd::Splat(a)));
 	}
 
 	inline Vec4& Vec4::operator*=(const Vec4& a)
 	{
-		x *= a.x;
-		y *= a.y;
-		z *= a.z;
-		w *= a.w;
+		Simd::Store(&x, Simd::Mul(Simd::Load(&x), Simd::Load(&a.x)));
 		return *this;
 	}
 
 	inline Vec4& Vec4::operator*=(const f32 a)
 	{
-		x *= a;
-		y *= a;
-		z *= a;
-		w *= a;
+		Simd::Store(&x, Simd::Mul(Simd::Load(&x), Simd::Splat(a)));
 		return *this;
 	}
 
@@ -790,24 +774,18 @@ namespace Maths
 
 	inline Vec4 Vec4::operator/(const Vec4& a) const
 	{
-		return Vec4(x / a.x, y / a.y, z / a.z, w / a.w);
+		return Vec4(Simd::Div(Simd::Load(&x), Simd::Load(&a.x)));
 	}
 
 	inline Vec4& Vec4::operator/=(const Vec4& a)
 	{
-		x /= a.x;
-		y /= a.y;
-		z /= a.z;
-		w /= a.w;
+		Simd::Store(&x, Simd::Div(Simd::Load(&x), Simd::Load(&a.x)));
 		return *this;
 	}
 
 	inline Vec4& Vec4::operator/=(const f32 a)
 	{
-		x /= a;
-		y /= a;
-		z /= a;
-		w /= a;
+		Simd::Store(&x, Simd::Div(Simd::Load(&x), Simd::Splat(a)));
 		return *this;
 	}
 
@@ -906,6 +884,30 @@ namespace Maths
 
 #pragma region Mat4
 
+	// Column i of the product is the sum of the columns of this matrix weighted by the components of column i of 'in'.
+	// Summed from 0 in the order of k, like the scalar dot products, so every lane gets the same result they did.
+	inline Mat4 Mat4::operator*(const Mat4& in) const
+	{
+		const Simd::Float4 columns[4] = { Simd::Load(content), Simd::Load(content + 4), Simd::Load(content + 8), Simd::Load(content + 12) };
+		Mat4 out;
+		for (size_t i = 0; i < 4; i++)
+		{
+			Simd::Float4 res = Simd::Zero();
+			for (size_t k = 0; k < 4; k++)
+				res = Simd::Add(res, Simd::Mul(columns[k], Simd::Splat(in.content[k + i * 4])));
+			Simd::Store(out.content + i * 4, res);
+		}
+		return out;
+	}
+
+	inline Vec4 Mat4::operator*(const Vec4& in) const
+	{
+		Simd::Float4 res = Simd::Zero();
+		for (size_t k = 0; k < 4; k++)
+			res = Simd::Add(res, Simd::Mul(Simd::Load(content + k * 4), Simd::Splat(in[k])));
+		return Vec4(res);
+	}
+
 	inline f32& Mat4::operator[](const size_t in)
 	{
 		assert(in < 16);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Types.hpp"
+
+// 4 wide float operations behind the Vec4 and Mat4 operators. SSE2 is part of every x64 CPU and of the default
+// Win32 target, NEON of every arm64 one, so they are used without runtime dispatch. Define MATHS_NO_SIMD to build
+// the scalar fallback instead. Each lane does the exact operation of the scalar code, the results are identical
+// as long as the compiler does not fuse multiplies and adds.
+#if !defined(MATHS_NO_SIMD) && (defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__))
+#define MATHS_SIMD_SSE
+#include <emmintrin.h>
+#elif !defined(MATHS_NO_SIMD) && (defined(_M_ARM64) || defined(__aarch64__))
+#define MATHS_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+// Vec4 and Mat4 start on 16 bytes so their loads never straddle a cache line. Not on 32 bits targets,
+// where msvc can not pass aligned types by value.
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_ARM64) || defined(__aarch64__)
+#define MATHS_SIMD_ALIGN alignas(16)
+#else
+#define MATHS_SIMD_ALIGN
+#endif
+
+namespace Maths::Simd
+{
+#if defined(MATHS_SIMD_SSE)
+	typedef __m128 Float4;
+
+	inline Float4 Load(const f32 *in) { return _mm_loadu_ps(in); }
+	inline void Store(f32 *out, Float4 in) { _mm_storeu_ps(out, in); }
+	inline Float4 Splat(f32 in) { return _mm_set1_ps(in); }
+	inline Float4 Zero() { return _mm_setzero_ps(); }
+	inline Float4 Add(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+	inline Float4 Sub(Float4 a, Float4 b) { return _mm_sub_ps(a, b); }
+	inline Float4 Mul(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+	inline Float4 Div(Float4 a, Float4 b) { return _mm_div_ps(a, b); }
+#elif defined(MATHS_SIMD_NEON)
+	typedef float32x4_t Float4;
+
+	inline Float4 Load(const f32 *in) { return vld1q_f32(in); }
+	inline void Store(f32 *out, Float4 in) { vst1q_f32(out, in); }
+	inline Float4 Splat(f32 in) { return vdupq_n_f32(in); }
+	inline Float4 Zero() { return vdupq_n_f32(0.0f); }
+	inline Float4 Add(Float4 a, Float4 b) { return vaddq_f32(a, b); }
+	inline Float4 Sub(Float4 a, Float4 b) { return vsubq_f32(a, b); }
+	inline Float4 Mul(Float4 a, Float4 b) { return vmulq_f32(a, b); }
+	inline Float4 Div(Float4 a, Float4 b) { return vdivq_f32(a, b); }
+#else
+	struct Float4
+	{
+		f32 v[4];
+	};
+
+	inline Float4 Load(const f32 *in) { return Float4{ { in[0], in[1], in[2], in[3] } }; }
+	inline void Store(f32 *out, Float4 in) { for (u32 i = 0; i < 4; i++) out[i] = in.v[i]; }
+	inline Float4 Splat(f32 in) { return Float4{ { in, in, in, in } }; }
+	inline Float4 Zero() { return Splat(0.0f); }
+	inline Float4 Add(Float4 a, Float4 b) { return Float4{ { a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] } }; }
+	inline Float4 Sub(Float4 a, Float4 b) { return Float4{ { a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3] } }; }
+	inline Float4 Mul(Float4 a, Float4 b) { return Float4{ { a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3] } }; }
+	inline Float4 Div(Float4 a, Float4 b) { return Float4{ { a.v[0] / b.v[0], a.v[1] / b.v[1], a.v[2] / b.v[2], a.v[3] / b.v[3] } }; }
+#endif
+}
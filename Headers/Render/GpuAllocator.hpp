@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vector>
+
+#include "vulkan.h"
+
+#include "Types.hpp"
+
+namespace Render
+{
+	// Size of the blocks sub-allocated by GpuAllocator, smaller on small heaps
+	const VkDeviceSize GPU_BLOCK_SIZE = 64ull << 20;
+
+	enum AllocationStrategy : u8
+	{
+		// Best fit in the sorted free ranges of the block, merged back when freed. For long lived resources.
+		ALLOCATION_FREE_LIST = 0,
+		// Placed after the last allocation of the block, which starts over once all of them are freed.
+		// For short lived resources freed together, like the staging buffers.
+		ALLOCATION_LINEAR,
+		ALLOCATION_STRATEGY_COUNT
+	};
+
+	struct GpuAllocation
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		// Host visible blocks stay mapped, nullptr in the other ones
+		u8 *mapped = nullptr;
+		u32 block = UINT32_MAX;
+	};
+
+	struct GpuMemoryStats
+	{
+		u32 blockCount = 0;
+		u32 dedicatedCount = 0;
+		u32 allocationCount = 0;
+		VkDeviceSize reservedBytes = 0;
+		VkDeviceSize usedBytes = 0;
+		// Over the free list blocks only, the linear ones are reclaimed as a whole
+		u32 freeRangeCount = 0;
+		VkDeviceSize freeBytes = 0;
+		VkDeviceSize largestFreeRange = 0;
+		// 1 - (sum of the largest free range of each block) / freeBytes: 0 when each block has its free space in one piece
+		f64 fragmentation = 0;
+	};
+
+	// Allocates a few large VkDeviceMemory blocks per memory type and places the buffers and images in them,
+	// instead of one vkAllocateMemory per resource. Resources larger than half a block get their own allocation.
+	// Blocks are kept once empty, until Shutdown.
+	// Not thread safe, only the render thread creates resources.
+	class GpuAllocator
+	{
+	public:
+		GpuAllocator() = default;
+		~GpuAllocator() = default;
+
+		// Caches the memory types of the device
+		void Init(VkPhysicalDevice physicalDevice, VkDevice device);
+		// Frees every block, the resources placed in them must have been destroyed
+		void Shutdown();
+
+		// First memory type of 'typeFilter' having all the 'properties', UINT32_MAX if there is none
+		u32 FindMemoryType(u32 typeFilter, VkMemoryPropertyFlags properties) const;
+
+		// Allocate and bind the memory of the resource. Return false if it can not be allocated or bound,
+		// 'out' is then left empty and the resource is still owned by the caller.
+		bool AllocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties, AllocationStrategy strategy, GpuAllocation &out);
+		bool AllocateImage(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags properties, AllocationStrategy strategy, GpuAllocation &out);
+		// Resets 'allocation', freeing an empty one does nothing
+		void Free(GpuAllocation &allocation);
+
+		GpuMemoryStats GetStats() const;
+
+	private:
+		struct FreeRange
+		{
+			VkDeviceSize offset;
+			VkDeviceSize size;
+		};
+
+		struct Block
+		{
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDeviceSize size = 0;
+			u8 *mapped = nullptr;
+			u32 memoryType = 0;
+			AllocationStrategy strategy = ALLOCATION_FREE_LIST;
+			// Optimal tiling images never share a block with the buffers and linear images,
+			// so bufferImageGranularity never has to be padded between neighbours
+			bool optimalImages = false;
+			bool dedicated = false;
+			u32 allocationCount = 0;
+			VkDeviceSize usedBytes = 0;
+			// End of the last allocation of a linear block
+			VkDeviceSize linearOffset = 0;
+			// Sorted by offset, never adjacent
+			std::vector<FreeRange> freeRanges;
+		};
+
+		VkDevice device = VK_NULL_HANDLE;
+		VkPhysicalDeviceMemoryProperties memoryProperties = {};
+		VkDeviceSize nonCoherentAtomSize = 1;
+		// Freed dedicated blocks keep their slot with a null memory, for the next one
+		std::vector<Block> blocks;
+
+		bool Allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties, AllocationStrategy strategy, bool optimalImage, GpuAllocation &out);
+		bool PlaceInBlock(Block &block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset);
+		bool CreateBlock(u32 memoryType, VkDeviceSize size, u32 &index);
+		VkDeviceSize GetBlockSize(u32 memoryType) const;
+	};
+}
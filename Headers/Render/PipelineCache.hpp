@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+
+#include "vulkan.h"
+
+#include "Types.hpp"
+
+namespace Render
+{
+	// Written before the driver data of the cache file. The driver checks its own header too,
+	// but the driver version is not part of it, and a truncated file would only be caught by some drivers.
+	struct PipelineCacheHeader
+	{
+		u32 magic;
+		u32 version;
+		u32 vendorID;
+		u32 deviceID;
+		u32 driverVersion;
+		u8 pipelineCacheUUID[VK_UUID_SIZE];
+		u64 dataSize;
+		// FNV-1a of the driver data
+		u64 dataHash;
+		// Pipeline creation time of the run that started from an empty cache, 0 if unknown
+		u64 coldCreationMicros;
+	};
+
+	// VkPipelineCache loaded from a file at init and written back at shutdown, so that the
+	// pipelines are not compiled again by the driver on every launch.
+	class PipelineCache
+	{
+	public:
+		PipelineCache() = default;
+		~PipelineCache() = default;
+
+		// Loads 'path' if it was written for this device and driver, starts from an empty cache otherwise.
+		// An empty path disables the file, the cache then only lives for this run.
+		bool Init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string &path);
+		// Writes the cache to a temporary file, then renames it over the previous one
+		bool Save();
+		void Shutdown();
+
+		VkPipelineCache Get() const { return cache; }
+		// True if the pipelines are created from the data of a previous run
+		bool IsWarm() const { return warm; }
+		u64 GetLoadedSize() const { return loadedSize; }
+		u64 GetColdCreationMicros() const { return coldCreationMicros; }
+		// Kept in the file when the cache was cold, to compare the next runs with
+		void SetCreationMicros(u64 micros);
+
+	private:
+		VkDevice device = VK_NULL_HANDLE;
+		VkPipelineCache cache = VK_NULL_HANDLE;
+		VkPhysicalDeviceProperties properties = {};
+		std::string path;
+		bool warm = false;
+		u64 loadedSize = 0;
+		u64 coldCreationMicros = 0;
+	};
+}
@@ -1,26 +1,92 @@
 #pragma once
 
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 
 #include <thread>
 #include <vector>
+#include <string>
 #include <chrono>
 #include <mutex>
 #include <bitset>
 #include <atomic>
 #include <array>
 
+#ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR
+#endif
 #include "vulkan.h"
 #include "VkBootstrap.h"
 
 #include "Types.hpp"
 #include "Maths/Maths.hpp"
 #include "Resource/Mesh.hpp"
+#include "Resource/AssetPack.hpp"
+#include "Resource/TextureEncoder.hpp"
+#include "Core/RollingStats.hpp"
+#include "Render/GpuAllocator.hpp"
+#include "Render/PipelineCache.hpp"
 
 #include "GameThread.hpp"
 
 const u32 MAX_FRAMES_IN_FLIGHT = 3;
+const u32 COMPUTE_PIPELINE_COUNT = 7;
+// Built by the asset packer, the loose files under Assets are loaded when it is missing
+const char *const ASSET_PACK_PATH = "Assets.pack";
+// Staging buffer of the upload batches, larger uploads are split over several batches
+const VkDeviceSize UPLOAD_STAGING_SIZE = 16ull << 20;
+// Offsets of the copies in the staging buffer, a multiple of every texel size
+const VkDeviceSize UPLOAD_ALIGNMENT = 16;
+
+// Passes of the frame command buffers timed by the GPU profiler, in recording order
+enum GpuPass : u32
+{
+	GPU_PASS_BIN0 = 0,
+	GPU_PASS_BIN1,
+	GPU_PASS_BIN2,
+	GPU_PASS_SIM0,
+	GPU_PASS_SIM1,
+	GPU_PASS_CULL,
+	GPU_PASS_RENDER,
+	GPU_PASS_COUNT
+};
+// Frames kept by the GPU profiler for its averages and percentiles
+const u32 GPU_PROFILE_WINDOW = 256;
+// Vertex, clipping primitives, fragment and compute invocations, see GPU_STATISTICS_FLAGS
+const u32 GPU_STATISTICS_COUNT = 4;
+
+// Renders into device images instead of the window swapchain, see --offscreen
+struct OffscreenSettings
+{
+	// Frames rendered before the render thread exits, 0 renders to the window
+	u32 frameCount = 0;
+	// Every n-th frame is written as a PNG in 'directory', 0 writes none
+	u32 saveInterval = 1;
+	std::string directory = "Frames";
+};
+
+// Uniform buffer of each frame, read by cube.vert and cull.comp
+struct FrameUniforms
+{
+	// Transposed, the shaders multiply the points on the left
+	Maths::Mat4 viewProjection;
+	// left, right, bottom, top, front, back, see Maths::Frustum
+	Maths::Vec4 frustumPlanes[6];
+	// x: pixels covered by one unit at a depth of one, for the LOD selection of cull.comp
+	Maths::Vec4 lod;
+};
+
+// Totals since the last LogCullingValidation, see --validate-culling
+struct CullingValidation
+{
+	u32 frames = 0;
+	u64 gpuVisible = 0;
+	u64 cpuVisible = 0;
+	u64 impostors = 0;
+	// Objects visible for one of them only, a few can differ by rounding when they touch a plane
+	u64 mismatches = 0;
+};
 
 struct UBO
 {
@@ -30,8 +96,10 @@ struct UBO
 
 struct AppData
 {
+#ifdef _WIN32
 	HWND hWnd;
 	HINSTANCE hInstance;
+#endif
 	GameThread *gm;
 	vkb::Instance instance;
 	vkb::InstanceDispatchTable instDisp;
@@ -40,6 +108,13 @@ struct AppData
 	vkb::DispatchTable disp;
 	vkb::Swapchain swapchain;
 	f32 maxSamplerAnisotropy = 0;
+	u32 maxStorageBufferRange = 0;
+	VkDeviceSize minStorageBufferOffsetAlignment = 0;
+	// Nanoseconds per timestamp tick, and the valid timestamp bits of the graphics queue (0 if it has none)
+	f32 timestampPeriod = 0;
+	u64 timestampMask = 0;
+	bool pipelineStatistics = false;
+	bool textureCompressionBC = false;
 };
 
 struct RenderData
@@ -47,37 +122,85 @@ struct RenderData
 	VkQueue graphicsQueue;
 	VkQueue presentQueue;
 	VkQueue transferQueue;
+	// Equal when the device has no transfer only family, the transfer queue is then the graphics one
+	u32 graphicsQueueFamily = 0;
+	u32 transferQueueFamily = 0;
 
+	// The swapchain images, or the images rendered to in offscreen mode
 	std::vector<VkImage> swapchainImages;
 	std::vector<VkImageView> swapchainImageViews;
 	std::vector<VkFramebuffer> framebuffers;
+	VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+	VkExtent2D extent = {};
+
+	// Offscreen mode only. Each frame in flight copies its image to its readback buffer,
+	// which is written as a PNG once the frame fence is signaled.
+	std::vector<Render::GpuAllocation> offscreenImagesMemory;
+	std::vector<VkBuffer> readbackBuffers;
+	std::vector<Render::GpuAllocation> readbackBuffersMemory;
+	std::vector<u8*> readbackBuffersMapped;
+	// Frame waiting in each readback buffer, UINT64_MAX if none
+	std::vector<u64> readbackFrames;
+
+	// GPU profiler, one pool of each type per frame command buffer. Empty when profiling is disabled,
+	// there are no statistics pools if the device can not count the pipeline statistics.
+	std::vector<VkQueryPool> timestampPools;
+	std::vector<VkQueryPool> statisticsPools;
+	// Set when the command buffer of the pools is submitted, cleared once their results are read
+	std::vector<u8> queriesPending;
 
 	VkRenderPass renderPass;
 	VkPipelineLayout pipelineLayout;
 	VkPipeline graphicsPipeline;
 	VkPipelineLayout computePipelineLayout;
-	VkPipeline computePipelines[4];
+	// bin0, bin1, bin2, sim0, sim1, reorder, cull
+	VkPipeline computePipelines[COMPUTE_PIPELINE_COUNT];
 
 	VkCommandPool commandPool;
 	VkCommandPool transfertCommandPool;
 	std::vector<VkCommandBuffer> commandBuffers;
 	std::vector<VkCommandBuffer> computeCommandBuffers;
-	VkCommandBuffer transferCommandBuffer;
+	// Submitted before the frame command buffer every SimulationSizes::reorderInterval frames
+	VkCommandBuffer reorderCommandBuffer = VK_NULL_HANDLE;
 
 	std::vector<VkSemaphore> availableSemaphores;
 	std::vector<VkSemaphore> finishedSemaphore;
 	std::vector<VkFence> inFlightFences;
 	std::vector<VkFence> imageInFlight;
+
+	// Upload batch, see BeginUploads. The copies and the release barriers are recorded for the transfer queue,
+	// the matching acquire barriers for the graphics queue, which waits on uploadSemaphore and signals uploadFence.
+	// No acquire command buffer when both queues are of the same family.
+	VkBuffer stagingBuffer = VK_NULL_HANDLE;
+	Render::GpuAllocation stagingBufferMemory;
+	// End of the data staged by the batch being recorded
+	VkDeviceSize stagingHead = 0;
+	VkCommandBuffer uploadCommandBuffer = VK_NULL_HANDLE;
+	VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;
+	VkSemaphore uploadSemaphore = VK_NULL_HANDLE;
+	VkFence uploadFence = VK_NULL_HANDLE;
+	bool uploadsPending = false;
 	
 	std::vector<VkBuffer> objectBuffers;
-	std::vector<VkDeviceMemory> objectBuffersMemory;
+	std::vector<Render::GpuAllocation> objectBuffersMemory;
 	std::vector<Maths::Vec4*> objectBuffersMapped;
 
 	VkBuffer computeBuffer;
-	VkDeviceMemory computeBufferMemory;
+	Render::GpuAllocation computeBufferMemory;
+
+	// Indirect draw command and visible objects, see CULL_HEADER_COUNT
+	VkBuffer cullBuffer;
+	Render::GpuAllocation cullBufferMemory;
+	// --validate-culling only. Each frame command buffer copies the culling buffer then the objects to its readback buffer,
+	// compared to the CPU culling once its fence is signaled.
+	std::vector<VkBuffer> cullReadbackBuffers;
+	std::vector<Render::GpuAllocation> cullReadbackBuffersMemory;
+	std::vector<u8> cullReadbackPending;
 
 	VkBuffer vertexBuffer;
-	VkDeviceMemory vertexBufferMemory;
+	Render::GpuAllocation vertexBufferMemory;
+	VkBuffer indexBuffer;
+	Render::GpuAllocation indexBufferMemory;
 	VkDescriptorSetLayout descriptorSetLayoutCompute;
 	VkDescriptorSetLayout descriptorSetLayoutRender;
 	VkDescriptorPool descriptorPool;
@@ -86,24 +209,30 @@ struct RenderData
 	std::vector<VkDescriptorSet> computeDescriptorSets;
 
 	VkImage depthImage;
-	VkDeviceMemory depthImageMemory;
+	Render::GpuAllocation depthImageMemory;
 	VkImageView depthImageView;
 
 	VkImage textureImage;
-	VkDeviceMemory textureImageMemory;
+	Render::GpuAllocation textureImageMemory;
+	VkFormat textureFormat = VK_FORMAT_R8G8B8A8_SRGB;
+	u32 textureMipLevels = 1;
 	VkImageView textureImageView;
 	VkSampler textureSampler;
 
-	u32 mainBufSize = 0;
-	u32 sizeObjects = 0;
-	u32 sizeSortBuf = 0;
-	u32 sizeMergeBuf = 0;
+	VkDeviceSize mainBufSize = 0;
+	VkDeviceSize sizeObjects = 0;
+	VkDeviceSize sizeBinBuf = 0;
+	VkDeviceSize sizeReorderBuf = 0;
+	VkDeviceSize sizeInstances = 0;
+	VkDeviceSize sizeCullBuf = 0;
+	u64 simulationFrame = 0;
 	u32 currentFrame = 0;
 };
 
 struct SceneData
 {
 	Resource::Mesh mesh;
+	Resource::AssetPack assets;
 };
 
 class RenderThread
@@ -112,7 +241,12 @@ public:
 	RenderThread() = default;
 	~RenderThread() = default;
 
-	void Init(HWND hwnd, HINSTANCE hInstance, GameThread *gm, Maths::IVec2 res, u32 targetDevice = 0);
+#ifdef _WIN32
+	// Window to present to, only the offscreen mode can run without one
+	void SetWindow(HWND hwnd, HINSTANCE hInstance);
+#endif
+	void Init(GameThread *gm, Maths::IVec2 res, u32 targetDevice = 0, const OffscreenSettings &offscreen = OffscreenSettings(), bool gpuProfile = false,
+		const std::string &pipelineCachePath = "PipelineCache.bin", bool validateCulling = false);
 	void Resize(s32 x, s32 y);
 	bool HasFinished() const;
 	bool HasCrashed() const;
@@ -127,6 +261,19 @@ private:
 	AppData appData = {};
 	RenderData renderData = {};
 	SceneData sceneData = {};
+	Render::GpuAllocator gpuAllocator;
+	Render::PipelineCache pipelineCache;
+	// Empty to start from an empty pipeline cache on every launch
+	std::string pipelineCachePath;
+	OffscreenSettings offscreen;
+	bool gpuProfile = false;
+	bool validateCulling = false;
+	CullingValidation cullingValidation;
+	std::vector<u8> cpuVisibleObjects;
+	Core::RollingStats gpuPassTimes[GPU_PASS_COUNT];
+	Core::RollingStats gpuFrameTimes;
+	// Pipeline statistics of the last frame read, in the order of GPU_STATISTICS_FLAGS
+	u64 gpuPassStatistics[GPU_PASS_COUNT][GPU_STATISTICS_COUNT] = {};
 	Maths::IVec2 res;
 	Maths::IVec2 swapRes;
 	u64 lastRes = 0;
@@ -140,48 +287,74 @@ private:
 	void ThreadFunc(u32 targetDevice);
 	void HandleResize();
 	void InitThread();
-	void LoadAssets();
+	bool LoadAssets();
 	void UnloadAssets();
 
+#ifdef _WIN32
 	VkSurfaceKHR CreateSurfaceWin32(VkInstance instance, HINSTANCE hInstance, HWND window, VkAllocationCallbacks *allocator = nullptr);
-	VkShaderModule CreateShaderModule(const std::string &code);
-	bool CreateImage(Maths::IVec2 res, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage &image, VkDeviceMemory &memory);
+#endif
+	std::string_view LoadAsset(const char *name, std::string &storage);
+	VkShaderModule CreateShaderModule(std::string_view code);
+	bool CreateImage(Maths::IVec2 res, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage &image, Render::GpuAllocation &memory,
+		u32 mipLevels = 1);
 	VkVertexInputBindingDescription GetBindingDescription();
-	std::array<VkVertexInputAttributeDescription, 4> GetAttributeDescriptions();
+	std::array<VkVertexInputAttributeDescription, 3> GetAttributeDescriptions();
 	bool InitVulkan(u32 targetDevice);
 	bool InitDevice(u32 targetDevice);
 	bool CreateSwapchain();
+	bool CreateOffscreenTargets();
 	bool GetQueues();
 	bool CreateRenderPass();
 	bool CreateDescriptorSetLayouts();
+	bool CreatePipelines();
 	bool CreateGraphicsPipeline();
 	bool CreateComputePipeline();
 	bool CreateFramebuffers();
 	bool CreateCommandPool();
+	bool CreateUploadResources();
+	bool BeginUploads();
+	bool ReserveStaging(VkDeviceSize size, VkDeviceSize &offset);
+	bool UploadBuffer(const void *data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset = 0);
+	// 'data' holds the 'mipCount' first levels, see Resource::TextureEncoder
+	bool UploadImage(const u8 *data, VkImage image, u32 width, u32 height, u32 mipCount, Resource::TextureEncoding encoding);
+	bool SubmitUploads();
+	bool WaitUploads();
 	bool CreateTextureImage();
-	VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
+	// Block compressed formats need the textureCompressionBC feature and linear filtering
+	bool IsCompressedFormatSupported(VkFormat format);
+	VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, u32 mipLevels = 1);
 	bool CreateTextureImageView();
 	bool CreateTextureSampler();
 	bool CreateDepthResources();
 	bool CreateVertexBuffer(const Resource::Mesh &m);
-	bool CreateObjectBuffers(u32 objectCount);
+	bool CreateIndexBuffer(const Resource::Mesh &m);
+	bool CreateObjectBuffers(const Simulation::SimulationSizes &sizes);
+	bool CreateCullBuffers(const Simulation::SimulationSizes &sizes);
 	bool CreateCommandBuffers();
+	bool RecordReorderCommandBuffer(u32 objectGroupsX, u32 objectGroupsY);
+	bool CreateQueryPools();
+	void DestroyQueryPools();
+	void ResetGpuQueries(VkCommandBuffer commandBuffer, u32 image);
+	void BeginGpuPass(VkCommandBuffer commandBuffer, u32 image, GpuPass pass);
+	void EndGpuPass(VkCommandBuffer commandBuffer, u32 image, GpuPass pass);
+	void ReadGpuQueries(u32 image);
+	void LogGpuProfile();
+	void ValidateCulling(u32 image);
+	void LogCullingValidation();
 	bool CreateSyncObjects();
     bool CreateDescriptorPool();
 	bool CreateDescriptorSets();
 	bool RecreateSwapchain();
-	VkCommandBuffer BeginSingleTimeCommands(VkCommandPool targetPool);
-	void EndSingleTimeCommands(VkCommandBuffer commandBuffer, VkCommandPool targetPool, VkQueue targetQueue);
-	bool TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
-	void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
 	bool UpdateUniformBuffer(u32 image);
-	u32 FindMemoryType(u32 typeFilter, VkMemoryPropertyFlags properties);
 	VkFormat FindDepthFormat();
 	VkWriteDescriptorSet CreateWriteDescriptorSet(VkDescriptorSet dstSet, u32 binding, VkDescriptorType type, VkDescriptorBufferInfo *bufferInfo = nullptr, VkDescriptorImageInfo *imageInfo = nullptr);
 	bool HasStencilComponent(VkFormat format);
 	VkFormat FindSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
-	bool CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
-	bool CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+	bool CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Render::GpuAllocation& bufferMemory,
+		Render::AllocationStrategy strategy = Render::ALLOCATION_FREE_LIST);
+	void SetFrameCommandBuffers(VkSubmitInfo &submitInfo, VkCommandBuffer (&commandBuffers)[2], u32 imgIndex);
 	bool DrawFrame();
+	bool DrawOffscreenFrame();
+	bool SaveOffscreenFrame(u32 slot);
 	void Cleanup();
 };
\ No newline at end of file
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "Types.hpp"
+#include "Resource/TextureEncoder.hpp"
+
+namespace Resource
+{
+	const u32 ASSET_PACK_MAGIC = 0x50415356; // "VSAP"
+	const u32 ASSET_PACK_VERSION = 2;
+	// Payloads start on this alignment in the file, and so in the mapping. SPIR-V needs 4 bytes.
+	const u64 ASSET_PACK_ALIGNMENT = 64;
+
+	enum AssetType : u32
+	{
+		// Copied as is, the shaders
+		ASSET_RAW = 0,
+		// Decoded by the packer, with their whole mip chain, see TextureEncoder
+		ASSET_TEXTURE_RGBA8,
+		// Block compressed variants of a texture, named after it with a ".bc1" or ".bc7" suffix
+		ASSET_TEXTURE_BC1,
+		ASSET_TEXTURE_BC7
+	};
+
+	// Start of the file, followed by the entries sorted by name, then the names, then the payloads
+	struct AssetPackHeader
+	{
+		u32 magic;
+		u32 version;
+		u32 entryCount;
+		u32 nameTableSize;
+	};
+
+	struct AssetPackEntry
+	{
+		// In the name table, not null terminated
+		u32 nameOffset;
+		u32 nameLength;
+		u64 offset;
+		u64 size;
+		// FNV-1a of the payload, checked when the pack is opened by a Debug build
+		u64 hash;
+		AssetType type;
+		// Textures only
+		u32 width;
+		u32 height;
+		u32 mipCount;
+	};
+
+	u64 HashAssetData(const u8 *data, u64 size);
+	bool IsTextureAsset(AssetType type);
+	TextureEncoding GetTextureEncoding(AssetType type);
+
+	// Read only view of a pack built by the asset packer (Sources/Tools/AssetPacker.cpp). The file is mapped,
+	// the payloads are used in place without being read or copied.
+	class AssetPack
+	{
+	public:
+		AssetPack() = default;
+		~AssetPack();
+
+		AssetPack(const AssetPack &) = delete;
+		AssetPack &operator=(const AssetPack &) = delete;
+
+		// False if the file is missing or is not a valid pack
+		bool Open(const std::string &path);
+		void Close();
+		bool IsOpen() const { return data != nullptr; }
+
+		// Names are the paths the pack was built from, e.g. "Assets/Shaders/sim1.comp.spv". nullptr if missing.
+		const AssetPackEntry *Find(std::string_view name) const;
+		const u8 *GetData(const AssetPackEntry &entry) const { return data + entry.offset; }
+		std::string_view GetName(const AssetPackEntry &entry) const;
+		u32 GetEntryCount() const { return entryCount; }
+		u64 GetSize() const { return size; }
+
+	private:
+		const u8 *data = nullptr;
+		u64 size = 0;
+		const AssetPackEntry *entries = nullptr;
+		const char *names = nullptr;
+		u32 entryCount = 0;
+#ifdef _WIN32
+		void *file = nullptr;
+		void *mapping = nullptr;
+#endif
+
+		// Reads the header and checks every entry against the size of the file
+		bool Validate();
+	};
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 #include "Maths/Maths.hpp"
 
 namespace Resource
@@ -16,16 +18,52 @@ namespace Resource
 		Vertex() {}
 	};
 
+	// Vertex as stored in the vertex buffer, 16 bytes instead of the 44 of Vertex. Decoded by cube.vert:
+	// half float position, unorm16 uv in [0, 1] and octahedral snorm16 normal.
+	// The position w is 1, or 0 for the corners of an impostor, which cube.vert places facing the camera.
+	// The color is not kept, no shader reads it.
+	struct PackedVertex
+	{
+		u16 pos[4];
+		u16 uv[2];
+		s16 norm[2];
+	};
+
+	// Range of the vertex and index buffers drawn by one draw call, the indices are relative to vertexOffset
+	struct SubMesh
+	{
+		u32 firstIndex = 0;
+		u32 indexCount = 0;
+		s32 vertexOffset = 0;
+	};
+
 	class Mesh
 	{
 	public:
 		Mesh();
 		~Mesh();
 
-		void CreateDefaultCube();
+		// Replaces the mesh with the cube, as its first sub mesh. The two return false if the sub mesh was not added.
+		bool CreateDefaultCube();
+		// Appends a sub mesh of two triangles, drawn instead of the cube far from the camera. The quad of
+		// Maths::Util::GeneratePlane, scaled to the mean area the cube covers on screen.
+		bool AddImpostorQuad();
+		// Unique vertices of each sub mesh, drawn with the indices
 		const std::vector<Vertex>& GetVertices() const;
+		const std::vector<PackedVertex>& GetPackedVertices() const;
+		const std::vector<u16>& GetIndices() const;
+		const std::vector<SubMesh>& GetSubMeshes() const;
+
+		static PackedVertex PackVertex(const Vertex &vertex, f32 w = 1.0f);
 
 	private:
 		std::vector<Vertex> vertices;
+		std::vector<PackedVertex> packedVertices;
+		std::vector<u16> indices;
+		std::vector<SubMesh> subMeshes;
+
+		// Appends the triangle list as a sub mesh, merging the vertices that pack to the same bytes.
+		// Up to 65536 unique vertices per sub mesh, a larger one is left out and false is returned.
+		bool AppendIndexed(const std::vector<Vertex> &triangles, f32 w);
 	};
 }
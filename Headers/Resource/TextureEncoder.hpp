@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+#include "Types.hpp"
+
+namespace Resource
+{
+	enum TextureEncoding : u8
+	{
+		TEXTURE_RGBA8 = 0,
+		// 4x4 blocks of 8 bytes, opaque textures only
+		TEXTURE_BC1,
+		// 4x4 blocks of 16 bytes, encoded with mode 6 (one subset, RGBA endpoints, 16 weights)
+		TEXTURE_BC7,
+		TEXTURE_ENCODING_COUNT
+	};
+
+	// Mip chains and block compression of the sRGB RGBA8 textures, used offline by the asset packer,
+	// and at load time for the textures that are not in the asset pack.
+	// A chain is level 0 followed by each smaller level, down to 1x1, without padding.
+	class TextureEncoder
+	{
+	public:
+		static u32 GetMipCount(u32 width, u32 height);
+		// Side of the blocks in texels (1 for RGBA8) and their size in bytes
+		static void GetBlockInfo(TextureEncoding encoding, u32 &blockSide, u32 &blockBytes);
+		static u64 GetLevelSize(TextureEncoding encoding, u32 width, u32 height);
+		static u64 GetChainSize(TextureEncoding encoding, u32 width, u32 height, u32 mipCount);
+
+		// Each level averages 2x2 texels of the previous one, in linear space
+		static std::vector<u8> BuildMipChain(const u8 *pixels, u32 width, u32 height);
+		// Compresses every level of an RGBA8 chain
+		static std::vector<u8> EncodeChain(const u8 *chain, u32 width, u32 height, u32 mipCount, TextureEncoding encoding);
+		static bool IsOpaque(const u8 *pixels, u32 width, u32 height);
+
+	private:
+		static void EncodeBC1Block(const u8 (&texels)[16][4], u8 *out);
+		static void EncodeBC7Block(const u8 (&texels)[16][4], u8 *out);
+	};
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+
+#include "Simulation/BoidEngine.hpp"
+
+namespace Simulation
+{
+	struct BatchArgs
+	{
+		// The kernel changes the checksums, batch runs default to the scalar one so they match on every CPU
+		BatchArgs() { config.kernelLevel = KernelLevel::SCALAR; }
+
+		BoidEngineConfig config;
+		u32 ticks = 1000;
+		// Prints the state checksum every N ticks, 0 only prints the final one
+		u32 checksumInterval = 0;
+	};
+
+	// Recognized arguments: --seed=, --ticks=, --threads=, --boids=, --world=(width)x(height),
+	// --step= (seconds), --kernel=(scalar|sse4.2|avx2|avx512|auto), --reorder-every= (ticks, 0 never), --checksum-every=.
+	// Returns false if the argument is unknown or its value can not be parsed.
+	bool ParseBatchArgument(const std::string &arg, BatchArgs &args);
+
+	// Runs the engine for args.ticks ticks as fast as possible, the report is written on stdout.
+	// Returns the process exit code.
+	s32 RunBatch(const BatchArgs &args);
+}
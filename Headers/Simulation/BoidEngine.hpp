@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vector>
+
+#include "Maths/Maths.hpp"
+#include "Core/JobSystem.hpp"
+#include "Simulation/SpatialGrid.hpp"
+#include "Simulation/BoidKernel.hpp"
+
+namespace Simulation
+{
+	const u32 BOID_CHUNK = 512;
+	const f32 BOID_CELL_SIZE = 64.0f;
+	const f32 BOID_CURSOR_DIST = 256.0f;
+
+	struct BoidEngineConfig
+	{
+		u32 objectCount = 65536;
+		// At least 3 * BOID_DIST_MAX on each axis, smaller worlds make boids see each other twice through the wrap
+		Maths::IVec2 worldSize = Maths::IVec2(1920, 1080);
+		// Minimum grid cell size, never below BOID_DIST_MAX. Cells are stretched to divide the world evenly.
+		f32 cellSize = BOID_CELL_SIZE;
+		f32 timeStep = 1 / 60.0f;
+		u64 seed = 0;
+		// Worker threads spawned by the engine, the thread calling Step always takes part as well
+		u32 threadCount = 0;
+		// KernelLevel::COUNT picks the best level supported by the CPU
+		KernelLevel kernelLevel = KernelLevel::COUNT;
+		// Ticks between two reorders of the boid arrays in grid order, 0 keeps every boid at its initial index.
+		// Reordering changes the summation order inside the cells, so it is part of the deterministic state.
+		u32 reorderInterval = 0;
+	};
+
+	// 2D boids simulation on the CPU, independent from any window or graphics API.
+	// Every tick advances by the same fixed time step, and all the random state comes from the seed:
+	// two engines with the same config produce bit-identical results.
+	class BoidEngine
+	{
+	public:
+		BoidEngine() = default;
+		~BoidEngine();
+
+		// Must be called from the thread that will call Step.
+		void Init(const BoidEngineConfig &config);
+		void Shutdown();
+
+		void Step();
+		// The cursor pushes boids away while it is pressed, applied from the next tick.
+		void SetCursor(Maths::Vec2 position, bool pressed);
+
+		u64 GetTick() const;
+		KernelLevel GetKernelLevel() const;
+		const BoidEngineConfig &GetConfig() const;
+		const std::vector<Maths::Vec2> &GetPositions() const;
+		const std::vector<Maths::Vec2> &GetVelocities() const;
+		// Stable id of the boid stored at each index of the arrays above, the identity until the first reorder.
+		const std::vector<u32> &GetObjectIds() const;
+		// FNV-1a hash of the raw bits of every position and velocity, in stable id order.
+		u64 ComputeChecksum() const;
+
+	private:
+		BoidEngineConfig config;
+		Core::JobSystem jobSystem;
+		SpatialGrid grid;
+		NeighbourKernel neighbourKernel = nullptr;
+		KernelLevel kernelLevel = KernelLevel::SCALAR;
+		Maths::IVec2 cellCount;
+		Maths::Vec2 cellSize;
+		u64 tick = 0;
+		u64 rngState = 0;
+		Maths::Vec2 cursorPos;
+		bool cursorPressed = false;
+
+		std::vector<Maths::Vec2> positions;
+		std::vector<Maths::Vec2> velocities;
+		std::vector<Maths::Vec2> accels;
+		// Index to stable id, and stable id to index
+		std::vector<u32> objectIds;
+		std::vector<u32> objectSlots;
+		std::vector<u32> reorderedIds;
+		// Copies of the positions and velocities in grid order, read by the neighbour kernel
+		std::vector<f32> sortedPosX;
+		std::vector<f32> sortedPosY;
+		std::vector<f32> sortedVelX;
+		std::vector<f32> sortedVelY;
+
+		u32 NextU32();
+		f32 NextFloat01();
+		s32 GetCell(Maths::IVec2 pos, Maths::IVec2 &dt) const;
+		static void GatherJob(void *data, u32 begin, u32 end);
+		static void CellUpdateJob(void *data, u32 begin, u32 end);
+		static void PostUpdateJob(void *data, u32 begin, u32 end);
+		static void ReorderJob(void *data, u32 begin, u32 end);
+		void ProcessCellUpdate(u32 cx, u32 cy);
+		void ProcessReorder(u32 begin, u32 end);
+		void ProcessPostUpdate(u32 begin, u32 end);
+	};
+}
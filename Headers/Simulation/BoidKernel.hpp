@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Types.hpp"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BOID_KERNEL_X86
+#endif
+
+namespace Simulation
+{
+	// Boid state copied in grid order, so the neighbours of a cell are contiguous in every array.
+	struct BoidSoA
+	{
+		const f32 *posX = nullptr;
+		const f32 *posY = nullptr;
+		const f32 *velX = nullptr;
+		const f32 *velY = nullptr;
+	};
+
+	// The boid whose neighbours are evaluated. 'x' and 'y' already include the wrap around offset
+	// of the neighbour cell, 'self' is the sorted index of the boid so that it skips itself.
+	struct NeighbourQuery
+	{
+		f32 x = 0;
+		f32 y = 0;
+		u32 self = 0;
+		f32 maxDistSqr = 0;
+		f32 minDistSqr = 0;
+		f32 avoidScale = 0;
+	};
+
+	struct NeighbourSums
+	{
+		f32 posX = 0;
+		f32 posY = 0;
+		f32 velX = 0;
+		f32 velY = 0;
+		f32 avoidX = 0;
+		f32 avoidY = 0;
+		u32 count = 0;
+		u32 avoidCount = 0;
+	};
+
+	// Accumulates the neighbours in [begin, end) of the sorted arrays into 'sums'.
+	typedef void (*NeighbourKernel)(const BoidSoA &boids, u32 begin, u32 end, const NeighbourQuery &query, NeighbourSums &sums);
+
+	enum class KernelLevel : u8
+	{
+		SCALAR = 0,
+		SSE42,
+		AVX2,
+		AVX512,
+		COUNT
+	};
+
+	// Highest kernel level supported by both the CPU and the OS.
+	KernelLevel DetectKernelLevel();
+	NeighbourKernel GetNeighbourKernel(KernelLevel level);
+	const char *GetKernelLevelName(KernelLevel level);
+
+	// Each SIMD kernel lives in its own translation unit, built for its instruction set only.
+	void AccumulateNeighboursScalar(const BoidSoA &boids, u32 begin, u32 end, const NeighbourQuery &query, NeighbourSums &sums);
+	void AccumulateNeighboursSSE42(const BoidSoA &boids, u32 begin, u32 end, const NeighbourQuery &query, NeighbourSums &sums);
+	void AccumulateNeighboursAVX2(const BoidSoA &boids, u32 begin, u32 end, const NeighbourQuery &query, NeighbourSums &sums);
+	void AccumulateNeighboursAVX512(const BoidSoA &boids, u32 begin, u32 end, const NeighbourQuery &query, NeighbourSums &sums);
+}
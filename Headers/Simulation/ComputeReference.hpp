@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vector>
+#include <bit>
+
+#include "Maths/Maths.hpp"
+#include "Core/JobSystem.hpp"
+#include "Simulation/SimulationSizes.hpp"
+
+namespace Simulation
+{
+	// Same 64 bytes as GameThread::GetInitialSimulationData, the compute shaders split them in streams (see SimulationSizes::PackState).
+	struct Object
+	{
+		Maths::Vec3 position;
+		f32 padding0;
+		Maths::Vec3 velocity;
+		f32 padding1;
+		Maths::Vec3 accel;
+		f32 padding2;
+		Maths::Vec4 rotation;
+	};
+	static_assert(sizeof(Object) == 64, "Object must match the shader layout");
+
+	// padding0 holds the raw bits of the stable id of the object, it follows the object through the reorders
+	inline u32 GetObjectId(const Object &object)
+	{
+		return std::bit_cast<u32>(object.padding0);
+	}
+
+	// Time spent in each stage of the last frame, in microseconds.
+	struct ComputeTimings
+	{
+		f64 bin0 = 0;
+		f64 bin1 = 0;
+		f64 bin2 = 0;
+		f64 sim0 = 0;
+		f64 sim1 = 0;
+		// Zero on the frames without reorder
+		f64 reorder = 0;
+	};
+
+	// CPU implementation of the bin0, bin1, bin2, sim0 and sim1 compute shaders. sim0 runs per chunk, or per
+	// boid like sim0boid when the sizes ask for NEIGHBOUR_PASS_BOID (sim0tiled gives the same results as sim0).
+	// Each shader invocation becomes one iteration of a job, with the same buffers and the same sizes
+	// as the specialization constants. Like on the GPU, the order of the objects inside a chunk comes
+	// from the atomic increments of bin0: it depends on the thread timing, and so do the last bits
+	// of the simulation results.
+	class ComputeReference
+	{
+	public:
+		ComputeReference() = default;
+		~ComputeReference();
+
+		// The calling thread becomes the owner of the job system and must be the one calling Step.
+		void Init(const SimulationSizes &sizes, u32 workerCount);
+		void Shutdown();
+
+		// Same layout as GameThread::GetInitialSimulationData, 4 vectors per object.
+		void SetObjects(const std::vector<Maths::Vec4> &data);
+		const std::vector<Object> &GetObjects() const;
+
+		// Runs the reorder when it is due, the binning passes then sim0 and sim1, like one frame of the GPU.
+		void Step();
+		// Only runs the chunk clear and the bin0, bin1 and bin2 passes.
+		void Bin();
+		// Same layout as the binning buffer of the shaders.
+		const std::vector<u32> &GetBins() const;
+		const ComputeTimings &GetTimings() const;
+
+		// Largest absolute difference on positions and velocities with another set of objects,
+		// matched by stable id since either set may have been reordered.
+		f32 MaxDifference(const Object *other, u32 count) const;
+
+	private:
+		Core::JobSystem jobSystem;
+		SimulationSizes sizes;
+		std::vector<Object> objects;
+		std::vector<u32> bins;
+		// Shared memory of the bin1 work group
+		std::vector<u32> laneSums;
+		// Region of the compute buffer written by the reorder pass
+		std::vector<Object> reordered;
+		u64 frame = 0;
+		ComputeTimings timings;
+
+		static void Bin0Job(void *data, u32 begin, u32 end);
+		static void Bin1SumJob(void *data, u32 begin, u32 end);
+		static void Bin1StartJob(void *data, u32 begin, u32 end);
+		static void Bin2Job(void *data, u32 begin, u32 end);
+		static void Sim0Job(void *data, u32 begin, u32 end);
+		static void Sim0BoidJob(void *data, u32 begin, u32 end);
+		static void Sim1Job(void *data, u32 begin, u32 end);
+		static void ReorderJob(void *data, u32 begin, u32 end);
+		void Bin0(u32 id);
+		void Bin1Sum(u32 lane);
+		void Bin1Start(u32 lane);
+		void Bin2(u32 id);
+		void Sim0(u32 index);
+		void Sim0Boid(u32 index);
+		void UpdateAccel(u32 boid1, Maths::IVec3 chunkPos);
+		void Sim1(u32 id);
+	};
+}
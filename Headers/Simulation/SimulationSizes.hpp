@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Types.hpp"
+#include "Maths/Maths.hpp"
+
+namespace Simulation
+{
+	// Specialization constant ids of shaderSimData.h
+	enum SimulationSpecConstant : u32
+	{
+		SPEC_OBJECT_COUNT = 0,
+		SPEC_WORLD_SIZE = 1,
+		SPEC_CHUNK_COUNT_SIDE = 2,
+		SPEC_STATE_HALF = 3,
+		SPEC_COUNT
+	};
+
+	// Shader used for the neighbour evaluation pass, chosen at launch
+	enum NeighbourPass : u32
+	{
+		// sim0.comp: one invocation per chunk, neighbours read from the storage buffer
+		NEIGHBOUR_PASS_CELL = 0,
+		// sim0tiled.comp: one work group per chunk, neighbours staged in shared memory
+		NEIGHBOUR_PASS_TILED,
+		// sim0boid.comp: one invocation per boid in the binning order, evens out crowded chunks
+		NEIGHBOUR_PASS_BOID,
+		NEIGHBOUR_PASS_COUNT
+	};
+
+	// Runtime sizes of the GPU simulation. The three first values and halfState are sent to the compute shaders as
+	// specialization constants, the others are derived with the same formulas as in shaderSimData.h.
+	struct SimulationSizes
+	{
+		u32 objectCount = 0;
+		u32 worldSize = 0;
+		u32 chunkCountSide = 0;
+		u32 chunkCount = 0;
+		// Layout of the binning buffer, see the BIN_*_OFFSET constants. The chunk counts are at 0.
+		u32 binCellStartOffset = 0;
+		u32 binSortedOffset = 0;
+		u32 binObjectCellOffset = 0;
+		u32 binObjectSlotOffset = 0;
+		u64 binBufferCount = 0;
+		// Layout of the culling buffer, see the CULL_* constants
+		u32 cullListCount = 0;
+		u64 cullLodStateOffset = 0;
+		u64 cullBufferCount = 0;
+		// Layout of the object state, see the STATE_* constants
+		u32 stateVectorUintCount = 3;
+		u64 stateVelocityOffset = 0;
+		u64 stateAccelOffset = 0;
+		u64 stateRotationOffset = 0;
+		u64 stateUintCount = 0;
+		// Not sizes, but fixed at launch like them and needed by the same code
+		NeighbourPass neighbourPass = NEIGHBOUR_PASS_CELL;
+		// Frames between two reorders of the object state in chunk order, 0 never reorders
+		u32 reorderInterval = 0;
+		// Velocities and accelerations stored as half floats, see STATE_HALF. Set before Init.
+		bool halfState = false;
+
+		// Picks the largest chunk grid whose chunks are still at least BOID_DIST_MAX wide.
+		// Returns false and fills 'error' if the sizes can not be simulated.
+		bool Init(u32 objectCount, u32 worldSize, std::string &error);
+
+		// Values in the order of the SimulationSpecConstant ids
+		void GetSpecializationData(u32 (&data)[SPEC_COUNT]) const;
+
+		// Object state of the GPU simulation, stateUintCount uints, from 'objects' laid out like
+		// GameThread::GetInitialSimulationData: 4 vectors per object, position, velocity, acceleration and rotation.
+		std::vector<u32> PackState(const std::vector<Maths::Vec4> &objects) const;
+		// Position of object 'index' in a packed state, w holds the raw bits of its stable id
+		Maths::Vec4 GetPackedPosition(const u32 *state, u32 index) const;
+		Maths::Vec4 GetPackedRotation(const u32 *state, u32 index) const;
+
+		// Invocations of the neighbour pass dispatch, see GetDispatchSize
+		u32 GetNeighbourInvocationCount() const;
+		// Compiled shader of the neighbour pass, relative to the working directory
+		const char *GetNeighbourShaderPath() const;
+
+		// Group counts of a dispatch running 'invocationCount' invocations of COMPUTE_GROUP_SIZE wide groups.
+		static void GetDispatchSize(u32 invocationCount, u32 &groupsX, u32 &groupsY);
+	};
+
+	// Recognized arguments: --boids=, --world-size= (side of the cube), --neighbour-pass=cell|tiled|boid,
+	// --reorder-every= (frames), --half-state. The counts are only stored, Init must be called with them afterwards.
+	// Returns false if the argument is unknown or its value can not be parsed.
+	bool ParseSimulationArgument(const std::string &arg, SimulationSizes &sizes);
+}
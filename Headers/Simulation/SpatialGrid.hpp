@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+
+#include "Maths/Maths.hpp"
+#include "Core/JobSystem.hpp"
+
+namespace Simulation
+{
+	const u32 GRID_MIN_CHUNK_SIZE = 8192;
+	const u32 GRID_CELL_BLOCK_SIZE = 1024;
+
+	// Uniform grid stored in compressed sparse row form: the objects of cell 'c' are
+	// sortedIndices[cellStart[c]] .. sortedIndices[cellStart[c] + cellCounts[c] - 1].
+	// It is rebuilt every tick with a parallel counting sort (histogram, prefix sum, scatter).
+	// Objects keep their index order inside a cell, so the result does not depend on the thread count.
+	class SpatialGrid
+	{
+	public:
+		SpatialGrid() = default;
+		~SpatialGrid() = default;
+
+		// Buffers only ever grow, a rebuild with the same object and cell counts does not allocate.
+		void Build(Core::JobSystem &jobs, const Maths::Vec2 *positions, u32 objectCount, Maths::IVec2 cellCount, Maths::Vec2 cellSize);
+
+		inline u32 GetCellStart(u32 cell) const { return cellStart[cell]; }
+		inline u32 GetCellCount(u32 cell) const { return cellCounts[cell]; }
+		inline const u32 *GetSortedIndices() const { return sortedIndices.data(); }
+		inline u32 GetTotalCells() const { return totalCells; }
+
+	private:
+		std::vector<u32> cellStart;
+		std::vector<u32> cellCounts;
+		std::vector<u32> sortedIndices;
+		std::vector<u32> objectCells;
+		// One histogram row per chunk, turned into per chunk write offsets by the prefix sum
+		std::vector<u32> chunkOffsets;
+		std::vector<u32> blockOffsets;
+
+		const Maths::Vec2 *positions = nullptr;
+		Maths::IVec2 cellCount;
+		Maths::Vec2 cellSize = Maths::Vec2(1);
+		u32 objectCount = 0;
+		u32 totalCells = 0;
+		u32 chunkCount = 0;
+		u32 chunkSize = 0;
+		u32 blockCount = 0;
+
+		static void HistogramJob(void *data, u32 begin, u32 end);
+		static void PrefixSumJob(void *data, u32 begin, u32 end);
+		static void OffsetJob(void *data, u32 begin, u32 end);
+		static void ScatterJob(void *data, u32 begin, u32 end);
+	};
+}
@@ -0,0 +1,727 @@
+#include "Benchmarks.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <algorithm>
+#include <bit>
+
+#include "Core/JobSystem.hpp"
+#include "Simulation/SpatialGrid.hpp"
+#include "Simulation/BoidKernel.hpp"
+#include "Simulation/ComputeReference.hpp"
+
+typedef u32 uint;
+#include "../Assets/Shaders/shaderSimData.h"
+
+namespace
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	f64 ElapsedMicros(Clock::time_point start)
+	{
+		return std::chrono::duration<f64, std::micro>(Clock::now() - start).count();
+	}
+
+	// Small amount of arithmetic per task, close to what a sparse cell update costs
+	void SmallTask(f32 *out, u32 index, u32 iterations)
+	{
+		f32 acc = (f32)(index);
+		for (u32 i = 0; i < iterations; i++)
+			acc = acc * 0.999f + sqrtf((f32)(i + index));
+		out[index] = acc;
+	}
+
+	// Replica of the pool that used to live in GameThread: one task vector behind a mutex,
+	// workers spinning on it, and the producer spinning on a shared counter.
+	class LegacyPool
+	{
+	public:
+		struct Task
+		{
+			u32 index;
+		};
+
+		void Init(u32 threadCount, f32 *output, u32 taskIterations)
+		{
+			out = output;
+			iterations = taskIterations;
+			poolExit = false;
+			threads.resize(threadCount);
+			for (u32 i = 0; i < threadCount; i++)
+				threads[i] = std::thread(&LegacyPool::ThreadFunc, this);
+		}
+
+		void Quit()
+		{
+			poolExit = true;
+			for (u32 i = 0; i < threads.size(); i++)
+				threads[i].join();
+			threads.clear();
+		}
+
+		void Run(u32 taskCount)
+		{
+			taskLock.lock();
+			for (u32 i = 0; i < taskCount; i++)
+				tasks.push_back({i});
+			taskCounter = taskCount;
+			taskLock.unlock();
+
+			while (taskCounter != 0)
+				Update();
+		}
+
+	private:
+		std::vector<std::thread> threads;
+		std::vector<Task> tasks;
+		std::atomic_uint32_t taskCounter = 0;
+		std::atomic_bool poolExit = false;
+		std::mutex taskLock;
+		f32 *out = nullptr;
+		u32 iterations = 0;
+
+		bool Update()
+		{
+			taskLock.lock();
+			Task task;
+			task.index = (u32)(-1);
+			if (!tasks.empty())
+			{
+				task = tasks.back();
+				tasks.pop_back();
+			}
+			taskLock.unlock();
+
+			if (task.index == (u32)(-1))
+				return false;
+			SmallTask(out, task.index, iterations);
+			taskCounter--;
+			return true;
+		}
+
+		void ThreadFunc()
+		{
+			while (!poolExit)
+				Update();
+		}
+	};
+
+	struct JobData
+	{
+		f32 *out;
+		u32 iterations;
+	};
+
+	void RunJob(void *data, u32 begin, u32 end)
+	{
+		const JobData *jobData = static_cast<const JobData *>(data);
+		for (u32 i = begin; i < end; i++)
+			SmallTask(jobData->out, i, jobData->iterations);
+	}
+
+	struct KernelRun
+	{
+		std::vector<Simulation::NeighbourSums> sums;
+		f64 micros = 0;
+	};
+
+	KernelRun RunKernel(Simulation::NeighbourKernel kernel, const Simulation::SpatialGrid &grid, const Simulation::BoidSoA &boids, Maths::IVec2 cellCount, u32 rounds)
+	{
+		Simulation::NeighbourQuery query;
+		query.maxDistSqr = BOID_DIST_MAX * BOID_DIST_MAX;
+		query.minDistSqr = BOID_DIST_MIN * BOID_DIST_MIN;
+		query.avoidScale = BOID_DIST_MIN * BOID_DIST_MIN * BOID_DIST_MIN;
+
+		KernelRun run;
+		run.sums.resize(OBJECT_COUNT);
+		Clock::time_point start = Clock::now();
+		for (u32 r = 0; r < rounds; r++)
+		{
+			for (s32 cy = 0; cy < cellCount.y; cy++)
+			{
+				for (s32 cx = 0; cx < cellCount.x; cx++)
+				{
+					const u32 cell = cx + cy * cellCount.x;
+					const u32 first = grid.GetCellStart(cell);
+					const u32 last = first + grid.GetCellCount(cell);
+					for (u32 index = first; index < last; index++)
+					{
+						Simulation::NeighbourSums sums;
+						query.x = boids.posX[index];
+						query.y = boids.posY[index];
+						query.self = index;
+						for (s32 y = std::max(cy - 1, 0); y <= std::min(cy + 1, cellCount.y - 1); y++)
+						{
+							for (s32 x = std::max(cx - 1, 0); x <= std::min(cx + 1, cellCount.x - 1); x++)
+							{
+								const u32 other = x + y * cellCount.x;
+								const u32 otherStart = grid.GetCellStart(other);
+								kernel(boids, otherStart, otherStart + grid.GetCellCount(other), query, sums);
+							}
+						}
+						run.sums[index] = sums;
+					}
+				}
+			}
+		}
+		run.micros = ElapsedMicros(start);
+		return run;
+	}
+
+	void PrintResult(const char *name, f64 micros, u32 rounds, f64 reference)
+	{
+		f64 perRound = micros / rounds;
+		printf("  %-28s %10.1f us/round  x%.2f\n", name, perRound, reference / perRound);
+	}
+
+	u32 GetChunkIndex(const Simulation::SimulationSizes &sizes, const Maths::Vec3 &position)
+	{
+		const s32 side = (s32)(sizes.chunkCountSide);
+		const Maths::Vec3 chunkPos = position * (f32)(side) / (f32)(sizes.worldSize);
+		const s32 x = std::clamp((s32)(chunkPos.x), 0, side - 1);
+		const s32 y = std::clamp((s32)(chunkPos.y), 0, side - 1);
+		const s32 z = std::clamp((s32)(chunkPos.z), 0, side - 1);
+		return x + ((z * side) + y) * side;
+	}
+
+	// Replica of the sort0 and sort1 shaders replaced by the counting sort: 64 invocations each
+	// append a slice of the objects to their own fixed size list per chunk, then one invocation per
+	// chunk merges the 64 lists into a fixed size bucket. Full lists and buckets drop objects.
+	class LegacyBinning
+	{
+	public:
+		static const u32 THREAD_COUNT = 64;
+
+		void Init(const Simulation::SimulationSizes &simSizes, const std::vector<Simulation::Object> &simObjects)
+		{
+			sizes = simSizes;
+			objects = &simObjects;
+			maxObjectsPerChunk = sizes.objectCount * 4 / sizes.chunkCount + 1;
+			threadObjectPerChunk = maxObjectsPerChunk / 4 + 1;
+			threadObjectCount = (sizes.objectCount + THREAD_COUNT - 1) / THREAD_COUNT;
+			lists.assign((size_t)(THREAD_COUNT) * sizes.chunkCount * threadObjectPerChunk, 0);
+			sorted.assign((size_t)(sizes.chunkCount) * maxObjectsPerChunk, 0);
+		}
+
+		void Run(Core::JobSystem &jobs)
+		{
+			Core::JobCounter counter;
+			jobs.ParallelFor(counter, THREAD_COUNT, 1, &LegacyBinning::Sort0Job, this);
+			jobs.Wait(counter);
+			jobs.ParallelFor(counter, sizes.chunkCount, 64, &LegacyBinning::Sort1Job, this);
+			jobs.Wait(counter);
+		}
+
+		u64 GetMemorySize() const
+		{
+			return (lists.size() + sorted.size()) * sizeof(u32);
+		}
+
+		u32 GetBinnedCount() const
+		{
+			u32 result = 0;
+			for (u32 i = 0; i < sizes.chunkCount; i++)
+				result += sorted[(size_t)(i) * maxObjectsPerChunk];
+			return result;
+		}
+
+	private:
+		Simulation::SimulationSizes sizes;
+		const std::vector<Simulation::Object> *objects = nullptr;
+		u32 maxObjectsPerChunk = 0;
+		u32 threadObjectPerChunk = 0;
+		u32 threadObjectCount = 0;
+		std::vector<u32> lists;
+		std::vector<u32> sorted;
+
+		static void Sort0Job(void *data, u32 begin, u32 end)
+		{
+			LegacyBinning *self = static_cast<LegacyBinning *>(data);
+			for (u32 i = begin; i < end; i++)
+				self->Sort0(i);
+		}
+
+		static void Sort1Job(void *data, u32 begin, u32 end)
+		{
+			LegacyBinning *self = static_cast<LegacyBinning *>(data);
+			for (u32 i = begin; i < end; i++)
+				self->Sort1(i);
+		}
+
+		void Sort0(u32 index)
+		{
+			u32 *threadLists = lists.data() + (size_t)(threadObjectPerChunk) * sizes.chunkCount * index;
+			for (u32 i = 0; i < sizes.chunkCount; i++)
+				threadLists[i * threadObjectPerChunk] = 0;
+
+			for (u32 i = 0; i < threadObjectCount; i++)
+			{
+				const u32 id = index * threadObjectCount + i;
+				if (id >= sizes.objectCount)
+					break;
+				u32 *list = threadLists + GetChunkIndex(sizes, (*objects)[id].position) * threadObjectPerChunk;
+				if (list[0] + 1 >= threadObjectPerChunk)
+					continue;
+				list[0]++;
+				list[list[0]] = id;
+			}
+		}
+
+		void Sort1(u32 index)
+		{
+			u32 *bucket = sorted.data() + (size_t)(maxObjectsPerChunk) * index;
+			u32 mergeCount = 0;
+			for (u32 i = 0; i < THREAD_COUNT && mergeCount + 1 < maxObjectsPerChunk; i++)
+			{
+				const u32 *list = lists.data() + (size_t)(threadObjectPerChunk) * (sizes.chunkCount * i + index);
+				for (u32 j = 0; j < list[0] && mergeCount + 1 < maxObjectsPerChunk; j++)
+				{
+					mergeCount++;
+					bucket[mergeCount] = list[j + 1];
+				}
+			}
+			bucket[0] = mergeCount;
+		}
+	};
+
+	// Checks that every object is in the sorted range of its own chunk exactly once, returns the number of errors.
+	u32 CheckBins(const Simulation::SimulationSizes &sizes, const std::vector<u32> &bins, const std::vector<Simulation::Object> &objects)
+	{
+		std::vector<u8> seen(sizes.objectCount, 0);
+		u32 errors = 0;
+		for (u32 cell = 0; cell < sizes.chunkCount; cell++)
+		{
+			const u32 first = bins[sizes.binCellStartOffset + cell];
+			const u32 count = bins[BIN_CELL_COUNT_OFFSET + cell];
+			for (u32 i = first; i < first + count && i < sizes.objectCount; i++)
+			{
+				const u32 id = bins[sizes.binSortedOffset + i];
+				if (id >= sizes.objectCount || seen[id]++ || GetChunkIndex(sizes, objects[id].position) != cell)
+					errors++;
+			}
+		}
+		for (u32 i = 0; i < sizes.objectCount; i++)
+		{
+			if (!seen[i])
+				errors++;
+		}
+		return errors;
+	}
+
+	// Uniform like GameThread::GetInitialSimulationData, or packed in a ball spanning a few chunks
+	std::vector<Maths::Vec4> MakeSimulationData(const Simulation::SimulationSizes &sizes, bool clustered)
+	{
+		const f32 worldSize = (f32)(sizes.worldSize);
+		std::vector<Maths::Vec4> result((size_t)(sizes.objectCount) * 4);
+		srand(1234);
+		for (u32 i = 0; i < sizes.objectCount; i++)
+		{
+			Maths::Vec3 dir = (Maths::Vec3(rand() / (f32)(RAND_MAX), rand() / (f32)(RAND_MAX), rand() / (f32)(RAND_MAX)) * 2 - 1).Normalize();
+			Maths::Vec3 pos = Maths::Vec3(rand() / (f32)(RAND_MAX), rand() / (f32)(RAND_MAX), rand() / (f32)(RAND_MAX)) * worldSize;
+			if (clustered)
+				pos = Maths::Vec3(worldSize * 0.5f) + dir * (rand() / (f32)(RAND_MAX)) * BOID_DIST_MAX * 2;
+			result[i*4] = Maths::Vec4(pos, std::bit_cast<f32>(i));
+			result[i*4+1] = Maths::Vec4(dir, 0) * BOID_MAX_SPEED * 0.2f * (1/144.0f);
+			result[i*4+3] = Maths::Vec4(0, 0, 0, 1);
+		}
+		return result;
+	}
+
+	// The scalar loops Mat4 and Vec4 used before Maths/Simd.hpp, the reference of the maths benchmark
+	Maths::Mat4 ScalarMultiply(const Maths::Mat4 &a, const Maths::Mat4 &b)
+	{
+		Maths::Mat4 out;
+		for (size_t j = 0; j < 4; j++)
+		{
+			for (size_t i = 0; i < 4; i++)
+			{
+				f32 res = 0;
+				for (size_t k = 0; k < 4; k++)
+					res += a.content[j + k * 4] * b.content[k + i * 4];
+				out.content[j + i * 4] = res;
+			}
+		}
+		return out;
+	}
+
+	Maths::Vec4 ScalarTransform(const Maths::Mat4 &a, const Maths::Vec4 &v)
+	{
+		Maths::Vec4 out;
+		for (size_t i = 0; i < 4; i++)
+		{
+			f32 res = 0;
+			for (size_t k = 0; k < 4; k++)
+				res += a.content[i + k * 4] * v[k];
+			out[i] = res;
+		}
+		return out;
+	}
+
+	// Same expression as the vector part of the benchmark, one component at a time
+	Maths::Vec4 ScalarVectorOps(const Maths::Vec4 &a, const Maths::Vec4 &b, f32 s)
+	{
+		Maths::Vec4 out;
+		for (size_t i = 0; i < 4; i++)
+		{
+			f32 res = (a[i] + b[i]) * s - a[i];
+			res /= b[i];
+			out[i] = res * b[i] + s;
+		}
+		return out;
+	}
+
+	Maths::Vec4 VectorOps(const Maths::Vec4 &a, const Maths::Vec4 &b, f32 s)
+	{
+		Maths::Vec4 res = (a + b) * s - a;
+		res /= b;
+		return res * b + s;
+	}
+
+	// Counts the values whose bits differ, -0 and +0 or two different NaNs included
+	u32 CountBitMismatches(const f32 *a, const f32 *b, size_t count)
+	{
+		u32 mismatches = 0;
+		for (size_t i = 0; i < count; i++)
+			mismatches += std::bit_cast<u32>(a[i]) != std::bit_cast<u32>(b[i]);
+		return mismatches;
+	}
+}
+
+bool Benchmarks::Run(const std::string &name)
+{
+	if (name == "jobs")
+		RunJobSystem();
+	else if (name == "neighbours")
+		RunNeighbourKernels();
+	else if (name == "reference")
+		RunComputeReference();
+	else if (name == "binning")
+		RunBinning();
+	else if (name == "maths")
+		RunMaths();
+	else
+		return false;
+	return true;
+}
+
+void Benchmarks::RunJobSystem()
+{
+	const u32 hardwareThreads = std::max<u32>(std::thread::hardware_concurrency(), 2);
+	const u32 workerCount = hardwareThreads - 1;
+	const u32 taskCounts[] = { 1024, 4096, 16384 };
+	const u32 iterationCounts[] = { 16, 256 };
+	const u32 rounds = 200;
+
+	printf("Job system benchmark, %u worker threads, %u rounds\n", workerCount, rounds);
+	for (u32 taskCount : taskCounts)
+	{
+		std::vector<f32> output(taskCount);
+		for (u32 iterations : iterationCounts)
+		{
+			printf("%u tasks, %u iterations per task:\n", taskCount, iterations);
+
+			LegacyPool legacy;
+			legacy.Init(workerCount, output.data(), iterations);
+			legacy.Run(taskCount);
+			Clock::time_point start = Clock::now();
+			for (u32 r = 0; r < rounds; r++)
+				legacy.Run(taskCount);
+			f64 legacyTime = ElapsedMicros(start);
+			legacy.Quit();
+			PrintResult("mutex task vector", legacyTime, rounds, legacyTime / rounds);
+
+			Core::JobSystem jobs;
+			jobs.Init(workerCount);
+			JobData data = { output.data(), iterations };
+
+			Core::JobCounter counter;
+			jobs.ParallelFor(counter, taskCount, 1, RunJob, &data);
+			jobs.Wait(counter);
+			start = Clock::now();
+			for (u32 r = 0; r < rounds; r++)
+			{
+				jobs.ParallelFor(counter, taskCount, 1, RunJob, &data);
+				jobs.Wait(counter);
+			}
+			PrintResult("job system, 1 task per job", ElapsedMicros(start), rounds, legacyTime / rounds);
+
+			const u32 grain = std::max<u32>(taskCount / (hardwareThreads * 8), 1);
+			start = Clock::now();
+			for (u32 r = 0; r < rounds; r++)
+			{
+				jobs.ParallelFor(counter, taskCount, grain, RunJob, &data);
+				jobs.Wait(counter);
+			}
+			PrintResult("job system, batched", ElapsedMicros(start), rounds, legacyTime / rounds);
+			jobs.Shutdown();
+		}
+	}
+}
+
+void Benchmarks::RunNeighbourKernels()
+{
+	const Maths::IVec2 res = Maths::IVec2(1920, 1080);
+	const f32 cellSize = 64;
+	const Maths::IVec2 cellCount = Maths::IVec2((s32)((res.x + cellSize - 1) / cellSize), (s32)((res.y + cellSize - 1) / cellSize));
+	const u32 rounds = 10;
+
+	std::vector<Maths::Vec2> positions(OBJECT_COUNT);
+	std::vector<Maths::Vec2> velocities(OBJECT_COUNT);
+	srand(1234);
+	for (u32 i = 0; i < OBJECT_COUNT; i++)
+	{
+		positions[i] = Maths::Vec2(rand() / (f32)(RAND_MAX) * res.x, rand() / (f32)(RAND_MAX) * res.y);
+		velocities[i] = Maths::Vec2(rand() / (f32)(RAND_MAX) * 2 - 1, rand() / (f32)(RAND_MAX) * 2 - 1) * BOID_MAX_SPEED;
+	}
+
+	Core::JobSystem jobs;
+	jobs.Init(std::max<u32>(std::thread::hardware_concurrency(), 2) - 1);
+	Simulation::SpatialGrid grid;
+	grid.Build(jobs, positions.data(), OBJECT_COUNT, cellCount, cellSize);
+	jobs.Shutdown();
+
+	std::vector<f32> posX(OBJECT_COUNT);
+	std::vector<f32> posY(OBJECT_COUNT);
+	std::vector<f32> velX(OBJECT_COUNT);
+	std::vector<f32> velY(OBJECT_COUNT);
+	for (u32 i = 0; i < OBJECT_COUNT; i++)
+	{
+		u32 boid = grid.GetSortedIndices()[i];
+		posX[i] = positions[boid].x;
+		posY[i] = positions[boid].y;
+		velX[i] = velocities[boid].x;
+		velY[i] = velocities[boid].y;
+	}
+	Simulation::BoidSoA boids;
+	boids.posX = posX.data();
+	boids.posY = posY.data();
+	boids.velX = velX.data();
+	boids.velY = velY.data();
+
+	const Simulation::KernelLevel detected = Simulation::DetectKernelLevel();
+	printf("Neighbour kernel benchmark, %u boids, %dx%d cells, %u rounds, best level %s\n", OBJECT_COUNT, cellCount.x, cellCount.y, rounds, Simulation::GetKernelLevelName(detected));
+
+	KernelRun reference = RunKernel(&Simulation::AccumulateNeighboursScalar, grid, boids, cellCount, rounds);
+	PrintResult(Simulation::GetKernelLevelName(Simulation::KernelLevel::SCALAR), reference.micros, rounds, reference.micros / rounds);
+	for (u8 level = (u8)(Simulation::KernelLevel::SCALAR) + 1; level <= (u8)(detected); level++)
+	{
+		Simulation::KernelLevel kernelLevel = (Simulation::KernelLevel)(level);
+		KernelRun run = RunKernel(Simulation::GetNeighbourKernel(kernelLevel), grid, boids, cellCount, rounds);
+		PrintResult(Simulation::GetKernelLevelName(kernelLevel), run.micros, rounds, reference.micros / rounds);
+
+		// Lanes are summed in a different order, so only the counts have to match exactly
+		u32 countErrors = 0;
+		f32 maxError = 0;
+		for (u32 i = 0; i < OBJECT_COUNT; i++)
+		{
+			const Simulation::NeighbourSums &a = reference.sums[i];
+			const Simulation::NeighbourSums &b = run.sums[i];
+			if (a.count != b.count || a.avoidCount != b.avoidCount)
+				countErrors++;
+			const f32 scale = std::max(1.0f, (f32)(a.count));
+			maxError = std::max(maxError, fabsf(a.posX - b.posX) / scale);
+			maxError = std::max(maxError, fabsf(a.posY - b.posY) / scale);
+			maxError = std::max(maxError, fabsf(a.velX - b.velX) / scale);
+			maxError = std::max(maxError, fabsf(a.velY - b.velY) / scale);
+		}
+		printf("    count mismatches: %u, max error per neighbour: %g\n", countErrors, maxError);
+	}
+}
+
+void Benchmarks::RunComputeReference()
+{
+	const u32 frames = 20;
+	const u32 workerCount = std::max<u32>(std::thread::hardware_concurrency(), 2) - 1;
+	// The per boid pass only matters with several threads, a crowded chunk can not stall a job then
+	const struct
+	{
+		Simulation::NeighbourPass pass;
+		const char *name;
+		u32 workerCount;
+		u32 reorderInterval;
+	} runs[] = {
+		{ Simulation::NEIGHBOUR_PASS_CELL, "per chunk", 0, 0 },
+		{ Simulation::NEIGHBOUR_PASS_CELL, "per chunk", workerCount, 0 },
+		{ Simulation::NEIGHBOUR_PASS_BOID, "per boid", workerCount, 0 },
+		{ Simulation::NEIGHBOUR_PASS_CELL, "per chunk", workerCount, 10 },
+	};
+	Simulation::SimulationSizes sizes;
+	std::string error;
+	if (!sizes.Init(OBJECT_COUNT, WORLD_SIZE, error))
+	{
+		printf("Invalid simulation size: %s\n", error.c_str());
+		return;
+	}
+	const std::vector<Maths::Vec4> initialData = MakeSimulationData(sizes, false);
+
+	printf("Compute reference benchmark, %u objects, %u chunks, %u frames\n", sizes.objectCount, sizes.chunkCount, frames);
+	std::vector<Simulation::Object> firstResult;
+	for (const auto &run : runs)
+	{
+		sizes.neighbourPass = run.pass;
+		sizes.reorderInterval = run.reorderInterval;
+		Simulation::ComputeReference reference;
+		reference.Init(sizes, run.workerCount);
+		reference.SetObjects(initialData);
+		Simulation::ComputeTimings total;
+		for (u32 f = 0; f < frames; f++)
+		{
+			reference.Step();
+			const Simulation::ComputeTimings &timings = reference.GetTimings();
+			total.bin0 += timings.bin0;
+			total.bin1 += timings.bin1;
+			total.bin2 += timings.bin2;
+			total.sim0 += timings.sim0;
+			total.sim1 += timings.sim1;
+			total.reorder += timings.reorder;
+		}
+		const f64 frameTime = (total.bin0 + total.bin1 + total.bin2 + total.sim0 + total.sim1 + total.reorder) / frames;
+		printf("%s sim0, %u worker threads, reorder every %u frames: %.3f ms/frame, %.1f M objects/s\n", run.name, run.workerCount, run.reorderInterval, frameTime / 1000, sizes.objectCount / frameTime);
+		printf("  bin0 %8.3f ms  bin1 %8.3f ms  bin2 %8.3f ms  sim0 %8.3f ms  sim1 %8.3f ms  reorder %8.3f ms\n", total.bin0 / frames / 1000, total.bin1 / frames / 1000, total.bin2 / frames / 1000, total.sim0 / frames / 1000, total.sim1 / frames / 1000, total.reorder / frames / 1000);
+
+		if (firstResult.empty())
+			firstResult = reference.GetObjects();
+		else
+			printf("  max difference with the first run: %g\n", reference.MaxDifference(firstResult.data(), sizes.objectCount));
+		reference.Shutdown();
+	}
+}
+
+void Benchmarks::RunBinning()
+{
+	const u32 rounds = 20;
+	const u32 workerCount = std::max<u32>(std::thread::hardware_concurrency(), 2) - 1;
+	Simulation::SimulationSizes sizes;
+	std::string error;
+	if (!sizes.Init(OBJECT_COUNT, WORLD_SIZE, error))
+	{
+		printf("Invalid simulation size: %s\n", error.c_str());
+		return;
+	}
+
+	printf("Binning benchmark, %u objects, %u chunks, %u rounds, %u worker threads\n", sizes.objectCount, sizes.chunkCount, rounds, workerCount);
+	const char *names[] = { "uniform", "clustered" };
+	for (u32 clustered = 0; clustered < 2; clustered++)
+	{
+		Simulation::ComputeReference reference;
+		reference.Init(sizes, workerCount);
+		reference.SetObjects(MakeSimulationData(sizes, clustered != 0));
+
+		f64 countingMicros = 0;
+		for (u32 r = 0; r < rounds; r++)
+		{
+			reference.Bin();
+			const Simulation::ComputeTimings &timings = reference.GetTimings();
+			countingMicros += timings.bin0 + timings.bin1 + timings.bin2;
+		}
+		const u32 countingErrors = CheckBins(sizes, reference.GetBins(), reference.GetObjects());
+		// Only one set of workers at a time, the objects stay readable after the shutdown
+		reference.Shutdown();
+
+		Core::JobSystem jobs;
+		jobs.Init(workerCount);
+		LegacyBinning legacy;
+		legacy.Init(sizes, reference.GetObjects());
+		Clock::time_point start = Clock::now();
+		for (u32 r = 0; r < rounds; r++)
+			legacy.Run(jobs);
+		const f64 legacyMicros = ElapsedMicros(start);
+		jobs.Shutdown();
+
+		printf("  %s distribution\n", names[clustered]);
+		printf("    two pass buckets %10.1f us/round  %8.2f MiB  %u objects dropped\n", legacyMicros / rounds, legacy.GetMemorySize() / (1024.0 * 1024.0), sizes.objectCount - legacy.GetBinnedCount());
+		printf("    counting sort    %10.1f us/round  %8.2f MiB  %u errors\n", countingMicros / rounds, sizes.binBufferCount * sizeof(u32) / (1024.0 * 1024.0), countingErrors);
+	}
+}
+
+void Benchmarks::RunMaths()
+{
+	const u32 count = 4096;
+	const u32 rounds = 200;
+	const char *simdName =
+#if defined(MATHS_SIMD_SSE)
+		"sse";
+#elif defined(MATHS_SIMD_NEON)
+		"neon";
+#else
+		"scalar fallback";
+#endif
+
+	// Products of random matrices, like the view projection and the model transforms
+	std::vector<Maths::Mat4> matrices(count);
+	std::vector<Maths::Vec4> vectors(count);
+	srand(1234);
+	for (u32 i = 0; i < count; i++)
+	{
+		const Maths::Vec3 position = Maths::Vec3(rand() / (f32)(RAND_MAX), rand() / (f32)(RAND_MAX), rand() / (f32)(RAND_MAX)) * 500.0f;
+		const Maths::Vec3 angles = Maths::Vec3(rand() / (f32)(RAND_MAX), rand() / (f32)(RAND_MAX), rand() / (f32)(RAND_MAX)) * 360.0f;
+		matrices[i] = Maths::Mat4::CreateTransformMatrix(position, angles, Maths::Vec3(rand() / (f32)(RAND_MAX) + 0.5f));
+		vectors[i] = Maths::Vec4(rand() / (f32)(RAND_MAX) * 2 - 1, rand() / (f32)(RAND_MAX) * 2 - 1, rand() / (f32)(RAND_MAX) * 2 - 1, rand() / (f32)(RAND_MAX) + 0.5f);
+	}
+	const Maths::Mat4 projection = Maths::Mat4::CreatePerspectiveProjectionMatrix(0.1f, 1000.0f, 70.0f, 16.0f / 9.0f);
+
+	printf("Maths benchmark, %u matrices and vectors, %u rounds, %s operators\n", count, rounds, simdName);
+	std::vector<Maths::Mat4> scalarMatrices(count);
+	std::vector<Maths::Mat4> simdMatrices(count);
+	Clock::time_point start = Clock::now();
+	for (u32 r = 0; r < rounds; r++)
+	{
+		for (u32 i = 0; i < count; i++)
+			scalarMatrices[i] = ScalarMultiply(projection, matrices[i]);
+	}
+	const f64 scalarMatrixTime = ElapsedMicros(start);
+	start = Clock::now();
+	for (u32 r = 0; r < rounds; r++)
+	{
+		for (u32 i = 0; i < count; i++)
+			simdMatrices[i] = projection * matrices[i];
+	}
+	printf("Mat4 * Mat4:\n");
+	PrintResult("scalar", scalarMatrixTime, rounds, scalarMatrixTime / rounds);
+	PrintResult(simdName, ElapsedMicros(start), rounds, scalarMatrixTime / rounds);
+	printf("    bit mismatches: %u\n", CountBitMismatches(scalarMatrices[0].content, simdMatrices[0].content, (size_t)(count) * 16));
+
+	std::vector<Maths::Vec4> scalarVectors(count);
+	std::vector<Maths::Vec4> simdVectors(count);
+	start = Clock::now();
+	for (u32 r = 0; r < rounds; r++)
+	{
+		for (u32 i = 0; i < count; i++)
+			scalarVectors[i] = ScalarTransform(matrices[i], vectors[i]);
+	}
+	const f64 scalarTransformTime = ElapsedMicros(start);
+	start = Clock::now();
+	for (u32 r = 0; r < rounds; r++)
+	{
+		for (u32 i = 0; i < count; i++)
+			simdVectors[i] = matrices[i] * vectors[i];
+	}
+	printf("Mat4 * Vec4:\n");
+	PrintResult("scalar", scalarTransformTime, rounds, scalarTransformTime / rounds);
+	PrintResult(simdName, ElapsedMicros(start), rounds, scalarTransformTime / rounds);
+	printf("    bit mismatches: %u\n", CountBitMismatches(&scalarVectors[0].x, &simdVectors[0].x, (size_t)(count) * 4));
+
+	start = Clock::now();
+	for (u32 r = 0; r < rounds; r++)
+	{
+		for (u32 i = 0; i < count; i++)
+			scalarVectors[i] = ScalarVectorOps(vectors[i], vectors[count - 1 - i], 0.75f);
+	}
+	const f64 scalarOpsTime = ElapsedMicros(start);
+	start = Clock::now();
+	for (u32 r = 0; r < rounds; r++)
+	{
+		for (u32 i = 0; i < count; i++)
+			simdVectors[i] = VectorOps(vectors[i], vectors[count - 1 - i], 0.75f);
+	}
+	printf("Vec4 +, -, *, /:\n");
+	PrintResult("scalar", scalarOpsTime, rounds, scalarOpsTime / rounds);
+	PrintResult(simdName, ElapsedMicros(start), rounds, scalarOpsTime / rounds);
+	printf("    bit mismatches: %u\n", CountBitMismatches(&scalarVectors[0].x, &simdVectors[0].x, (size_t)(count) * 4));
+}
@@ -0,0 +1,295 @@
+#include "Core/JobSystem.hpp"
+#include "Core/Profiler.hpp"
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <string>
+#endif
+
+using namespace Core;
+
+static thread_local JobContext *currentContext = nullptr;
+static thread_local JobSystem *currentSystem = nullptr;
+
+bool JobDeque::Push(Job *job)
+{
+	s64 b = bottom.load(std::memory_order_relaxed);
+	s64 t = top.load(std::memory_order_acquire);
+	if (b - t >= (s64)JOB_DEQUE_SIZE)
+		return false;
+
+	buffer[b & (JOB_DEQUE_SIZE - 1)].store(job, std::memory_order_relaxed);
+	bottom.store(b + 1, std::memory_order_release);
+	return true;
+}
+
+Job *JobDeque::Pop()
+{
+	s64 b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	s64 t = top.load(std::memory_order_relaxed);
+
+	if (t > b)
+	{
+		// Deque was already empty
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job *job = buffer[b & (JOB_DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+	if (t == b)
+	{
+		// Last item: race against the thieves for it
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			job = nullptr;
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+Job *JobDeque::Steal()
+{
+	s64 t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	s64 b = bottom.load(std::memory_order_acquire);
+	if (t >= b)
+		return nullptr;
+
+	Job *job = buffer[t & (JOB_DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+	if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return nullptr;
+	return job;
+}
+
+bool JobDeque::IsEmpty() const
+{
+	return bottom.load(std::memory_order_acquire) <= top.load(std::memory_order_acquire);
+}
+
+JobSystem::~JobSystem()
+{
+	Shutdown();
+}
+
+void JobSystem::Init(u32 workerCount)
+{
+	if (running)
+		Shutdown();
+
+	exit = false;
+	running = true;
+	contexts.resize(workerCount + 1);
+	for (u32 i = 0; i < contexts.size(); i++)
+	{
+		contexts[i] = std::make_unique<JobContext>();
+		contexts[i]->stealSeed = 0x9E3779B9u * (i + 1);
+	}
+
+	// Context 0 belongs to the thread that owns the system
+	currentContext = contexts[0].get();
+	currentSystem = this;
+
+	workers.resize(workerCount);
+	for (u32 i = 0; i < workerCount; i++)
+	{
+		workers[i] = std::thread(&JobSystem::WorkerFunc, this, i + 1);
+	}
+}
+
+void JobSystem::Shutdown()
+{
+	if (!running)
+		return;
+
+	exit = true;
+	wakeEpoch.fetch_add(1, std::memory_order_seq_cst);
+	wakeEpoch.notify_all();
+	for (u32 i = 0; i < workers.size(); i++)
+	{
+		if (workers[i].joinable())
+			workers[i].join();
+	}
+	workers.clear();
+	contexts.clear();
+	if (currentSystem == this)
+	{
+		currentContext = nullptr;
+		currentSystem = nullptr;
+	}
+	running = false;
+}
+
+bool JobSystem::IsRunning() const
+{
+	return running;
+}
+
+u32 JobSystem::GetWorkerCount() const
+{
+	return (u32)(workers.size());
+}
+
+JobContext *JobSystem::GetContext()
+{
+	return currentSystem == this ? currentContext : nullptr;
+}
+
+Job *JobSystem::AllocateJob(JobContext *ctx)
+{
+	Job *job = &ctx->pool[ctx->poolIndex & (JOB_POOL_SIZE - 1)];
+	ctx->poolIndex++;
+
+	// The ring wrapped around onto a job that is still queued: help until it is done
+	while (!job->finished.load(std::memory_order_acquire))
+	{
+		if (!RunOne(ctx))
+			std::this_thread::yield();
+	}
+	return job;
+}
+
+void JobSystem::Submit(JobCounter &counter, JobFunc func, void *data, u32 begin, u32 end)
+{
+	counter.value.fetch_add(1, std::memory_order_relaxed);
+
+	JobContext *ctx = GetContext();
+	if (!ctx)
+	{
+		// Foreign thread, there is no deque we are allowed to push to
+		func(data, begin, end);
+		counter.value.fetch_sub(1, std::memory_order_acq_rel);
+		return;
+	}
+
+	Job *job = AllocateJob(ctx);
+	job->func = func;
+	job->data = data;
+	job->begin = begin;
+	job->end = end;
+	job->counter = &counter;
+	job->finished.store(false, std::memory_order_relaxed);
+
+	if (!ctx->deque.Push(job))
+	{
+		Execute(job);
+		return;
+	}
+	WakeWorkers(1);
+}
+
+void JobSystem::ParallelFor(JobCounter &counter, u32 count, u32 grainSize, JobFunc func, void *data)
+{
+	if (grainSize == 0)
+		grainSize = 1;
+
+	for (u32 begin = 0; begin < count; begin += grainSize)
+	{
+		u32 end = begin + grainSize < count ? begin + grainSize : count;
+		Submit(counter, func, data, begin, end);
+	}
+}
+
+void JobSystem::Wait(JobCounter &counter)
+{
+	PROFILE_ZONE("JobSystem::Wait");
+	JobContext *ctx = GetContext();
+	while (!counter.IsDone())
+	{
+		if (!ctx || !RunOne(ctx))
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::WakeWorkers(u32 count)
+{
+	wakeEpoch.fetch_add(1, std::memory_order_seq_cst);
+	if (sleepingCount.load(std::memory_order_seq_cst) == 0)
+		return;
+
+	if (count > 1)
+		wakeEpoch.notify_all();
+	else
+		wakeEpoch.notify_one();
+}
+
+Job *JobSystem::FindJob(JobContext *ctx)
+{
+	Job *job = ctx->deque.Pop();
+	if (job)
+		return job;
+
+	// xorshift to pick a random victim, so that thieves do not all hammer the same deque
+	u32 seed = ctx->stealSeed;
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	ctx->stealSeed = seed;
+
+	const u32 count = (u32)(contexts.size());
+	for (u32 i = 0; i < count; i++)
+	{
+		JobContext *victim = contexts[(seed + i) % count].get();
+		if (victim == ctx)
+			continue;
+		job = victim->deque.Steal();
+		if (job)
+			return job;
+	}
+	return nullptr;
+}
+
+bool JobSystem::RunOne(JobContext *ctx)
+{
+	Job *job = FindJob(ctx);
+	if (!job)
+		return false;
+	Execute(job);
+	return true;
+}
+
+void JobSystem::Execute(Job *job)
+{
+	JobCounter *counter = job->counter;
+	job->func(job->data, job->begin, job->end);
+	// The slot can be reused by its owner as soon as it is flagged, do not touch it afterwards
+	job->finished.store(true, std::memory_order_release);
+	counter->value.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void JobSystem::WorkerFunc(u32 index)
+{
+#ifdef _WIN32
+	SetThreadDescription(GetCurrentThread(), (L"Job Worker " + std::to_wstring(index)).c_str());
+#endif
+	PROFILE_THREAD("Job Worker " + std::to_string(index));
+	JobContext *ctx = contexts[index].get();
+	currentContext = ctx;
+	currentSystem = this;
+
+	while (!exit.load(std::memory_order_relaxed))
+	{
+		bool found = false;
+		for (u32 i = 0; i < JOB_SPIN_COUNT && !found; i++)
+		{
+			found = RunOne(ctx);
+			if (!found)
+				std::this_thread::yield();
+		}
+		if (found)
+			continue;
+
+		// Nothing to do: park until a producer bumps the epoch
+		u32 epoch = wakeEpoch.load(std::memory_order_seq_cst);
+		sleepingCount.fetch_add(1, std::memory_order_seq_cst);
+		bool hasWork = false;
+		for (u32 i = 0; i < contexts.size() && !hasWork; i++)
+			hasWork = !contexts[i]->deque.IsEmpty();
+		if (!hasWork && !exit.load(std::memory_order_relaxed))
+			wakeEpoch.wait(epoch, std::memory_order_seq_cst);
+		sleepingCount.fetch_sub(1, std::memory_order_seq_cst);
+	}
+
+	currentContext = nullptr;
+	currentSystem = nullptr;
+}
@@ -0,0 +1,315 @@
+#include "Core/Logger.hpp"
+#include "Core/Profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+using namespace Core;
+
+namespace
+{
+	const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	const char *const LEVEL_NAMES[LOG_LEVEL_NONE + 1] = { "debug", "info", "warning", "error", "none" };
+
+	std::atomic<LogThreadBuffer *> bufferList = nullptr;
+	std::atomic_bool running = false;
+	std::thread flushThread;
+	LoggerSettings sinks;
+	std::ofstream file;
+
+	static thread_local LogThreadBuffer *threadBuffer = nullptr;
+	// Head of the record being written by this thread, published by EndRecord
+	static thread_local u64 pendingHead = 0;
+
+	struct PendingLine
+	{
+		u64 time;
+		std::string text;
+	};
+
+	// Buffers outlive their thread, messages logged just before a thread exits are still written.
+	// Also writes the last messages when the application returns without calling Shutdown.
+	struct BufferListOwner
+	{
+		~BufferListOwner()
+		{
+			Logger::Shutdown();
+			LogThreadBuffer *buffer = bufferList.exchange(nullptr);
+			while (buffer)
+			{
+				LogThreadBuffer *next = buffer->next;
+				delete buffer;
+				buffer = next;
+			}
+		}
+	} bufferListOwner;
+
+	LogThreadBuffer *GetThreadBuffer()
+	{
+		if (threadBuffer)
+			return threadBuffer;
+
+		LogThreadBuffer *buffer = new LogThreadBuffer();
+		LogThreadBuffer *head = bufferList.load(std::memory_order_relaxed);
+		do
+		{
+			buffer->next = head;
+		} while (!bufferList.compare_exchange_weak(head, buffer, std::memory_order_release, std::memory_order_relaxed));
+		threadBuffer = buffer;
+		return buffer;
+	}
+
+	// Copies 'spec' to 'out' as a printf conversion, if it only holds flags, width, precision and one of 'conversions'
+	bool BuildConversion(std::string_view spec, const char *lengthModifier, const char *conversions, char defaultConversion, char (&out)[32])
+	{
+		char conversion = defaultConversion;
+		if (!spec.empty() && strchr(conversions, spec.back()))
+		{
+			conversion = spec.back();
+			spec.remove_suffix(1);
+		}
+		if (spec.size() > 16 || spec.find_first_not_of("0123456789.-+ #") != std::string_view::npos)
+			return false;
+		snprintf(out, sizeof(out), "%%%.*s%s%c", (int)(spec.size()), spec.data(), lengthModifier, conversion);
+		return true;
+	}
+
+	// Appends the argument at 'args' and moves past it
+	void FormatArg(const u8 *&args, std::string_view spec, std::string &out)
+	{
+		char conversion[32];
+		char text[256];
+		const LogArgType type = (LogArgType)(*args++);
+		if (type == LOG_ARG_STRING)
+		{
+			u16 length;
+			memcpy(&length, args, sizeof(length));
+			args += sizeof(length);
+			const std::string value((const char *)(args), length);
+			args += length;
+			if (spec.empty() || !BuildConversion(spec, "", "s", 's', conversion))
+				out += value;
+			else
+			{
+				snprintf(text, sizeof(text), conversion, value.c_str());
+				out += text;
+			}
+			return;
+		}
+
+		u64 bits;
+		memcpy(&bits, args, sizeof(bits));
+		args += sizeof(bits);
+		if (type == LOG_ARG_FLOAT)
+		{
+			f64 value;
+			memcpy(&value, &bits, sizeof(value));
+			if (!BuildConversion(spec, "", "fFeEgG", 'g', conversion))
+				BuildConversion("", "", "", 'g', conversion);
+			snprintf(text, sizeof(text), conversion, value);
+		}
+		else
+		{
+			const char defaultConversion = type == LOG_ARG_SIGNED ? 'd' : 'u';
+			if (!BuildConversion(spec, "ll", "diuxXoc", defaultConversion, conversion))
+				BuildConversion("", "ll", "", defaultConversion, conversion);
+			if (conversion[strlen(conversion) - 1] == 'c')
+				snprintf(text, sizeof(text), "%c", (char)(bits));
+			else
+				snprintf(text, sizeof(text), conversion, (unsigned long long)(bits));
+		}
+		out += text;
+	}
+
+	void FormatRecord(const LogRecord &record, const u8 *args, std::string &out)
+	{
+		char prefix[64];
+		snprintf(prefix, sizeof(prefix), "[%9.3f] %-7s ", record.time / 1000000000.0, LEVEL_NAMES[record.level < LOG_LEVEL_NONE ? record.level : LOG_LEVEL_NONE]);
+		out = prefix;
+		u32 remainingArgs = record.argCount;
+		for (const char *c = record.format; *c; c++)
+		{
+			const char *close = c[0] == '{' ? strchr(c, '}') : nullptr;
+			if (!close || (c[1] != '}' && c[1] != ':') || remainingArgs == 0)
+			{
+				out += *c;
+				continue;
+			}
+			const std::string_view spec = c[1] == ':' ? std::string_view(c + 2, close - c - 2) : std::string_view();
+			FormatArg(args, spec, out);
+			remainingArgs--;
+			c = close;
+		}
+		if (out.back() != '\n')
+			out += '\n';
+	}
+
+	void WriteLine(const std::string &line)
+	{
+		if (sinks.console)
+			fwrite(line.data(), 1, line.size(), stdout);
+#ifdef _WIN32
+		if (sinks.debugOutput)
+			OutputDebugStringA(line.c_str());
+#endif
+		if (file.is_open())
+			file << line;
+	}
+
+	u64 ElapsedNanos()
+	{
+		return (u64)(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count());
+	}
+
+	// Only called by the flush thread, or by Shutdown once it has joined
+	void FlushBuffers()
+	{
+		std::vector<PendingLine> lines;
+		for (LogThreadBuffer *buffer = bufferList.load(std::memory_order_acquire); buffer; buffer = buffer->next)
+		{
+			u64 tail = buffer->tail.load(std::memory_order_relaxed);
+			const u64 head = buffer->head.load(std::memory_order_acquire);
+			while (tail < head)
+			{
+				const u32 offset = (u32)(tail % LOG_BUFFER_SIZE);
+				if (LOG_BUFFER_SIZE - offset < sizeof(LogRecord))
+				{
+					tail += LOG_BUFFER_SIZE - offset;
+					continue;
+				}
+				LogRecord record;
+				memcpy(&record, buffer->data + offset, sizeof(record));
+				if (record.format)
+				{
+					lines.push_back(PendingLine{ record.time, std::string() });
+					FormatRecord(record, buffer->data + offset + sizeof(record), lines.back().text);
+				}
+				tail += record.size;
+			}
+			buffer->tail.store(tail, std::memory_order_release);
+
+			const u32 dropped = buffer->dropped.exchange(0, std::memory_order_relaxed);
+			if (dropped)
+			{
+				const LogRecord record = { 0, LOG_LEVEL_WARNING, 1, "{} messages dropped, the ring of their thread was full", ElapsedNanos() };
+				u8 args[1 + sizeof(u64)];
+				u8 *out = args;
+				LogArgEncode(out, dropped);
+				lines.push_back(PendingLine{ record.time, std::string() });
+				FormatRecord(record, args, lines.back().text);
+			}
+		}
+		if (lines.empty())
+			return;
+
+		// Each ring is in order, merge the threads by time
+		std::stable_sort(lines.begin(), lines.end(), [](const PendingLine &a, const PendingLine &b) { return a.time < b.time; });
+		for (const PendingLine &line : lines)
+			WriteLine(line.text);
+		if (sinks.console)
+			fflush(stdout);
+		if (file.is_open())
+			file.flush();
+	}
+}
+
+void Logger::Init(const LoggerSettings &settings)
+{
+	// The pending messages are kept for the new sinks
+	if (running.exchange(false, std::memory_order_acq_rel))
+		flushThread.join();
+	if (file.is_open())
+		file.close();
+	sinks = settings;
+	SetLevel(settings.level);
+	if (!settings.filePath.empty())
+	{
+		file.open(settings.filePath, std::ios_base::binary | std::ios_base::trunc);
+		if (!file.is_open())
+			LOG_ERROR("Could not open the log file {}", settings.filePath);
+	}
+	running.store(true, std::memory_order_release);
+	flushThread = std::thread(&Logger::FlushThreadFunc);
+}
+
+void Logger::Shutdown()
+{
+	if (running.exchange(false, std::memory_order_acq_rel))
+		flushThread.join();
+	FlushBuffers();
+	if (file.is_open())
+		file.close();
+}
+
+void Logger::SetLevel(LogLevel level)
+{
+	minLevel.store(level, std::memory_order_relaxed);
+}
+
+bool Logger::ParseLevel(const std::string &text, LogLevel &out)
+{
+	for (u32 i = 0; i <= LOG_LEVEL_NONE; i++)
+	{
+		if (text == LEVEL_NAMES[i])
+		{
+			out = (LogLevel)(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+u8 *Logger::BeginRecord(LogLevel level, const char *format, u8 argCount, u32 argSize)
+{
+	LogThreadBuffer *buffer = GetThreadBuffer();
+	const u32 size = (u32)((sizeof(LogRecord) + argSize + 7) & ~7ull);
+	u64 head = buffer->head.load(std::memory_order_relaxed);
+	const u64 tail = buffer->tail.load(std::memory_order_acquire);
+
+	// Records never wrap around the end of the ring, the space left there is skipped
+	const u32 offset = (u32)(head % LOG_BUFFER_SIZE);
+	const u32 skipped = LOG_BUFFER_SIZE - offset < size ? LOG_BUFFER_SIZE - offset : 0;
+	if (head + skipped + size - tail > LOG_BUFFER_SIZE)
+	{
+		buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+	if (skipped >= sizeof(LogRecord))
+	{
+		const LogRecord padding = { skipped, level, 0, nullptr, 0 };
+		memcpy(buffer->data + offset, &padding, sizeof(padding));
+	}
+	head += skipped;
+
+	const LogRecord record = { size, level, argCount, format, ElapsedNanos() };
+	u8 *out = buffer->data + head % LOG_BUFFER_SIZE;
+	memcpy(out, &record, sizeof(record));
+	pendingHead = head + size;
+	return out + sizeof(record);
+}
+
+void Logger::EndRecord()
+{
+	threadBuffer->head.store(pendingHead, std::memory_order_release);
+}
+
+void Logger::FlushThreadFunc()
+{
+#ifdef _WIN32
+	SetThreadDescription(GetCurrentThread(), L"Log Flush Thread");
+#endif
+	PROFILE_THREAD("Log Flush Thread");
+	while (running.load(std::memory_order_acquire))
+	{
+		FlushBuffers();
+		std::this_thread::sleep_for(std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS));
+	}
+}
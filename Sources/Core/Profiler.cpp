@@ -0,0 +1,130 @@
+#include "Core/Profiler.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+using namespace Core;
+
+namespace
+{
+	const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+	std::atomic<ProfileThreadBuffer *> bufferList = nullptr;
+	std::atomic_uint32_t nextThreadId = 1;
+
+	// Buffers outlive their thread so that the trace can be written after the workers have joined
+	struct BufferListOwner
+	{
+		~BufferListOwner()
+		{
+			ProfileThreadBuffer *buffer = bufferList.exchange(nullptr);
+			while (buffer)
+			{
+				ProfileThreadBuffer *next = buffer->next;
+				for (u32 i = 0; i < PROFILER_MAX_BLOCKS; i++)
+					delete[] buffer->blocks[i].load(std::memory_order_relaxed);
+				delete buffer;
+				buffer = next;
+			}
+		}
+	} bufferListOwner;
+
+	static thread_local ProfileThreadBuffer *threadBuffer = nullptr;
+
+	ProfileThreadBuffer *GetThreadBuffer()
+	{
+		if (threadBuffer)
+			return threadBuffer;
+
+		ProfileThreadBuffer *buffer = new ProfileThreadBuffer();
+		buffer->threadId = nextThreadId.fetch_add(1, std::memory_order_relaxed);
+		snprintf(buffer->name, sizeof(buffer->name), "Thread %u", buffer->threadId);
+		ProfileThreadBuffer *head = bufferList.load(std::memory_order_relaxed);
+		do
+		{
+			buffer->next = head;
+		} while (!bufferList.compare_exchange_weak(head, buffer, std::memory_order_release, std::memory_order_relaxed));
+		threadBuffer = buffer;
+		return buffer;
+	}
+
+	void WriteEscaped(std::ofstream &file, const char *text)
+	{
+		for (; *text; text++)
+		{
+			if (*text == '"' || *text == '\\')
+				file << '\\';
+			if ((u8)(*text) >= 0x20)
+				file << *text;
+		}
+	}
+}
+
+u64 Profiler::Now()
+{
+	return (u64)(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count());
+}
+
+void Profiler::Record(const char *name, u64 begin, u64 end)
+{
+	ProfileThreadBuffer *buffer = GetThreadBuffer();
+	const u32 index = buffer->count.load(std::memory_order_relaxed);
+	const u32 blockIndex = index / PROFILER_BLOCK_SIZE;
+	if (blockIndex >= PROFILER_MAX_BLOCKS)
+	{
+		buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	ProfileEvent *block = buffer->blocks[blockIndex].load(std::memory_order_relaxed);
+	if (!block)
+	{
+		block = new ProfileEvent[PROFILER_BLOCK_SIZE];
+		buffer->blocks[blockIndex].store(block, std::memory_order_release);
+	}
+	block[index % PROFILER_BLOCK_SIZE] = ProfileEvent{ name, begin, end };
+	buffer->count.store(index + 1, std::memory_order_release);
+}
+
+void Profiler::SetThreadName(const std::string &name)
+{
+	ProfileThreadBuffer *buffer = GetThreadBuffer();
+	snprintf(buffer->name, sizeof(buffer->name), "%s", name.c_str());
+}
+
+bool Profiler::WriteChromeTrace(const std::string &path)
+{
+	std::ofstream file = std::ofstream(path, std::ios_base::binary | std::ios_base::trunc);
+	if (!file.is_open())
+		return false;
+
+	char text[128];
+	bool first = true;
+	file << "{\"traceEvents\":[\n";
+	for (ProfileThreadBuffer *buffer = bufferList.load(std::memory_order_acquire); buffer; buffer = buffer->next)
+	{
+		file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId << ",\"args\":{\"name\":\"";
+		WriteEscaped(file, buffer->name);
+		file << "\"}}";
+		first = false;
+
+		const u32 count = buffer->count.load(std::memory_order_acquire);
+		for (u32 i = 0; i < count; i++)
+		{
+			const ProfileEvent &event = buffer->blocks[i / PROFILER_BLOCK_SIZE].load(std::memory_order_acquire)[i % PROFILER_BLOCK_SIZE];
+			file << ",\n{\"name\":\"";
+			WriteEscaped(file, event.name);
+			// Chrome traces are in microseconds
+			snprintf(text, sizeof(text), "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				buffer->threadId, event.begin / 1000.0, (event.end - event.begin) / 1000.0);
+			file << text;
+		}
+		const u32 dropped = buffer->dropped.load(std::memory_order_relaxed);
+		if (dropped)
+			printf("Profiler: %u events dropped on thread '%s'\n", dropped, buffer->name);
+	}
+	file << "\n]}\n";
+	file.close();
+	return !file.fail();
+}
@@ -0,0 +1,50 @@
+#include "Core/RollingStats.hpp"
+
+#include <algorithm>
+
+using namespace Core;
+
+void RollingStats::Init(u32 capacity)
+{
+	samples.assign(capacity, 0.0);
+	sorted.reserve(capacity);
+	next = 0;
+	count = 0;
+}
+
+void RollingStats::Add(f64 value)
+{
+	if (samples.empty())
+		return;
+	samples[next] = value;
+	next = (next + 1) % (u32)(samples.size());
+	if (count < samples.size())
+		count++;
+}
+
+u32 RollingStats::GetCount() const
+{
+	return count;
+}
+
+f64 RollingStats::GetAverage() const
+{
+	if (count == 0)
+		return 0;
+	// Summed again on every call, a running sum would drift as samples leave the window
+	f64 sum = 0;
+	for (u32 i = 0; i < count; i++)
+		sum += samples[i];
+	return sum / count;
+}
+
+f64 RollingStats::GetPercentile(f64 fraction) const
+{
+	if (count == 0)
+		return 0;
+	sorted.assign(samples.begin(), samples.begin() + count);
+	const f64 clamped = fraction < 0 ? 0 : (fraction > 1 ? 1 : fraction);
+	const u32 rank = (u32)(clamped * (count - 1) + 0.5);
+	std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+	return sorted[rank];
+}
@@ -0,0 +1,196 @@
+#include <cstdio>
+#include <string>
+
+#include "Simulation/Batch.hpp"
+#include "Benchmarks.hpp"
+#include "Core/Profiler.hpp"
+
+#ifdef HEADLESS_RENDERER
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "Core/Logger.hpp"
+#include "GameThread.hpp"
+#include "RenderThread.hpp"
+#endif
+
+namespace
+{
+	s32 WriteProfilerTrace(const std::string &path, s32 result)
+	{
+		if (path.empty())
+			return result;
+#ifdef PROFILER_ENABLED
+		if (!Core::Profiler::WriteChromeTrace(path))
+			fprintf(stderr, "Could not write the trace to %s\n", path.c_str());
+#else
+		fprintf(stderr, "--trace needs a build with PROFILER_ENABLED defined\n");
+#endif
+		return result;
+	}
+
+#ifdef HEADLESS_RENDERER
+	bool ParseValue(const std::string &arg, const char *prefix, u32 &out)
+	{
+		const size_t length = strlen(prefix);
+		if (arg.compare(0, length, prefix) != 0)
+			return false;
+		const char *text = arg.c_str() + length;
+		char *end = nullptr;
+		unsigned long long value = strtoull(text, &end, 0);
+		if (*text == '\0' || *end != '\0' || value > 0xFFFFFFFFull)
+			return false;
+		out = (u32)(value);
+		return true;
+	}
+
+	bool ParseText(const std::string &arg, const char *prefix, std::string &out)
+	{
+		const size_t length = strlen(prefix);
+		if (arg.compare(0, length, prefix) != 0 || arg.size() == length)
+			return false;
+		out = arg.substr(length);
+		return true;
+	}
+
+	bool ParseFlag(const std::string &arg, const char *name, bool &out)
+	{
+		if (arg != name)
+			return false;
+		out = true;
+		return true;
+	}
+
+	// Same threads as the windowed build, without a window: the main thread only waits for the render thread
+	// to save its last frame. The arguments are those of the windowed --offscreen mode.
+	s32 RunOffscreen(const std::vector<std::string> &args)
+	{
+		u32 frameCount = 0;
+		u32 width = 800;
+		u32 height = 600;
+		u32 targetDevice = 0;
+		bool gpuProfile = false;
+		bool validateCulling = false;
+		OffscreenSettings offscreen;
+		std::string pipelineCachePath = "PipelineCache.bin";
+		std::string logLevel;
+		Core::LoggerSettings log;
+		log.console = true;
+		Simulation::SimulationSizes simSizes;
+		simSizes.objectCount = OBJECT_COUNT;
+		simSizes.worldSize = WORLD_SIZE;
+		for (const std::string &arg : args)
+		{
+			if (ParseValue(arg, "--offscreen=", frameCount) || ParseValue(arg, "--save-every=", offscreen.saveInterval) ||
+				ParseText(arg, "--frames-dir=", offscreen.directory) || ParseValue(arg, "--width=", width) ||
+				ParseValue(arg, "--height=", height) || ParseValue(arg, "--device=", targetDevice) ||
+				ParseFlag(arg, "--gpu-profile", gpuProfile) || ParseFlag(arg, "--validate-culling", validateCulling) ||
+				ParseText(arg, "--pipeline-cache=", pipelineCachePath) || ParseText(arg, "--log-level=", logLevel) ||
+				ParseText(arg, "--log-file=", log.filePath) || Simulation::ParseSimulationArgument(arg, simSizes))
+				continue;
+			fprintf(stderr, "Invalid argument: %s\n", arg.c_str());
+			return 1;
+		}
+		// Same bounds as the windowed build
+		offscreen.frameCount = Maths::Util::MaxI(1, (s32)(frameCount));
+		const Maths::IVec2 res = Maths::IVec2(Maths::Util::MaxI(64, (s32)(width)), Maths::Util::MaxI(64, (s32)(height)));
+
+		const bool validLogLevel = logLevel.empty() || Core::Logger::ParseLevel(logLevel, log.level);
+		Core::Logger::Init(log);
+		if (!validLogLevel)
+			LOG_WARNING("Unknown log level: {}", logLevel);
+		std::string sizeError;
+		if (!simSizes.Init(simSizes.objectCount, simSizes.worldSize, sizeError))
+		{
+			LOG_ERROR("Invalid simulation size: {}", sizeError);
+			Core::Logger::Shutdown();
+			return 1;
+		}
+
+		GameThread gh;
+		RenderThread rh;
+		gh.Init(res, simSizes, false);
+		// Without a window there are no size messages, the camera uses the offscreen resolution
+		gh.Resize(res.x, res.y);
+		rh.Init(&gh, res, targetDevice, offscreen, gpuProfile, pipelineCachePath, validateCulling);
+		while (!gh.HasRequestedExit() && !rh.HasCrashed() && !GameThread::HasCrashed())
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		rh.Quit();
+		gh.Quit();
+		const bool crashed = rh.HasCrashed() || GameThread::HasCrashed();
+		Core::Logger::Shutdown();
+		return crashed ? 1 : 0;
+	}
+#endif
+}
+
+// Entry point of the headless build: no window, only the CPU simulation, or the offscreen renderer when built with
+// HEADLESS_RENDERER. See the README for the command line.
+int main(int argc, char *argv[])
+{
+	const std::string batchText = "--batch";
+	const std::string benchText = "--bench=";
+	const std::string traceText = "--trace=";
+	const std::string offscreenText = "--offscreen=";
+	Simulation::BatchArgs batchArgs;
+	std::string benchmark;
+	std::string tracePath;
+	PROFILE_THREAD("Main Thread");
+	for (s32 i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]).compare(0, offscreenText.size(), offscreenText) != 0)
+			continue;
+#ifdef HEADLESS_RENDERER
+		// The other arguments are the renderer ones, not the batch ones
+		std::vector<std::string> args;
+		for (s32 j = 1; j < argc; j++)
+		{
+			std::string arg = argv[j];
+			if (arg.compare(0, traceText.size(), traceText) == 0)
+				tracePath = arg.substr(traceText.size());
+			else
+				args.push_back(arg);
+		}
+		return WriteProfilerTrace(tracePath, RunOffscreen(args));
+#else
+		fprintf(stderr, "--offscreen needs a build with HEADLESS_RENDERER defined\n");
+		return 1;
+#endif
+	}
+	for (s32 i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == batchText)
+			continue;
+		if (arg.compare(0, benchText.size(), benchText) == 0)
+		{
+			benchmark = arg.substr(benchText.size());
+			continue;
+		}
+		if (arg.compare(0, traceText.size(), traceText) == 0)
+		{
+			tracePath = arg.substr(traceText.size());
+			continue;
+		}
+		if (!Simulation::ParseBatchArgument(arg, batchArgs))
+		{
+			fprintf(stderr, "Invalid argument: %s\n", arg.c_str());
+			fprintf(stderr, "Usage: %s [--batch] [--seed=N] [--ticks=N] [--threads=N] [--boids=N] [--world=WxH] [--step=S] [--kernel=scalar|sse4.2|avx2|avx512|auto] [--reorder-every=N] [--checksum-every=N] [--trace=file.json]\n", argv[0]);
+			fprintf(stderr, "       %s --bench=(name) [--trace=file.json]\n", argv[0]);
+			fprintf(stderr, "       %s --offscreen=N [--save-every=N] [--frames-dir=dir] [--width=N] [--height=N] [--device=N] [--boids=N] [--world-size=N] [...]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (!benchmark.empty())
+	{
+		if (Benchmarks::Run(benchmark))
+			return WriteProfilerTrace(tracePath, 0);
+		fprintf(stderr, "Unknown benchmark: %s\n", benchmark.c_str());
+		return 1;
+	}
+	return WriteProfilerTrace(tracePath, Simulation::RunBatch(batchArgs));
+}
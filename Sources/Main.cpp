@@ -6,6 +6,11 @@
 #include "Maths/Maths.hpp"
 #include "RenderThread.hpp"
 #include "GameThread.hpp"
+#include "Benchmarks.hpp"
+#include "Core/Logger.hpp"
+#include "Core/Profiler.hpp"
+#include "Simulation/Batch.hpp"
+#include "Simulation/SimulationSizes.hpp"
 
 #ifdef _DEBUG
 #include <crtdbg.h>
@@ -26,6 +31,15 @@ struct LaunchArgs
 	Maths::IVec2 defaultRes = Maths::IVec2(800, 600);
 	u32 targetDevice = 0;
 	bool isUnitTest = false;
+	bool batch = false;
+	bool gpuProfile = false;
+	bool validateCulling = false;
+	OffscreenSettings offscreen;
+	std::string benchmark;
+	std::string tracePath;
+	std::string pipelineCachePath = "PipelineCache.bin";
+	Core::LoggerSettings log;
+	std::vector<std::string> otherArgs;
 } launchArgs;
 
 struct SavedInfos
@@ -40,8 +54,20 @@ struct SavedInfos
 LRESULT CALLBACK WndProc(_In_ HWND hWnd, _In_ UINT message, _In_ WPARAM wParam, _In_ LPARAM lParam);
 void OnMoveMouse(HWND hwnd, bool reset = false);
 void ToggleFullscreen(HWND hwnd, bool full);
+void WriteProfilerTrace();
 void HandleCustomMessage(HWND hWnd, WindowMessage msg, u64 payload);
 
+// The paths are kept in UTF-8 for the narrow file functions, VulkanWin32.manifest makes it the process code page
+std::string ToUtf8(const wchar_t *text)
+{
+	std::string result(WideCharToMultiByte(CP_UTF8, 0, text, -1, nullptr, 0, nullptr, nullptr), '\0');
+	WideCharToMultiByte(CP_UTF8, 0, text, -1, result.data(), (s32)(result.size()), nullptr, nullptr);
+	// The size counted the terminating null
+	if (!result.empty())
+		result.pop_back();
+	return result;
+}
+
 std::wstring GetLastErrorAsString()
 {
     DWORD errorMessageID = GetLastError();
@@ -84,6 +110,18 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 		const std::wstring deviceText = L"--device=";
 		const std::wstring widthText = L"--width=";
 		const std::wstring heightText = L"--height=";
+		const std::wstring benchText = L"--bench=";
+		const std::wstring batchText = L"--batch";
+		const std::wstring gpuProfileText = L"--gpu-profile";
+		const std::wstring validateCullingText = L"--validate-culling";
+		const std::wstring offscreenText = L"--offscreen=";
+		const std::wstring saveEveryText = L"--save-every=";
+		const std::wstring framesDirText = L"--frames-dir=";
+		const std::wstring traceText = L"--trace=";
+		const std::wstring logLevelText = L"--log-level=";
+		const std::wstring logFileText = L"--log-file=";
+		const std::wstring pipelineCacheText = L"--pipeline-cache=";
+		std::string logLevel;
 		for (s32 i = 0; i < argCount; i++)
 		{
 			if (testText.compare(arglist[i]) == 0)
@@ -102,8 +140,142 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 			{
 				launchArgs.defaultRes.y = Maths::Util::MaxI(64, std::stoi(arglist[i] + heightText.size()));
 			}
+			else if (benchText.compare(0, benchText.size(), arglist[i], benchText.size()) == 0)
+			{
+				for (const wchar_t *c = arglist[i] + benchText.size(); *c; c++)
+					launchArgs.benchmark.push_back((char)(*c));
+			}
+			else if (batchText.compare(arglist[i]) == 0)
+			{
+				launchArgs.batch = true;
+			}
+			else if (gpuProfileText.compare(arglist[i]) == 0)
+			{
+				launchArgs.gpuProfile = true;
+			}
+			else if (validateCullingText.compare(arglist[i]) == 0)
+			{
+				launchArgs.validateCulling = true;
+			}
+			else if (offscreenText.compare(0, offscreenText.size(), arglist[i], offscreenText.size()) == 0)
+			{
+				launchArgs.offscreen.frameCount = Maths::Util::MaxI(1, std::stoi(arglist[i] + offscreenText.size()));
+			}
+			else if (saveEveryText.compare(0, saveEveryText.size(), arglist[i], saveEveryText.size()) == 0)
+			{
+				launchArgs.offscreen.saveInterval = Maths::Util::MaxI(0, std::stoi(arglist[i] + saveEveryText.size()));
+			}
+			else if (framesDirText.compare(0, framesDirText.size(), arglist[i], framesDirText.size()) == 0)
+			{
+				launchArgs.offscreen.directory = ToUtf8(arglist[i] + framesDirText.size());
+			}
+			else if (traceText.compare(0, traceText.size(), arglist[i], traceText.size()) == 0)
+			{
+				launchArgs.tracePath = ToUtf8(arglist[i] + traceText.size());
+			}
+			else if (logLevelText.compare(0, logLevelText.size(), arglist[i], logLevelText.size()) == 0)
+			{
+				for (const wchar_t *c = arglist[i] + logLevelText.size(); *c; c++)
+					logLevel.push_back((char)(*c));
+			}
+			else if (logFileText.compare(0, logFileText.size(), arglist[i], logFileText.size()) == 0)
+			{
+				launchArgs.log.filePath = ToUtf8(arglist[i] + logFileText.size());
+			}
+			else if (pipelineCacheText.compare(0, pipelineCacheText.size(), arglist[i], pipelineCacheText.size()) == 0)
+			{
+				launchArgs.pipelineCachePath = ToUtf8(arglist[i] + pipelineCacheText.size());
+			}
+			else if (arglist[i][0] == L'-' && arglist[i][1] == L'-')
+			{
+				// The first argument may be the executable path, only options are forwarded
+				std::string arg;
+				for (const wchar_t *c = arglist[i]; *c; c++)
+					arg.push_back((char)(*c));
+				launchArgs.otherArgs.push_back(arg);
+			}
 		}
 		LocalFree(arglist);
+		PROFILE_THREAD("Main Thread");
+
+#ifdef UNIT_TEST
+		launchArgs.log.console = true;
+#endif
+#ifndef NDEBUG
+		launchArgs.log.level = Core::LOG_LEVEL_DEBUG;
+#endif
+		const bool validLogLevel = logLevel.empty() || Core::Logger::ParseLevel(logLevel, launchArgs.log.level);
+		Core::Logger::Init(launchArgs.log);
+		if (!validLogLevel)
+			LOG_WARNING("Unknown log level: {}", logLevel);
+
+		if (!launchArgs.benchmark.empty())
+		{
+			if (Benchmarks::Run(launchArgs.benchmark))
+			{
+				WriteProfilerTrace();
+				Core::Logger::Shutdown();
+				return 0;
+			}
+			LOG_ERROR("Unknown benchmark: {}", launchArgs.benchmark);
+			Core::Logger::Shutdown();
+			return 1;
+		}
+
+		if (launchArgs.batch)
+		{
+			Simulation::BatchArgs batchArgs;
+			for (const std::string &arg : launchArgs.otherArgs)
+			{
+				if (!Simulation::ParseBatchArgument(arg, batchArgs))
+				{
+					LOG_ERROR("Invalid batch argument: {}", arg);
+					Core::Logger::Shutdown();
+					return 1;
+				}
+			}
+			s32 result = Simulation::RunBatch(batchArgs);
+			WriteProfilerTrace();
+			Core::Logger::Shutdown();
+			return result;
+		}
+
+		Simulation::SimulationSizes simSizes;
+		simSizes.objectCount = OBJECT_COUNT;
+		simSizes.worldSize = WORLD_SIZE;
+		for (const std::string &arg : launchArgs.otherArgs)
+		{
+			if (!Simulation::ParseSimulationArgument(arg, simSizes))
+			{
+				LOG_ERROR("Invalid argument: {}", arg);
+				Core::Logger::Shutdown();
+				return 1;
+			}
+		}
+		std::string sizeError;
+		if (!simSizes.Init(simSizes.objectCount, simSizes.worldSize, sizeError))
+		{
+			LOG_ERROR("Invalid simulation size: {}", sizeError);
+			MessageBoxA(NULL, ("Invalid simulation size: " + sizeError).c_str(), "Error!", MB_OK);
+			Core::Logger::Shutdown();
+			return 1;
+		}
+
+		// Offscreen runs need no window, the main thread only waits for the render thread to save its last frame
+		if (launchArgs.offscreen.frameCount != 0)
+		{
+			gh.Init(launchArgs.defaultRes, simSizes, launchArgs.isUnitTest);
+			// Without a window there are no size messages, the camera uses the offscreen resolution
+			gh.Resize(launchArgs.defaultRes.x, launchArgs.defaultRes.y);
+			rh.Init(&gh, launchArgs.defaultRes, launchArgs.targetDevice, launchArgs.offscreen, launchArgs.gpuProfile, launchArgs.pipelineCachePath, launchArgs.validateCulling);
+			while (!gh.HasRequestedExit() && !rh.HasCrashed() && !gh.HasCrashed())
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			rh.Quit();
+			gh.Quit();
+			WriteProfilerTrace();
+			Core::Logger::Shutdown();
+			return (gh.HasCrashed() || rh.HasCrashed()) ? 1 : 0;
+		}
 
 		cursorHide = nullptr;
 
@@ -124,6 +296,7 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 		if (!RegisterClassExW(&wcex))
 		{
 			MessageBoxW(NULL, L"Call to RegisterClassExW failed!", szTitle, NULL);
+			Core::Logger::Shutdown();
 			return 1;
 		}
 
@@ -163,13 +336,16 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 		if (!hWnd)
 		{
 			MessageBoxW(hWnd, L"Call to CreateWindow failed!", szTitle, NULL);
+			Core::Logger::Shutdown();
 			return 1;
 		}
 
 		customMessage = RegisterWindowMessageA("VulkanWin32 Custom Message");
 
-		gh.Init(hWnd, customMessage, launchArgs.defaultRes,  launchArgs.isUnitTest);
-		rh.Init(hWnd, hInstance, &gh, launchArgs.defaultRes, launchArgs.targetDevice);
+		gh.SetWindow(hWnd, customMessage);
+		gh.Init(launchArgs.defaultRes, simSizes, launchArgs.isUnitTest);
+		rh.SetWindow(hWnd, hInstance);
+		rh.Init(&gh, launchArgs.defaultRes, launchArgs.targetDevice, launchArgs.offscreen, launchArgs.gpuProfile, launchArgs.pipelineCachePath, launchArgs.validateCulling);
 
 		// Main message loop:
 		MSG msg;
@@ -180,6 +356,8 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 		}
 		rh.Quit();
 		gh.Quit();
+		WriteProfilerTrace();
+		Core::Logger::Shutdown();
 		if (gh.HasCrashed() || rh.HasCrashed())
 			return 1;
 		return (int)msg.wParam;
@@ -247,12 +425,7 @@ LRESULT CALLBACK WndProc(_In_ HWND hWnd, _In_ UINT message, _In_ WPARAM wParam,
 		/*
 		if (isKeyDown)
 		{
-			std::stringstream stream;
-			stream << "0x"  << std::setfill('0') << std::setw(sizeof(u16)*2)  << std::hex << virtualCode;
-			GameThread::LogMessage("Key pressed: " + std::to_string(virtualCode) + " (" + stream.str() + ") scancode: ");
-			std::stringstream stream1;
-			stream1 << "0x"  << std::setfill('0') << std::setw(sizeof(u16)*2)  << std::hex << scanCode;
-			GameThread::LogMessage(std::to_string(scanCode) + " (" + stream1.str() + ")\n");
+			LOG_DEBUG("Key pressed: {} ({:#06x}) scancode: {} ({:#06x})", virtualCode, virtualCode, scanCode, scanCode);
 		}
 		*/
 		gh.SetKeyState((u8)(wParam), (u8)(scanCode), isKeyDown);
@@ -389,3 +562,15 @@ void ToggleFullscreen(HWND hwnd, bool full)
 			SendMessageA(hwnd, WM_SYSCOMMAND, SC_MAXIMIZE, 0);
 	}
 }
+
+void WriteProfilerTrace()
+{
+	if (launchArgs.tracePath.empty())
+		return;
+#ifdef PROFILER_ENABLED
+	if (!Core::Profiler::WriteChromeTrace(launchArgs.tracePath))
+		LOG_ERROR("Could not write the trace to {}", launchArgs.tracePath);
+#else
+	LOG_WARNING("--trace needs a build with PROFILER_ENABLED defined");
+#endif
+}
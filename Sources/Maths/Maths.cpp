@@ -1,6 +1,7 @@
 #include "Maths/Maths.hpp"
 
 #include <cstdio>
+#include <cstring>
 
 // TODO enable this if using Vulkan, or any other API that invert some axis
 #define INVERTED_PROJECTION
@@ -99,35 +100,6 @@ namespace Maths
 		}
 	}
 
-	Mat4 Mat4::operator*(const Mat4& in) const
-	{
-		Mat4 out;
-		for (size_t j = 0; j < 4; j++)
-		{
-			for (size_t i = 0; i < 4; i++)
-			{
-				f32 res = 0;
-				for (size_t k = 0; k < 4; k++)
-					res += content[j + k * 4] * in.content[k + i * 4];
-
-				out.content[j + i * 4] = res;
-			}
-		}
-		return out;
-	}
-
-	Vec4 Mat4::operator*(const Vec4& in) const
-	{
-		Vec4 out;
-		for (size_t i = 0; i < 4; i++)
-		{
-			f32 res = 0;
-			for (size_t k = 0; k < 4; k++) res += content[i + k * 4] * in[k];
-			out[i] = res;
-		}
-		return out;
-	}
-
 	Mat4 Mat4::CreateXRotationMatrix(f32 angle)
 	{
 		Mat4 out = Mat4(1);
@@ -1065,6 +1037,24 @@ namespace Maths
 		UVOut->push_back(Vec2(1, 1));
 	}
 
+	u16 Util::FloatToHalf(f32 value)
+	{
+		u32 bits;
+		memcpy(&bits, &value, sizeof(bits));
+		const u16 sign = (u16)((bits >> 16) & 0x8000);
+		const s32 exponent = (s32)((bits >> 23) & 0xff) - 127 + 15;
+		u32 mantissa = bits & 0x7fffff;
+		if (exponent <= 0)
+			return sign;
+		if (exponent >= 31)
+			return (u16)(sign | 0x7c00);
+		u32 half = ((u32)(exponent) << 10) | (mantissa >> 13);
+		mantissa &= 0x1fff;
+		if (mantissa > 0x1000 || (mantissa == 0x1000 && (half & 1)))
+			half++;
+		return (u16)(sign | half);
+	}
+
 	Vec3 Maths::Util::GetSphericalCoord(f32 longitude, f32 latitude)
 	{
 		longitude = ToRadians(longitude);
@@ -1072,13 +1062,35 @@ namespace Maths
 		return Vec3(cosf(longitude) * cosf(latitude), sinf(latitude), sinf(longitude) * cosf(latitude));
 	}
 
+	Frustum Frustum::FromViewProjection(const Mat4& viewProjection)
+	{
+		// Each clip coordinate is the dot product of a row of the matrix with the point
+		Vec4 rows[4];
+		for (u8 i = 0; i < 4; i++)
+			rows[i] = Vec4(viewProjection.at(0, i), viewProjection.at(1, i), viewProjection.at(2, i), viewProjection.at(3, i));
+		const auto toPlane = [](const Vec4& row)
+		{
+			const f32 length = row.GetVector().Length();
+			return Vec4(row.x / length, row.y / length, row.z / length, -row.w / length);
+		};
+		Frustum result;
+		result.left = toPlane(rows[3] + rows[0]);
+		result.right = toPlane(rows[3] - rows[0]);
+		result.bottom = toPlane(rows[3] + rows[1]);
+		result.top = toPlane(rows[3] - rows[1]);
+		result.front = toPlane(rows[2]);
+		result.back = toPlane(rows[3] - rows[2]);
+		return result;
+	}
+
 	bool AABB::IsOnFrustum(const Frustum& camFrustum, const Maths::Mat4& transform) const
 	{
 		Vec3 globalCenter = (transform * Vec4(center)).GetVector();
 		Maths::Mat3 rot = transform;
-		Vec3 right = (rot * Vec3(1, 0, 0)) * size.x * 2.0f;
-		Vec3 up = (rot * Vec3(0, 1, 0)) * size.y * 2.0f;
-		Vec3 forward = (rot * Vec3(0, 0, 1)) * size.z * 2.0f;
+		// 'size' is the half extent, as in IsOnOrForwardPlane
+		Vec3 right = (rot * Vec3(1, 0, 0)) * size.x;
+		Vec3 up = (rot * Vec3(0, 1, 0)) * size.y;
+		Vec3 forward = (rot * Vec3(0, 0, 1)) * size.z;
 		Vec3 newExtent;
 		for (u8 i = 0; i < 3; ++i)
 		{
@@ -0,0 +1,282 @@
+#include "Render/GpuAllocator.hpp"
+
+using namespace Render;
+
+namespace
+{
+	VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+void GpuAllocator::Init(VkPhysicalDevice physicalDevice, VkDevice deviceIn)
+{
+	device = deviceIn;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+	VkPhysicalDeviceProperties properties = {};
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	nonCoherentAtomSize = properties.limits.nonCoherentAtomSize ? properties.limits.nonCoherentAtomSize : 1;
+}
+
+void GpuAllocator::Shutdown()
+{
+	for (Block &block : blocks)
+	{
+		if (block.memory != VK_NULL_HANDLE)
+			vkFreeMemory(device, block.memory, nullptr);
+	}
+	blocks.clear();
+}
+
+u32 GpuAllocator::FindMemoryType(u32 typeFilter, VkMemoryPropertyFlags properties) const
+{
+	for (u32 i = 0; i < memoryProperties.memoryTypeCount; i++)
+	{
+		if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+			return i;
+	}
+	return UINT32_MAX;
+}
+
+bool GpuAllocator::AllocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties, AllocationStrategy strategy, GpuAllocation &out)
+{
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(device, buffer, &requirements);
+	if (!Allocate(requirements, properties, strategy, false, out))
+		return false;
+	if (vkBindBufferMemory(device, buffer, out.memory, out.offset) != VK_SUCCESS)
+	{
+		Free(out);
+		return false;
+	}
+	return true;
+}
+
+bool GpuAllocator::AllocateImage(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags properties, AllocationStrategy strategy, GpuAllocation &out)
+{
+	VkMemoryRequirements requirements;
+	vkGetImageMemoryRequirements(device, image, &requirements);
+	if (!Allocate(requirements, properties, strategy, tiling == VK_IMAGE_TILING_OPTIMAL, out))
+		return false;
+	if (vkBindImageMemory(device, image, out.memory, out.offset) != VK_SUCCESS)
+	{
+		Free(out);
+		return false;
+	}
+	return true;
+}
+
+void GpuAllocator::Free(GpuAllocation &allocation)
+{
+	if (allocation.block >= blocks.size())
+	{
+		allocation = GpuAllocation();
+		return;
+	}
+
+	Block &block = blocks[allocation.block];
+	block.allocationCount--;
+	block.usedBytes -= allocation.size;
+	if (block.dedicated)
+	{
+		vkFreeMemory(device, block.memory, nullptr);
+		block = Block();
+	}
+	else if (block.strategy == ALLOCATION_LINEAR)
+	{
+		if (block.allocationCount == 0)
+			block.linearOffset = 0;
+	}
+	else
+	{
+		// Insert the range back in offset order, merged with the free neighbours
+		std::vector<FreeRange> &ranges = block.freeRanges;
+		u32 next = 0;
+		while (next < ranges.size() && ranges[next].offset < allocation.offset)
+			next++;
+		FreeRange range = { allocation.offset, allocation.size };
+		if (next > 0 && ranges[next - 1].offset + ranges[next - 1].size == range.offset)
+		{
+			next--;
+			range.offset = ranges[next].offset;
+			range.size += ranges[next].size;
+			ranges.erase(ranges.begin() + next);
+		}
+		if (next < ranges.size() && range.offset + range.size == ranges[next].offset)
+		{
+			range.size += ranges[next].size;
+			ranges.erase(ranges.begin() + next);
+		}
+		ranges.insert(ranges.begin() + next, range);
+	}
+	allocation = GpuAllocation();
+}
+
+GpuMemoryStats GpuAllocator::GetStats() const
+{
+	GpuMemoryStats stats;
+	VkDeviceSize largestRanges = 0;
+	for (const Block &block : blocks)
+	{
+		if (block.memory == VK_NULL_HANDLE)
+			continue;
+		if (block.dedicated)
+			stats.dedicatedCount++;
+		else
+			stats.blockCount++;
+		stats.allocationCount += block.allocationCount;
+		stats.reservedBytes += block.size;
+		stats.usedBytes += block.usedBytes;
+		VkDeviceSize blockLargestRange = 0;
+		for (const FreeRange &range : block.freeRanges)
+		{
+			stats.freeRangeCount++;
+			stats.freeBytes += range.size;
+			if (range.size > blockLargestRange)
+				blockLargestRange = range.size;
+		}
+		largestRanges += blockLargestRange;
+		if (blockLargestRange > stats.largestFreeRange)
+			stats.largestFreeRange = blockLargestRange;
+	}
+	if (stats.freeBytes != 0)
+		stats.fragmentation = 1.0 - (f64)(largestRanges) / stats.freeBytes;
+	return stats;
+}
+
+bool GpuAllocator::Allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties, AllocationStrategy strategy, bool optimalImage, GpuAllocation &out)
+{
+	const u32 memoryType = FindMemoryType(requirements.memoryTypeBits, properties);
+	if (memoryType == UINT32_MAX)
+		return false;
+
+	// Flushes and invalidations of non coherent memory work on whole atoms, they must not spill onto a neighbour
+	VkDeviceSize alignment = requirements.alignment ? requirements.alignment : 1;
+	VkDeviceSize size = requirements.size;
+	const VkMemoryPropertyFlags typeFlags = memoryProperties.memoryTypes[memoryType].propertyFlags;
+	if ((typeFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(typeFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+	{
+		alignment = AlignUp(alignment, nonCoherentAtomSize);
+		size = AlignUp(size, nonCoherentAtomSize);
+	}
+
+	const VkDeviceSize blockSize = GetBlockSize(memoryType);
+	u32 blockIndex = UINT32_MAX;
+	VkDeviceSize offset = 0;
+	if (size > blockSize / 2)
+	{
+		if (!CreateBlock(memoryType, size, blockIndex))
+			return false;
+		blocks[blockIndex].dedicated = true;
+	}
+	else
+	{
+		for (u32 i = 0; i < blocks.size() && blockIndex == UINT32_MAX; i++)
+		{
+			Block &block = blocks[i];
+			if (block.memory != VK_NULL_HANDLE && !block.dedicated && block.memoryType == memoryType &&
+				block.strategy == strategy && block.optimalImages == optimalImage && PlaceInBlock(block, size, alignment, offset))
+				blockIndex = i;
+		}
+		if (blockIndex == UINT32_MAX)
+		{
+			if (!CreateBlock(memoryType, blockSize, blockIndex))
+				return false;
+			blocks[blockIndex].strategy = strategy;
+			blocks[blockIndex].optimalImages = optimalImage;
+			if (strategy == ALLOCATION_FREE_LIST)
+				blocks[blockIndex].freeRanges.push_back(FreeRange{ 0, blockSize });
+			PlaceInBlock(blocks[blockIndex], size, alignment, offset);
+		}
+	}
+
+	Block &block = blocks[blockIndex];
+	block.allocationCount++;
+	block.usedBytes += size;
+	out.memory = block.memory;
+	out.offset = offset;
+	out.size = size;
+	out.mapped = block.mapped ? block.mapped + offset : nullptr;
+	out.block = blockIndex;
+	return true;
+}
+
+bool GpuAllocator::PlaceInBlock(Block &block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset)
+{
+	if (block.strategy == ALLOCATION_LINEAR)
+	{
+		offset = AlignUp(block.linearOffset, alignment);
+		if (offset + size > block.size)
+			return false;
+		block.linearOffset = offset + size;
+		return true;
+	}
+
+	// Best fit, the smallest range keeps the large ones for the large resources
+	std::vector<FreeRange> &ranges = block.freeRanges;
+	u32 best = UINT32_MAX;
+	for (u32 i = 0; i < ranges.size(); i++)
+	{
+		const VkDeviceSize start = AlignUp(ranges[i].offset, alignment);
+		if (start + size <= ranges[i].offset + ranges[i].size && (best == UINT32_MAX || ranges[i].size < ranges[best].size))
+			best = i;
+	}
+	if (best == UINT32_MAX)
+		return false;
+
+	const FreeRange range = ranges[best];
+	offset = AlignUp(range.offset, alignment);
+	ranges.erase(ranges.begin() + best);
+	// The alignment padding before the allocation and the space after it stay free
+	const VkDeviceSize end = offset + size;
+	if (end < range.offset + range.size)
+		ranges.insert(ranges.begin() + best, FreeRange{ end, range.offset + range.size - end });
+	if (offset > range.offset)
+		ranges.insert(ranges.begin() + best, FreeRange{ range.offset, offset - range.offset });
+	return true;
+}
+
+bool GpuAllocator::CreateBlock(u32 memoryType, VkDeviceSize size, u32 &index)
+{
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryType;
+	VkDeviceMemory memory;
+	if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+		return false;
+
+	u8 *mapped = nullptr;
+	if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void **>(&mapped)) != VK_SUCCESS)
+		{
+			vkFreeMemory(device, memory, nullptr);
+			return false;
+		}
+	}
+
+	index = 0;
+	while (index < blocks.size() && blocks[index].memory != VK_NULL_HANDLE)
+		index++;
+	if (index == blocks.size())
+		blocks.emplace_back();
+	Block &block = blocks[index];
+	block = Block();
+	block.memory = memory;
+	block.size = size;
+	block.mapped = mapped;
+	block.memoryType = memoryType;
+	return true;
+}
+
+VkDeviceSize GpuAllocator::GetBlockSize(u32 memoryType) const
+{
+	// Small heaps, like the host visible part of the VRAM, are not filled by a couple of blocks
+	const VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size;
+	VkDeviceSize size = GPU_BLOCK_SIZE;
+	while (size > (1ull << 20) && size > heapSize / 8)
+		size /= 2;
+	return size;
+}
@@ -0,0 +1,164 @@
+#include "Render/PipelineCache.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "Core/Logger.hpp"
+
+using namespace Render;
+
+namespace
+{
+	const u32 PIPELINE_CACHE_MAGIC = 0x43505356; // "VSPC"
+	const u32 PIPELINE_CACHE_VERSION = 1;
+
+	u64 HashData(const u8 *data, u64 size)
+	{
+		u64 hash = 0xcbf29ce484222325ull;
+		for (u64 i = 0; i < size; i++)
+		{
+			hash ^= data[i];
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	// Reads the driver data of 'path', empty if the file is missing, truncated or written for another device or driver
+	std::vector<u8> ReadCacheFile(const std::string &path, const VkPhysicalDeviceProperties &properties, u64 &coldCreationMicros)
+	{
+		std::ifstream file = std::ifstream(path, std::ios_base::binary | std::ios_base::ate);
+		if (!file.is_open())
+			return std::vector<u8>();
+		const u64 fileSize = (u64)(file.tellg());
+		file.seekg(0);
+
+		PipelineCacheHeader header = {};
+		if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)))
+		{
+			LOG_WARNING("Pipeline cache {} is truncated, it is rebuilt", path);
+			return std::vector<u8>();
+		}
+		if (header.magic != PIPELINE_CACHE_MAGIC || header.version != PIPELINE_CACHE_VERSION ||
+			header.vendorID != properties.vendorID || header.deviceID != properties.deviceID ||
+			header.driverVersion != properties.driverVersion ||
+			memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+		{
+			LOG_INFO("Pipeline cache {} was written for another device or driver, it is rebuilt", path);
+			return std::vector<u8>();
+		}
+
+		// Checked before allocating, a damaged header could ask for any size
+		if (header.dataSize != fileSize - sizeof(header))
+		{
+			LOG_WARNING("Pipeline cache {} is corrupted, it is rebuilt", path);
+			return std::vector<u8>();
+		}
+		std::vector<u8> data(header.dataSize);
+		if (!file.read(reinterpret_cast<char *>(data.data()), data.size()) || HashData(data.data(), data.size()) != header.dataHash)
+		{
+			LOG_WARNING("Pipeline cache {} is corrupted, it is rebuilt", path);
+			return std::vector<u8>();
+		}
+		coldCreationMicros = header.coldCreationMicros;
+		return data;
+	}
+}
+
+bool PipelineCache::Init(VkPhysicalDevice physicalDevice, VkDevice deviceIn, const std::string &pathIn)
+{
+	device = deviceIn;
+	path = pathIn;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	std::vector<u8> data;
+	if (!path.empty())
+		data = ReadCacheFile(path, properties, coldCreationMicros);
+
+	VkPipelineCacheCreateInfo cacheInfo = {};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = data.size();
+	cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+	VkResult result = vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache);
+	if (result != VK_SUCCESS && !data.empty())
+	{
+		// Some drivers refuse data they do not like instead of ignoring it
+		LOG_WARNING("Pipeline cache {} was rejected by the driver, it is rebuilt", path);
+		data.clear();
+		cacheInfo.initialDataSize = 0;
+		cacheInfo.pInitialData = nullptr;
+		result = vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache);
+	}
+	if (result != VK_SUCCESS)
+	{
+		cache = VK_NULL_HANDLE;
+		return false;
+	}
+	warm = !data.empty();
+	loadedSize = data.size();
+	if (!warm)
+		coldCreationMicros = 0;
+	return true;
+}
+
+bool PipelineCache::Save()
+{
+	if (cache == VK_NULL_HANDLE || path.empty())
+		return true;
+
+	size_t dataSize = 0;
+	if (vkGetPipelineCacheData(device, cache, &dataSize, nullptr) != VK_SUCCESS)
+		return false;
+	std::vector<u8> data(dataSize);
+	if (vkGetPipelineCacheData(device, cache, &dataSize, data.data()) != VK_SUCCESS)
+		return false;
+	data.resize(dataSize);
+
+	PipelineCacheHeader header = {};
+	header.magic = PIPELINE_CACHE_MAGIC;
+	header.version = PIPELINE_CACHE_VERSION;
+	header.vendorID = properties.vendorID;
+	header.deviceID = properties.deviceID;
+	header.driverVersion = properties.driverVersion;
+	memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+	header.dataSize = data.size();
+	header.dataHash = HashData(data.data(), data.size());
+	header.coldCreationMicros = coldCreationMicros;
+
+	// A crash while writing leaves the previous file intact, the rename replaces it in one step
+	const std::string tempPath = path + ".tmp";
+	{
+		std::ofstream file = std::ofstream(tempPath, std::ios_base::binary | std::ios_base::trunc);
+		if (!file.is_open())
+			return false;
+		file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char *>(data.data()), data.size());
+		file.close();
+		if (file.fail())
+			return false;
+	}
+	std::error_code error;
+	std::filesystem::rename(tempPath, path, error);
+	if (error)
+	{
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+	return true;
+}
+
+void PipelineCache::Shutdown()
+{
+	if (cache != VK_NULL_HANDLE)
+		vkDestroyPipelineCache(device, cache, nullptr);
+	cache = VK_NULL_HANDLE;
+	warm = false;
+	loadedSize = 0;
+}
+
+void PipelineCache::SetCreationMicros(u64 micros)
+{
+	if (!warm)
+		coldCreationMicros = micros;
+}
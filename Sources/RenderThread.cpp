@@ -1,7 +1,14 @@
 #include "RenderThread.hpp"
 
+#include "Core/Logger.hpp"
+#include "Core/Profiler.hpp"
 #include "Resource/Texture.hpp"
 
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+// The frame paths are UTF-8, like every path of the command line
+#define STBIW_WINDOWS_UTF8
+#include <stb_image_write.h>
+
 #include <filesystem>
 #include <time.h>
 #include <fstream>
@@ -16,8 +23,17 @@ const char *alphaBitStrings[] =
 	"VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR"
 };
 
+const char *gpuPassNames[GPU_PASS_COUNT] = { "bin0", "bin1", "bin2", "sim0", "sim1", "cull", "render" };
+
+// The results of a statistics query come in the order of the bits
+const VkQueryPipelineStatisticFlags GPU_STATISTICS_FLAGS =	VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+															VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+															VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+															VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
 std::string LoadFile(const std::string &path)
 {
+	PROFILE_ZONE("LoadFile");
 	std::ifstream file = std::ifstream(path, std::ios_base::binary | std::ios_base::ate);
 	if (!file.is_open())
 		return "";
@@ -32,12 +48,26 @@ std::string LoadFile(const std::string &path)
 	return result;
 }
 
-void RenderThread::Init(HWND hwnd, HINSTANCE hinstance, GameThread *gm, Maths::IVec2 resIn, u32 targetDevice)
+#ifdef _WIN32
+void RenderThread::SetWindow(HWND hwnd, HINSTANCE hinstance)
 {
 	appData.hWnd = hwnd;
 	appData.hInstance = hinstance;
+}
+#endif
+
+void RenderThread::Init(GameThread *gm, Maths::IVec2 resIn, u32 targetDevice, const OffscreenSettings &offscreenIn, bool gpuProfileIn,
+	const std::string &pipelineCachePathIn, bool validateCullingIn)
+{
 	appData.gm = gm;
 	res = resIn;
+	offscreen = offscreenIn;
+	gpuProfile = gpuProfileIn;
+	pipelineCachePath = pipelineCachePathIn;
+	validateCulling = validateCullingIn;
+	for (u32 i = 0; i < GPU_PASS_COUNT; i++)
+		gpuPassTimes[i].Init(GPU_PROFILE_WINDOW);
+	gpuFrameTimes.Init(GPU_PROFILE_WINDOW);
 	thread = std::thread(&RenderThread::ThreadFunc, this, targetDevice);
 }
 
@@ -77,7 +107,10 @@ void RenderThread::HandleResize()
 
 void RenderThread::InitThread()
 {
+#ifdef _WIN32
 	SetThreadDescription(GetCurrentThread(), L"Render Thread");
+#endif
+	PROFILE_THREAD("Render Thread");
 	std::chrono::time_point<std::chrono::system_clock> now = std::chrono::system_clock::now();
 	start = now.time_since_epoch();
 }
@@ -85,13 +118,23 @@ void RenderThread::InitThread()
 void RenderThread::ThreadFunc(u32 targetDevice)
 {
 	InitThread();
-	LoadAssets();
+	if (!LoadAssets())
+	{
+		crashed = true;
+		return;
+	}
 
+	const std::chrono::steady_clock::time_point initStart = std::chrono::steady_clock::now();
 	if (!InitVulkan(targetDevice))
 	{
 		crashed = true;
 		return;
 	}
+	LOG_INFO("Vulkan initialized in {:.1f} ms", std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - initStart).count());
+	const Render::GpuMemoryStats memoryStats = gpuAllocator.GetStats();
+	LOG_INFO("GPU memory: {} allocations in {} blocks and {} dedicated allocations, {:.1f} / {:.1f} MiB used, {} free ranges, {:.1f}% fragmentation",
+		memoryStats.allocationCount, memoryStats.blockCount, memoryStats.dedicatedCount, memoryStats.usedBytes / 1048576.0,
+		memoryStats.reservedBytes / 1048576.0, memoryStats.freeRangeCount, memoryStats.fragmentation * 100);
 
 	u32 counter = 0;
 	u32 tm0 = 0;
@@ -107,7 +150,9 @@ void RenderThread::ThreadFunc(u32 targetDevice)
 		if (tm0 != tm1)
 		{
 			tm0 = tm1;
-			GameThread::LogMessage("FPS: " + std::to_string(counter) + "\n");
+			LOG_INFO("FPS: {}", counter);
+			LogGpuProfile();
+			LogCullingValidation();
 			counter = 0;
 		}
 		counter++;
@@ -116,6 +161,19 @@ void RenderThread::ThreadFunc(u32 targetDevice)
 
 		if (!DrawFrame())
 			break;
+		if (offscreen.frameCount != 0)
+		{
+			// Nothing waits on a display, frames are rendered as fast as the GPU allows
+			if (renderData.simulationFrame < offscreen.frameCount)
+				continue;
+			// The last frames in flight are still in their readback buffers
+			appData.disp.deviceWaitIdle();
+			bool saved = true;
+			for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+				saved &= SaveOffscreenFrame((renderData.currentFrame + i) % MAX_FRAMES_IN_FLIGHT);
+			exit = saved;
+			break;
+		}
 		std::this_thread::sleep_for(std::chrono::milliseconds(5));
 	}
 
@@ -125,38 +183,59 @@ void RenderThread::ThreadFunc(u32 targetDevice)
 
 	if (!exit)
 		crashed = true;
+	else if (offscreen.frameCount != 0)
+		appData.gm->SendWindowMessage(EXIT_WINDOW);
 }
 
 bool RenderThread::InitVulkan(u32 targetDevice)
 {
+	PROFILE_ZONE("RenderThread::InitVulkan");
+	// The uploads are submitted first, the transfer queue copies them while the pipelines are created
 	return	InitDevice(targetDevice) &&
-			CreateSwapchain() &&
+			(offscreen.frameCount != 0 ? CreateOffscreenTargets() : CreateSwapchain()) &&
 			GetQueues() &&
+			CreateCommandPool() &&
+			CreateUploadResources() &&
+			BeginUploads() &&
+			CreateTextureImage() &&
+			CreateVertexBuffer(sceneData.mesh) &&
+			CreateIndexBuffer(sceneData.mesh) &&
+			CreateObjectBuffers(appData.gm->GetSimulationSizes()) &&
+			CreateCullBuffers(appData.gm->GetSimulationSizes()) &&
+			SubmitUploads() &&
 			CreateRenderPass() &&
 			CreateDescriptorSetLayouts() &&
-			CreateGraphicsPipeline() &&
-			CreateComputePipeline() &&
+			CreatePipelines() &&
 			CreateDepthResources() &&
 			CreateFramebuffers() &&
-			CreateCommandPool() &&
-			CreateTextureImage() &&
 			CreateTextureImageView() &&
 			CreateTextureSampler() &&
-			CreateVertexBuffer(sceneData.mesh) &&
-			CreateObjectBuffers(OBJECT_COUNT) &&
 			CreateDescriptorPool() &&
 			CreateDescriptorSets() &&
 			CreateCommandBuffers() &&
-			CreateSyncObjects();
+			CreateSyncObjects() &&
+			WaitUploads();
 }
 
-void RenderThread::LoadAssets()
+bool RenderThread::LoadAssets()
 {
-	sceneData.mesh.CreateDefaultCube();
+	PROFILE_ZONE("RenderThread::LoadAssets");
+	if (!sceneData.mesh.CreateDefaultCube() || !sceneData.mesh.AddImpostorQuad())
+	{
+		GameThread::SendErrorPopup("failed to build the boid mesh");
+		return false;
+	}
+	const std::string packPath = std::filesystem::path(std::filesystem::current_path()).append(ASSET_PACK_PATH).string();
+	if (sceneData.assets.Open(packPath))
+		LOG_INFO("Loading the assets from {}, {} assets in {:.1f} KiB", ASSET_PACK_PATH, sceneData.assets.GetEntryCount(), sceneData.assets.GetSize() / 1024.0);
+	else
+		LOG_INFO("No asset pack, loading the files under Assets");
+	return true;
 }
 
 void RenderThread::UnloadAssets()
 {
+	sceneData.assets.Close();
 	/*
 	kernels.UnloadTextures(textures);
 	kernels.UnloadCubemaps(cubemaps);
@@ -166,6 +245,7 @@ void RenderThread::UnloadAssets()
 	*/
 }
 
+#ifdef _WIN32
 VkSurfaceKHR RenderThread::CreateSurfaceWin32(VkInstance instance, HINSTANCE hInstance, HWND window, VkAllocationCallbacks* allocator)
 {
 	VkSurfaceKHR surface = VK_NULL_HANDLE;
@@ -195,10 +275,12 @@ VkSurfaceKHR RenderThread::CreateSurfaceWin32(VkInstance instance, HINSTANCE hIn
 	}
 	return surface;
 }
+#endif
 
 bool RenderThread::InitDevice(u32 targetDevice)
 {
-	GameThread::LogMessage("Initializing Vulkan...\n");
+	PROFILE_ZONE("RenderThread::InitDevice");
+	LOG_INFO("Initializing Vulkan...");
 	auto systemInfoRes = vkb::SystemInfo::get_system_info();
 	if (!systemInfoRes)
 	{
@@ -206,13 +288,24 @@ bool RenderThread::InitDevice(u32 targetDevice)
 		return false;
 	}
 	auto &systemInfo = systemInfoRes.value();
-	GameThread::LogMessage("Available extensions:\n");
+	LOG_DEBUG("Available extensions:");
 	for (u32 i = 0; i < systemInfo.available_extensions.size(); i++)
-		GameThread::LogMessage(std::string("- ") + systemInfo.available_extensions[i].extensionName + "\n");
+		LOG_DEBUG("- {}", systemInfo.available_extensions[i].extensionName);
 
 	vkb::InstanceBuilder instanceBuilder;
-	instanceBuilder.enable_extension(VK_KHR_SURFACE_EXTENSION_NAME);
-	instanceBuilder.enable_extension(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+	// Without a surface the windowing extensions are not needed, they may be missing on a headless machine
+	if (offscreen.frameCount != 0)
+		instanceBuilder.set_headless();
+	else
+	{
+#ifdef _WIN32
+		instanceBuilder.enable_extension(VK_KHR_SURFACE_EXTENSION_NAME);
+		instanceBuilder.enable_extension(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+#else
+		GameThread::SendErrorPopup("Rendering to a window is only supported on Windows, use --offscreen=N");
+		return false;
+#endif
+	}
 	instanceBuilder.set_app_name("Vulkan Demo").set_app_version(VK_MAKE_VERSION(1, 4, 0));
 	instanceBuilder.set_engine_name("Ligma Engine").request_validation_layers();
 
@@ -220,13 +313,10 @@ bool RenderThread::InitDevice(u32 targetDevice)
 		VkDebugUtilsMessageTypeFlagsEXT messageType,
 		const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
 		void*) -> VkBool32 {
-			if (messageSeverity & (VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT))
-			{
-				const char* severity = vkb::to_string_message_severity(messageSeverity);
-				const char* type = vkb::to_string_message_type(messageType);
-				std::string res = std::string("[") + severity + ": " + type + "] " + pCallbackData->pMessage + "\n";
-				OutputDebugStringA(res.c_str());
-			}
+			if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)
+				LOG_ERROR("[{}] {}", vkb::to_string_message_type(messageType), pCallbackData->pMessage);
+			else if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
+				LOG_WARNING("[{}] {}", vkb::to_string_message_type(messageType), pCallbackData->pMessage);
 			// Return false to move on, but return true for validation to skip passing down the call to the driver
 			return VK_TRUE;
 		});
@@ -240,7 +330,10 @@ bool RenderThread::InitDevice(u32 targetDevice)
 	}
 	appData.instance = instanceRet.value();
 	appData.instDisp = appData.instance.make_table();
-	appData.surface = CreateSurfaceWin32(appData.instance, appData.hInstance, appData.hWnd);
+#ifdef _WIN32
+	if (offscreen.frameCount == 0)
+		appData.surface = CreateSurfaceWin32(appData.instance, appData.hInstance, appData.hWnd);
+#endif
 
 	vkb::PhysicalDeviceSelector physDeviceSelector(appData.instance);
 	auto devices = physDeviceSelector.set_surface(appData.surface).select_devices();
@@ -260,23 +353,31 @@ bool RenderThread::InitDevice(u32 targetDevice)
 		GameThread::SendErrorPopup(err);
 		return false;
 	}
-	GameThread::LogMessage("Suitable GPU(s):\n");
+	LOG_INFO("Suitable GPU(s):");
 	auto &deviceList = devices.value();
 	for (u32 i = 0; i < deviceList.size(); i++)
 	{
-		GameThread::LogMessage(std::to_string(i) + ": " + deviceList[i].name + "\n");
+		LOG_INFO("{}: {}", i, deviceList[i].name);
 	}
 	if (targetDevice >= deviceList.size())
 	{
-		GameThread::LogMessage("Requested GPU id " + std::to_string(targetDevice) + " is not available. Defaulting to first device.\n");
+		LOG_WARNING("Requested GPU id {} is not available. Defaulting to first device.", targetDevice);
 		targetDevice = 0;
 	}
-	GameThread::LogMessage("Using GPU device " + std::to_string(targetDevice) + ": " + deviceList[targetDevice].name + "\n");
+	LOG_INFO("Using GPU device {}: {}", targetDevice, deviceList[targetDevice].name);
 	vkb::PhysicalDevice physicalDevice = deviceList[targetDevice];
 	VkPhysicalDeviceFeatures features = {};
 	features.logicOp = VK_TRUE;
 	features.samplerAnisotropy = VK_TRUE;
 	physicalDevice.enable_features_if_present(features);
+	// Requested on its own, the GPU profiler still has its timestamps without it
+	VkPhysicalDeviceFeatures statisticsFeatures = {};
+	statisticsFeatures.pipelineStatisticsQuery = VK_TRUE;
+	appData.pipelineStatistics = physicalDevice.enable_features_if_present(statisticsFeatures);
+	// The textures fall back to RGBA8 without it
+	VkPhysicalDeviceFeatures compressionFeatures = {};
+	compressionFeatures.textureCompressionBC = VK_TRUE;
+	appData.textureCompressionBC = physicalDevice.enable_features_if_present(compressionFeatures);
 	physicalDevice.enable_extension_if_present(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
 	vkb::DeviceBuilder deviceBuilder{ physicalDevice };
 	VkPhysicalDeviceSynchronization2Features syncFeatures = {};
@@ -292,9 +393,15 @@ bool RenderThread::InitDevice(u32 targetDevice)
 	}
 	appData.device = deviceRet.value();
 	appData.disp = appData.device.make_table();
+	gpuAllocator.Init(physicalDevice, appData.device);
 	VkPhysicalDeviceProperties properties{};
 	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
 	appData.maxSamplerAnisotropy = properties.limits.maxSamplerAnisotropy;
+	appData.maxStorageBufferRange = properties.limits.maxStorageBufferRange;
+	appData.minStorageBufferOffsetAlignment = properties.limits.minStorageBufferOffsetAlignment;
+	appData.timestampPeriod = properties.limits.timestampPeriod;
+	const u32 timestampBits = appData.device.queue_families[appData.device.get_queue_index(vkb::QueueType::graphics).value()].timestampValidBits;
+	appData.timestampMask = timestampBits >= 64 ? ~0ull : (1ull << timestampBits) - 1;
 
 	return true;
 }
@@ -314,11 +421,11 @@ bool RenderThread::CreateSwapchain()
 		init = true;
 		VkSurfaceCapabilitiesKHR surfaceCaps = {};
 		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(appData.device.physical_device, appData.surface, &surfaceCaps);
-		GameThread::LogMessage("Supported alpha composite mode(s):\n");
+		LOG_INFO("Supported alpha composite mode(s):");
 		for (u32 i = 0; i < 4; i++)
 		{
 			if ((1 << i) & surfaceCaps.supportedCompositeAlpha)
-				GameThread::LogMessage(std::string("- ") + alphaBitStrings[i] + "\n");
+				LOG_INFO("- {}", alphaBitStrings[i]);
 		}
 	}
 	auto swapRet = swapchainBuilder.set_old_swapchain(appData.swapchain).build(x, y);
@@ -337,6 +444,59 @@ bool RenderThread::CreateSwapchain()
 	}
 	vkb::destroy_swapchain(appData.swapchain);
 	appData.swapchain = swapRet.value();
+	renderData.colorFormat = appData.swapchain.image_format;
+	renderData.extent = appData.swapchain.extent;
+	// The object buffers are created per image before the framebuffers
+	renderData.swapchainImages = appData.swapchain.get_images().value();
+	renderData.swapchainImageViews = appData.swapchain.get_image_views().value();
+	return true;
+}
+
+bool RenderThread::CreateOffscreenTargets()
+{
+	// Always supported as a color attachment and a copy source, and in the byte order of the PNGs
+	renderData.colorFormat = VK_FORMAT_R8G8B8A8_UNORM;
+	renderData.extent.width = (u32)(res.x);
+	renderData.extent.height = (u32)(res.y);
+	swapRes = res;
+
+	// One image per frame in flight, DrawOffscreenFrame renders frame slot i into image i
+	renderData.swapchainImages.resize(MAX_FRAMES_IN_FLIGHT);
+	renderData.swapchainImageViews.resize(MAX_FRAMES_IN_FLIGHT);
+	renderData.offscreenImagesMemory.resize(MAX_FRAMES_IN_FLIGHT);
+	for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		if (!CreateImage(res, renderData.colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, renderData.swapchainImages[i], renderData.offscreenImagesMemory[i]))
+			return false;
+		renderData.swapchainImageViews[i] = CreateImageView(renderData.swapchainImages[i], renderData.colorFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+		if (renderData.swapchainImageViews[i] == VK_NULL_HANDLE)
+			return false;
+	}
+
+	if (offscreen.saveInterval == 0)
+		return true;
+
+	std::error_code error;
+	std::filesystem::create_directories(offscreen.directory, error);
+	if (error)
+	{
+		GameThread::SendErrorPopup("failed to create the frame directory " + offscreen.directory + ": " + error.message());
+		return false;
+	}
+
+	const VkDeviceSize readbackSize = (VkDeviceSize)(renderData.extent.width) * renderData.extent.height * 4;
+	renderData.readbackBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	renderData.readbackBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+	renderData.readbackBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+	renderData.readbackFrames.resize(MAX_FRAMES_IN_FLIGHT, UINT64_MAX);
+	for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		if (!CreateBuffer(readbackSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			renderData.readbackBuffers[i], renderData.readbackBuffersMemory[i]))
+			return false;
+		renderData.readbackBuffersMapped[i] = renderData.readbackBuffersMemory[i].mapped;
+	}
 	return true;
 }
 
@@ -349,34 +509,46 @@ bool RenderThread::GetQueues()
 		return false;
 	}
 	renderData.graphicsQueue = gq.value();
+	renderData.graphicsQueueFamily = appData.device.get_queue_index(vkb::QueueType::graphics).value();
 
-	auto pq = appData.device.get_queue(vkb::QueueType::present);
-	if (!pq.has_value())
+	// Nothing is presented in offscreen mode, there is no surface to find a present queue for
+	if (offscreen.frameCount == 0)
 	{
-		GameThread::SendErrorPopup("failed to get present queue: " + pq.error().message());
-		return false;
+		auto pq = appData.device.get_queue(vkb::QueueType::present);
+		if (!pq.has_value())
+		{
+			GameThread::SendErrorPopup("failed to get present queue: " + pq.error().message());
+			return false;
+		}
+		renderData.presentQueue = pq.value();
 	}
-	renderData.presentQueue = pq.value();
 
 	auto tq = appData.device.get_queue(vkb::QueueType::transfer);
-	if (!tq.has_value())
+	auto tf = appData.device.get_queue_index(vkb::QueueType::transfer);
+	if (!tq.has_value() || !tf.has_value())
+	{
 		renderData.transferQueue = renderData.graphicsQueue;
+		renderData.transferQueueFamily = renderData.graphicsQueueFamily;
+	}
 	else
+	{
 		renderData.transferQueue = tq.value();
+		renderData.transferQueueFamily = tf.value();
+	}
 	return true;
 }
 
 bool RenderThread::CreateRenderPass()
 {
 	VkAttachmentDescription colorAttachment = {};
-	colorAttachment.format = appData.swapchain.image_format;
+	colorAttachment.format = renderData.colorFormat;
 	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
 	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
 	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	colorAttachment.finalLayout = offscreen.frameCount != 0 ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 	VkAttachmentDescription depthAttachment = {};
 	depthAttachment.format = FindDepthFormat();
@@ -410,15 +582,25 @@ bool RenderThread::CreateRenderPass()
 	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
 	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
+	// Offscreen images are copied to their readback buffer right after the render pass
+	VkSubpassDependency readbackDependency = {};
+	readbackDependency.srcSubpass = 0;
+	readbackDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+	readbackDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	readbackDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	readbackDependency.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	readbackDependency.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
 	VkAttachmentDescription descriptions[2] = {colorAttachment, depthAttachment};
+	VkSubpassDependency dependencies[2] = {dependency, readbackDependency};
 	VkRenderPassCreateInfo renderPassInfo = {};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 	renderPassInfo.attachmentCount = 2;
 	renderPassInfo.pAttachments = descriptions;
 	renderPassInfo.subpassCount = 1;
 	renderPassInfo.pSubpasses = &subpass;
-	renderPassInfo.dependencyCount = 1;
-	renderPassInfo.pDependencies = &dependency;
+	renderPassInfo.dependencyCount = offscreen.frameCount != 0 ? 2 : 1;
+	renderPassInfo.pDependencies = dependencies;
 
 	if (appData.disp.createRenderPass(&renderPassInfo, nullptr, &renderData.renderPass) != VK_SUCCESS)
 	{
@@ -428,7 +610,17 @@ bool RenderThread::CreateRenderPass()
 	return true;
 }
 
-VkShaderModule RenderThread::CreateShaderModule(const std::string &code)
+std::string_view RenderThread::LoadAsset(const char *name, std::string &storage)
+{
+	// Used in place from the mapped pack, 'storage' only holds the loose files
+	const Resource::AssetPackEntry *entry = sceneData.assets.Find(name);
+	if (entry)
+		return std::string_view(reinterpret_cast<const char *>(sceneData.assets.GetData(*entry)), entry->size);
+	storage = LoadFile(std::filesystem::path(std::filesystem::current_path()).append(name).string());
+	return storage;
+}
+
+VkShaderModule RenderThread::CreateShaderModule(std::string_view code)
 {
 	VkShaderModuleCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
@@ -443,7 +635,7 @@ VkShaderModule RenderThread::CreateShaderModule(const std::string &code)
 }
 
 bool RenderThread::CreateImage(	IVec2 res, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage,
-								VkMemoryPropertyFlags properties, VkImage &image, VkDeviceMemory &memory)
+								VkMemoryPropertyFlags properties, VkImage &image, Render::GpuAllocation &memory, u32 mipLevels)
 {
 	VkImageCreateInfo imageInfo = {};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -451,7 +643,7 @@ bool RenderThread::CreateImage(	IVec2 res, VkFormat format, VkImageTiling tiling
 	imageInfo.extent.width = (u32)(res.x);
 	imageInfo.extent.height = (u32)(res.y);
 	imageInfo.extent.depth = 1;
-	imageInfo.mipLevels = 1;
+	imageInfo.mipLevels = mipLevels;
 	imageInfo.arrayLayers = 1;
 	imageInfo.format = format;
 	imageInfo.tiling = tiling;
@@ -467,21 +659,13 @@ bool RenderThread::CreateImage(	IVec2 res, VkFormat format, VkImageTiling tiling
 		return false;
 	}
 
-	VkMemoryRequirements memRequirements;
-	appData.disp.getImageMemoryRequirements(image, &memRequirements);
-
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
-
-	if (appData.disp.allocateMemory(&allocInfo, nullptr, &memory) != VK_SUCCESS)
+	if (!gpuAllocator.AllocateImage(image, tiling, properties, Render::ALLOCATION_FREE_LIST, memory))
 	{
 		GameThread::SendErrorPopup("failed to allocate image memory!");
+		appData.disp.destroyImage(image, nullptr);
+		image = VK_NULL_HANDLE;
 		return false;
 	}
-
-	appData.disp.bindImageMemory(image, memory, 0);
 	return true;
 }
 
@@ -489,35 +673,31 @@ VkVertexInputBindingDescription RenderThread::GetBindingDescription()
 {
 	VkVertexInputBindingDescription bindingDescription = {};
 	bindingDescription.binding = 0;
-	bindingDescription.stride = sizeof(Resource::Vertex);
+	bindingDescription.stride = sizeof(Resource::PackedVertex);
 	bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
 	return bindingDescription;
 }
 
-std::array<VkVertexInputAttributeDescription, 4> RenderThread::GetAttributeDescriptions()
+std::array<VkVertexInputAttributeDescription, 3> RenderThread::GetAttributeDescriptions()
 {
-	std::array<VkVertexInputAttributeDescription, 4> attributeDescriptions = {};
+	// Every format here is mandatory for vertex buffers, the fetch unit converts them to floats
+	std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions = {};
 
 	attributeDescriptions[0].binding = 0;
 	attributeDescriptions[0].location = 0;
-	attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-	attributeDescriptions[0].offset = offsetof(Resource::Vertex, pos);
+	attributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_SFLOAT;
+	attributeDescriptions[0].offset = offsetof(Resource::PackedVertex, pos);
 
 	attributeDescriptions[1].binding = 0;
 	attributeDescriptions[1].location = 1;
-	attributeDescriptions[1].format = VK_FORMAT_R32G32_SFLOAT;
-	attributeDescriptions[1].offset = offsetof(Resource::Vertex, uv);
+	attributeDescriptions[1].format = VK_FORMAT_R16G16_UNORM;
+	attributeDescriptions[1].offset = offsetof(Resource::PackedVertex, uv);
 
 	attributeDescriptions[2].binding = 0;
 	attributeDescriptions[2].location = 2;
-	attributeDescriptions[2].format = VK_FORMAT_R32G32B32_SFLOAT;
-	attributeDescriptions[2].offset = offsetof(Resource::Vertex, col);
-
-	attributeDescriptions[3].binding = 0;
-	attributeDescriptions[3].location = 3;
-	attributeDescriptions[3].format = VK_FORMAT_R32G32B32_SFLOAT;
-	attributeDescriptions[3].offset = offsetof(Resource::Vertex, norm);
+	attributeDescriptions[2].format = VK_FORMAT_R16G16_SNORM;
+	attributeDescriptions[2].offset = offsetof(Resource::PackedVertex, norm);
 
 	return attributeDescriptions;
 }
@@ -531,12 +711,12 @@ bool RenderThread::CreateDescriptorSetLayouts()
 	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	uboLayoutBinding.pImmutableSamplers = nullptr;
 
-	VkDescriptorSetLayoutBinding objectLayoutBinding = {};
-	objectLayoutBinding.binding = 1;
-	objectLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-	objectLayoutBinding.descriptorCount = 1;
-	objectLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-	objectLayoutBinding.pImmutableSamplers = nullptr;
+	VkDescriptorSetLayoutBinding instanceLayoutBinding = {};
+	instanceLayoutBinding.binding = 1;
+	instanceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	instanceLayoutBinding.descriptorCount = 1;
+	instanceLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	instanceLayoutBinding.pImmutableSamplers = nullptr;
 
 	VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
 	samplerLayoutBinding.binding = 2;
@@ -544,6 +724,13 @@ bool RenderThread::CreateDescriptorSetLayouts()
 	samplerLayoutBinding.descriptorCount = 1;
 	samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	samplerLayoutBinding.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutBinding visibleLayoutBinding = {};
+	visibleLayoutBinding.binding = 3;
+	visibleLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	visibleLayoutBinding.descriptorCount = 1;
+	visibleLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	visibleLayoutBinding.pImmutableSamplers = nullptr;
 	
 	VkDescriptorSetLayoutBinding computeLayoutBinding0 = {};
 	computeLayoutBinding0.binding = 0;
@@ -559,16 +746,29 @@ bool RenderThread::CreateDescriptorSetLayouts()
 	computeLayoutBinding1.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 	computeLayoutBinding1.pImmutableSamplers = nullptr;
 
+	VkDescriptorSetLayoutBinding computeLayoutBinding2 = {};
+	computeLayoutBinding2.binding = 2;
+	computeLayoutBinding2.descriptorCount = 1;
+	computeLayoutBinding2.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	computeLayoutBinding2.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	computeLayoutBinding2.pImmutableSamplers = nullptr;
+
+	// 3, 4 and 5 are the velocity, acceleration and rotation streams of the object state, 0 its positions
+	VkDescriptorSetLayoutBinding computeStreamBindings[3] = { computeLayoutBinding0, computeLayoutBinding0, computeLayoutBinding0 };
+	for (u32 j = 0; j < 3; j++)
+		computeStreamBindings[j].binding = 3 + j;
+
 	VkDescriptorSetLayoutCreateInfo layoutInfoCompute = {};
 	layoutInfoCompute.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layoutInfoCompute.bindingCount = 2;
-	VkDescriptorSetLayoutBinding bindings0[2] = { computeLayoutBinding0, computeLayoutBinding1 };
+	layoutInfoCompute.bindingCount = 6;
+	VkDescriptorSetLayoutBinding bindings0[6] = { computeLayoutBinding0, computeLayoutBinding1, computeLayoutBinding2,
+		computeStreamBindings[0], computeStreamBindings[1], computeStreamBindings[2] };
 	layoutInfoCompute.pBindings = bindings0;
 
 	VkDescriptorSetLayoutCreateInfo layoutInfoRender = {};
 	layoutInfoRender.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layoutInfoRender.bindingCount = 3;
-	VkDescriptorSetLayoutBinding bindings1[3] = { uboLayoutBinding, objectLayoutBinding, samplerLayoutBinding };
+	layoutInfoRender.bindingCount = 4;
+	VkDescriptorSetLayoutBinding bindings1[4] = { uboLayoutBinding, instanceLayoutBinding, samplerLayoutBinding, visibleLayoutBinding };
 	layoutInfoRender.pBindings = bindings1;
 	
 	if (appData.disp.createDescriptorSetLayout(&layoutInfoCompute, nullptr, &renderData.descriptorSetLayoutCompute) != VK_SUCCESS ||
@@ -581,14 +781,37 @@ bool RenderThread::CreateDescriptorSetLayouts()
 	return true;
 }
 
-bool RenderThread::CreateGraphicsPipeline()
+bool RenderThread::CreatePipelines()
 {
-	const std::filesystem::path defaultPath = std::filesystem::current_path();
-	std::string vertCode = LoadFile(std::filesystem::path(defaultPath).append("Assets/Shaders/cube.vert.spv").string());
-	std::string fragCode = LoadFile(std::filesystem::path(defaultPath).append("Assets/Shaders/cube.frag.spv").string());
+	if (!pipelineCache.Init(appData.device.physical_device, appData.device, pipelineCachePath))
+	{
+		GameThread::SendErrorPopup("failed to create pipeline cache");
+		return false;
+	}
 
-	VkShaderModule vertModule = CreateShaderModule(vertCode);
-	VkShaderModule fragModule = CreateShaderModule(fragCode);
+	const std::chrono::steady_clock::time_point creationStart = std::chrono::steady_clock::now();
+	if (!CreateGraphicsPipeline() || !CreateComputePipeline())
+		return false;
+	const u64 creationMicros = (u64)(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - creationStart).count());
+
+	// The cold time is kept in the cache file, each warm launch is compared to the launch that compiled everything
+	pipelineCache.SetCreationMicros(creationMicros);
+	if (!pipelineCache.IsWarm())
+		LOG_INFO("Pipelines created in {:.1f} ms from a cold cache", creationMicros / 1000.0);
+	else if (pipelineCache.GetColdCreationMicros() != 0)
+		LOG_INFO("Pipelines created in {:.1f} ms from a {:.1f} KiB cache, {:.1f} ms with a cold cache", creationMicros / 1000.0,
+			pipelineCache.GetLoadedSize() / 1024.0, pipelineCache.GetColdCreationMicros() / 1000.0);
+	else
+		LOG_INFO("Pipelines created in {:.1f} ms from a {:.1f} KiB cache", creationMicros / 1000.0, pipelineCache.GetLoadedSize() / 1024.0);
+	return true;
+}
+
+bool RenderThread::CreateGraphicsPipeline()
+{
+	PROFILE_ZONE("RenderThread::CreateGraphicsPipeline");
+	std::string vertStorage, fragStorage;
+	VkShaderModule vertModule = CreateShaderModule(LoadAsset("Assets/Shaders/cube.vert.spv", vertStorage));
+	VkShaderModule fragModule = CreateShaderModule(LoadAsset("Assets/Shaders/cube.frag.spv", fragStorage));
 	if (vertModule == VK_NULL_HANDLE || fragModule == VK_NULL_HANDLE)
 	{
 		GameThread::SendErrorPopup("failed to create shader module");
@@ -627,14 +850,14 @@ bool RenderThread::CreateGraphicsPipeline()
 	VkViewport viewport = {};
 	viewport.x = 0.0f;
 	viewport.y = 0.0f;
-	viewport.width = (float)appData.swapchain.extent.width;
-	viewport.height = (float)appData.swapchain.extent.height;
+	viewport.width = (float)renderData.extent.width;
+	viewport.height = (float)renderData.extent.height;
 	viewport.minDepth = 0.0f;
 	viewport.maxDepth = 1.0f;
 
 	VkRect2D scissor = {};
 	scissor.offset = { 0, 0 };
-	scissor.extent = appData.swapchain.extent;
+	scissor.extent = renderData.extent;
 
 	VkPipelineViewportStateCreateInfo viewportState = {};
 	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
@@ -728,7 +951,7 @@ bool RenderThread::CreateGraphicsPipeline()
 	pipelineInfo.subpass = 0;
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-	if (appData.disp.createGraphicsPipelines(VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &renderData.graphicsPipeline) != VK_SUCCESS)
+	if (appData.disp.createGraphicsPipelines(pipelineCache.Get(), 1, &pipelineInfo, nullptr, &renderData.graphicsPipeline) != VK_SUCCESS)
 	{
 		GameThread::SendErrorPopup("failed to create pipline");
 		return false;
@@ -741,17 +964,17 @@ bool RenderThread::CreateGraphicsPipeline()
 
 bool RenderThread::CreateComputePipeline()
 {
-	const std::filesystem::path defaultPath = std::filesystem::current_path();
-	std::string compCodeSort0 = LoadFile(std::filesystem::path(defaultPath).append("Assets/Shaders/sort0.comp.spv").string());
-	std::string compCodeSort1 = LoadFile(std::filesystem::path(defaultPath).append("Assets/Shaders/sort1.comp.spv").string());
-	std::string compCodeSim0 = LoadFile(std::filesystem::path(defaultPath).append("Assets/Shaders/sim0.comp.spv").string());
-	std::string compCodeSim1 = LoadFile(std::filesystem::path(defaultPath).append("Assets/Shaders/sim1.comp.spv").string());
-
-	VkShaderModule compModuleSort0 = CreateShaderModule(compCodeSort0);
-	VkShaderModule compModuleSort1 = CreateShaderModule(compCodeSort1);
-	VkShaderModule compModuleSim0 = CreateShaderModule(compCodeSim0);
-	VkShaderModule compModuleSim1 = CreateShaderModule(compCodeSim1);
-	if (compModuleSort0 == VK_NULL_HANDLE || compModuleSort1 == VK_NULL_HANDLE || compModuleSim0 == VK_NULL_HANDLE || compModuleSim1 == VK_NULL_HANDLE)
+	PROFILE_ZONE("RenderThread::CreateComputePipeline");
+	std::string codeStorage[COMPUTE_PIPELINE_COUNT];
+	VkShaderModule compModuleBin0 = CreateShaderModule(LoadAsset("Assets/Shaders/bin0.comp.spv", codeStorage[0]));
+	VkShaderModule compModuleBin1 = CreateShaderModule(LoadAsset("Assets/Shaders/bin1.comp.spv", codeStorage[1]));
+	VkShaderModule compModuleBin2 = CreateShaderModule(LoadAsset("Assets/Shaders/bin2.comp.spv", codeStorage[2]));
+	VkShaderModule compModuleSim0 = CreateShaderModule(LoadAsset(appData.gm->GetSimulationSizes().GetNeighbourShaderPath(), codeStorage[3]));
+	VkShaderModule compModuleSim1 = CreateShaderModule(LoadAsset("Assets/Shaders/sim1.comp.spv", codeStorage[4]));
+	VkShaderModule compModuleReorder = CreateShaderModule(LoadAsset("Assets/Shaders/reorder.comp.spv", codeStorage[5]));
+	VkShaderModule compModuleCull = CreateShaderModule(LoadAsset("Assets/Shaders/cull.comp.spv", codeStorage[6]));
+	if (compModuleBin0 == VK_NULL_HANDLE || compModuleBin1 == VK_NULL_HANDLE || compModuleBin2 == VK_NULL_HANDLE || compModuleSim0 == VK_NULL_HANDLE || compModuleSim1 == VK_NULL_HANDLE ||
+		compModuleReorder == VK_NULL_HANDLE || compModuleCull == VK_NULL_HANDLE)
 	{
 		GameThread::SendErrorPopup("failed to create compute shader module");
 		return false;
@@ -769,64 +992,86 @@ bool RenderThread::CreateComputePipeline()
 		return false;
 	}
 
-	VkShaderModule modules[4] = {compModuleSort0, compModuleSort1, compModuleSim0, compModuleSim1};
-	VkPipelineShaderStageCreateInfo compStageInfo[4] = {};
-	VkComputePipelineCreateInfo pipelineInfo[4] = {};
+	// Simulation sizes are specialization constants, the same SPIR-V works for any boid count
+	u32 specData[Simulation::SPEC_COUNT];
+	appData.gm->GetSimulationSizes().GetSpecializationData(specData);
+	VkSpecializationMapEntry specEntries[Simulation::SPEC_COUNT] = {};
+	for (u32 i = 0; i < Simulation::SPEC_COUNT; i++)
+	{
+		specEntries[i].constantID = i;
+		specEntries[i].offset = i * sizeof(u32);
+		specEntries[i].size = sizeof(u32);
+	}
+	VkSpecializationInfo specInfo = {};
+	specInfo.mapEntryCount = Simulation::SPEC_COUNT;
+	specInfo.pMapEntries = specEntries;
+	specInfo.dataSize = sizeof(specData);
+	specInfo.pData = specData;
+
+	VkShaderModule modules[COMPUTE_PIPELINE_COUNT] = {compModuleBin0, compModuleBin1, compModuleBin2, compModuleSim0, compModuleSim1, compModuleReorder, compModuleCull};
+	VkPipelineShaderStageCreateInfo compStageInfo[COMPUTE_PIPELINE_COUNT] = {};
+	VkComputePipelineCreateInfo pipelineInfo[COMPUTE_PIPELINE_COUNT] = {};
 
-	for (u32 i = 0; i < 4; i++)
+	for (u32 i = 0; i < COMPUTE_PIPELINE_COUNT; i++)
 	{
 		compStageInfo[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		compStageInfo[i].stage = VK_SHADER_STAGE_COMPUTE_BIT;
 		compStageInfo[i].module = modules[i];
 		compStageInfo[i].pName = "main";
+		compStageInfo[i].pSpecializationInfo = &specInfo;
 
 		pipelineInfo[i].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
 		pipelineInfo[i].layout = renderData.computePipelineLayout;
 		pipelineInfo[i].stage = compStageInfo[i];
 	}
 
-	if (appData.disp.createComputePipelines(VK_NULL_HANDLE, 4, pipelineInfo, nullptr, renderData.computePipelines) != VK_SUCCESS)
+	if (appData.disp.createComputePipelines(pipelineCache.Get(), COMPUTE_PIPELINE_COUNT, pipelineInfo, nullptr, renderData.computePipelines) != VK_SUCCESS)
 	{
 		GameThread::SendErrorPopup("failed to create compute pipelines!");
 		return false;
 	}
 
-	appData.disp.destroyShaderModule(compModuleSort0, nullptr);
-	appData.disp.destroyShaderModule(compModuleSort1, nullptr);
+	appData.disp.destroyShaderModule(compModuleBin0, nullptr);
+	appData.disp.destroyShaderModule(compModuleBin1, nullptr);
+	appData.disp.destroyShaderModule(compModuleBin2, nullptr);
 	appData.disp.destroyShaderModule(compModuleSim0, nullptr);
 	appData.disp.destroyShaderModule(compModuleSim1, nullptr);
+	appData.disp.destroyShaderModule(compModuleReorder, nullptr);
+	appData.disp.destroyShaderModule(compModuleCull, nullptr);
 
 	return true;
 }
 
-u32 align(unsigned int x, unsigned int a)
+VkDeviceSize align(VkDeviceSize x, VkDeviceSize a)
 {
-	unsigned int r = x % a;
+	VkDeviceSize r = x % a;
 	return r ? x + (a - r) : x;
 }
 
-bool RenderThread::CreateObjectBuffers(u32 objectCount)
+bool RenderThread::CreateObjectBuffers(const Simulation::SimulationSizes &sizes)
 {
-	VkDeviceSize bufferSizeA = sizeof(Mat4);
-	renderData.sizeObjects = align(sizeof(Vec4) * 4 * objectCount, 0x40);
-	renderData.sizeSortBuf = align(SORT_THREAD_COUNT * CHUNK_COUNT * SORT_THREAD_OBJECT_PER_CHUNK * sizeof(u32), 0x40);
-	renderData.sizeMergeBuf = align(MAX_OBJECTS_PER_CHUNK * CHUNK_COUNT * sizeof(u32), 0x40);
-	renderData.mainBufSize = renderData.sizeObjects + renderData.sizeSortBuf + renderData.sizeMergeBuf;
+	VkDeviceSize bufferSizeA = sizeof(FrameUniforms);
+	// Each region is bound at its own offset, so they all start on the device storage buffer alignment.
+	// The streams inside the object state are padded to 64 objects, which covers the largest alignment allowed.
+	const VkDeviceSize regionAlignment = appData.minStorageBufferOffsetAlignment > 0x40 ? appData.minStorageBufferOffsetAlignment : 0x40;
+	// The streams of the object state, back to back
+	renderData.sizeObjects = align(sizes.stateUintCount * sizeof(u32), regionAlignment);
+	renderData.sizeBinBuf = align(sizes.binBufferCount * sizeof(u32), regionAlignment);
+	// The reorder pass gathers the objects there before they are copied back
+	renderData.sizeReorderBuf = sizes.reorderInterval != 0 ? renderData.sizeObjects : 0;
+	// Written by sim1, the only part of the objects the vertex shader reads
+	renderData.sizeInstances = align(INSTANCE_UINT_COUNT * sizeof(u32) * (VkDeviceSize)(sizes.objectCount), regionAlignment);
+	renderData.mainBufSize = renderData.sizeObjects + renderData.sizeBinBuf + renderData.sizeReorderBuf + renderData.sizeInstances;
+	if (renderData.sizeObjects > appData.maxStorageBufferRange || renderData.sizeBinBuf > appData.maxStorageBufferRange)
+	{
+		GameThread::SendErrorPopup("simulation buffers are larger than the device storage buffer range, reduce the boid count");
+		return false;
+	}
 	VkDeviceSize bufferSizeB = renderData.mainBufSize;
 	renderData.objectBuffers.resize(renderData.swapchainImageViews.size());
 	renderData.objectBuffersMemory.resize(renderData.swapchainImageViews.size());
 	renderData.objectBuffersMapped.resize(renderData.swapchainImageViews.size());
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	CreateBuffer(bufferSizeB, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-	auto sourceData = appData.gm->GetInitialSimulationData();
-	void* data;
-	appData.disp.mapMemory(stagingBufferMemory, 0, renderData.sizeObjects, 0, &data);
-	memcpy(data, sourceData.data(), renderData.sizeObjects);
-	appData.disp.unmapMemory(stagingBufferMemory);
-
 	bool success = true;
 	for (u32 i = 0; i < renderData.swapchainImageViews.size(); i++)
 	{
@@ -835,33 +1080,76 @@ bool RenderThread::CreateObjectBuffers(u32 objectCount)
 								VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 								renderData.objectBuffers[i],
 								renderData.objectBuffersMemory[i]);
-	
-		success &= appData.disp.mapMemory(	renderData.objectBuffersMemory[i],
-											0,
-											bufferSizeA,
-											0,
-											reinterpret_cast<void**>(&renderData.objectBuffersMapped[i])) == VK_SUCCESS;
+		renderData.objectBuffersMapped[i] = reinterpret_cast<Vec4*>(renderData.objectBuffersMemory[i].mapped);
 	}
 
 	success &= CreateBuffer(bufferSizeB,
-		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 		renderData.computeBuffer,
 		renderData.computeBufferMemory);
+	if (!success)
+		return false;
 
-	CopyBuffer(stagingBuffer, renderData.computeBuffer, bufferSizeB);
+	// Only the objects have an initial state, the bins are written by the first frame
+	const std::vector<u32> sourceData = sizes.PackState(appData.gm->GetInitialSimulationData());
+	return UploadBuffer(sourceData.data(), sourceData.size() * sizeof(u32), renderData.computeBuffer);
+}
 
-	appData.disp.destroyBuffer(stagingBuffer, nullptr);
-	appData.disp.freeMemory(stagingBufferMemory, nullptr);
+bool RenderThread::CreateCullBuffers(const Simulation::SimulationSizes &sizes)
+{
+	renderData.sizeCullBuf = align(sizes.cullBufferCount * sizeof(u32), 0x40);
+	if (renderData.sizeCullBuf > appData.maxStorageBufferRange)
+	{
+		GameThread::SendErrorPopup("culling buffer is larger than the device storage buffer range, reduce the boid count");
+		return false;
+	}
+	if (!CreateBuffer(renderData.sizeCullBuf,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		renderData.cullBuffer,
+		renderData.cullBufferMemory))
+		return false;
 
-	return success;
+	if (validateCulling)
+	{
+		const u32 imageCount = (u32)(renderData.swapchainImageViews.size());
+		renderData.cullReadbackBuffers.resize(imageCount);
+		renderData.cullReadbackBuffersMemory.resize(imageCount);
+		renderData.cullReadbackPending.resize(imageCount, 0);
+		for (u32 i = 0; i < imageCount; i++)
+		{
+			if (!CreateBuffer(renderData.sizeCullBuf + renderData.sizeObjects, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				renderData.cullReadbackBuffers[i], renderData.cullReadbackBuffersMemory[i]))
+				return false;
+		}
+	}
+
+	// cull.comp only counts the instances, the rest of the draws never changes
+	const std::vector<Resource::SubMesh> &subMeshes = sceneData.mesh.GetSubMeshes();
+	if (subMeshes.size() < LOD_COUNT)
+	{
+		GameThread::SendErrorPopup("the boid mesh is missing a level of detail");
+		return false;
+	}
+	u32 header[CULL_HEADER_COUNT] = {};
+	for (u32 i = 0; i < LOD_COUNT; i++)
+	{
+		VkDrawIndexedIndirectCommand command = {};
+		command.indexCount = subMeshes[i].indexCount;
+		command.firstIndex = subMeshes[i].firstIndex;
+		command.vertexOffset = subMeshes[i].vertexOffset;
+		memcpy(header + i * CULL_COMMAND_STRIDE, &command, sizeof(command));
+	}
+	// Every boid starts with its mesh
+	const std::vector<u32> lodState((size_t)(sizes.cullBufferCount - sizes.cullLodStateOffset), 0);
+	return UploadBuffer(header, sizeof(header), renderData.cullBuffer) &&
+		UploadBuffer(lodState.data(), lodState.size() * sizeof(u32), renderData.cullBuffer, sizes.cullLodStateOffset * sizeof(u32));
 }
 
 bool RenderThread::CreateFramebuffers()
 {
-	renderData.swapchainImages = appData.swapchain.get_images().value();
-	renderData.swapchainImageViews = appData.swapchain.get_image_views().value();
-
 	renderData.framebuffers.resize(renderData.swapchainImageViews.size());
 
 	for (u32 i = 0; i < renderData.swapchainImageViews.size(); i++)
@@ -873,8 +1161,8 @@ bool RenderThread::CreateFramebuffers()
 		framebufferInfo.renderPass = renderData.renderPass;
 		framebufferInfo.attachmentCount = 2;
 		framebufferInfo.pAttachments = attachments;
-		framebufferInfo.width = appData.swapchain.extent.width;
-		framebufferInfo.height = appData.swapchain.extent.height;
+		framebufferInfo.width = renderData.extent.width;
+		framebufferInfo.height = renderData.extent.height;
 		framebufferInfo.layers = 1;
 
 		if (appData.disp.createFramebuffer(&framebufferInfo, nullptr, &renderData.framebuffers[i]) != VK_SUCCESS)
@@ -887,7 +1175,7 @@ bool RenderThread::CreateCommandPool()
 {
 	VkCommandPoolCreateInfo poolInfo0 = {};
 	poolInfo0.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	poolInfo0.queueFamilyIndex = appData.device.get_queue_index(vkb::QueueType::graphics).value();
+	poolInfo0.queueFamilyIndex = renderData.graphicsQueueFamily;
 
 	if (appData.disp.createCommandPool(&poolInfo0, nullptr, &renderData.commandPool) != VK_SUCCESS)
 	{
@@ -897,8 +1185,7 @@ bool RenderThread::CreateCommandPool()
 
 	VkCommandPoolCreateInfo poolInfo1 = {};
 	poolInfo1.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	auto transfer = appData.device.get_queue_index(vkb::QueueType::transfer);
-	poolInfo1.queueFamilyIndex = transfer.has_value() ? transfer.value() : poolInfo0.queueFamilyIndex;
+	poolInfo1.queueFamilyIndex = renderData.transferQueueFamily;
 
 	if (appData.disp.createCommandPool(&poolInfo1, nullptr, &renderData.transfertCommandPool) != VK_SUCCESS)
 	{
@@ -910,42 +1197,84 @@ bool RenderThread::CreateCommandPool()
 
 bool RenderThread::CreateTextureImage()
 {
-	IVec2 res;
-	u8 *pixels = Resource::Texture::ReadTexture("Assets/Textures/blocks.png", res);
-	if (!pixels)
+	PROFILE_ZONE("RenderThread::CreateTextureImage");
+	const std::string texturePath = "Assets/Textures/blocks.png";
+	const char *const encodingNames[Resource::TEXTURE_ENCODING_COUNT] = { "RGBA8", "BC1", "BC7" };
+
+	// Best variant of the asset pack that the device can sample: BC7, BC1, then the RGBA8 chain
+	struct TextureVariant
 	{
-		GameThread::SendErrorPopup("failed to load texture");
-		return false;
+		const char *suffix;
+		Resource::AssetType type;
+		VkFormat format;
+	};
+	const TextureVariant variants[3] = {
+		{ ".bc7", Resource::ASSET_TEXTURE_BC7, VK_FORMAT_BC7_SRGB_BLOCK },
+		{ ".bc1", Resource::ASSET_TEXTURE_BC1, VK_FORMAT_BC1_RGB_SRGB_BLOCK },
+		{ "", Resource::ASSET_TEXTURE_RGBA8, VK_FORMAT_R8G8B8A8_SRGB } };
+	const Resource::AssetPackEntry *entry = nullptr;
+	renderData.textureFormat = VK_FORMAT_R8G8B8A8_SRGB;
+	for (u32 i = 0; i < 3 && !entry; i++)
+	{
+		if (variants[i].type != Resource::ASSET_TEXTURE_RGBA8 && !IsCompressedFormatSupported(variants[i].format))
+			continue;
+		entry = sceneData.assets.Find(texturePath + variants[i].suffix);
+		if (entry && entry->type != variants[i].type)
+			entry = nullptr;
+		if (entry)
+			renderData.textureFormat = variants[i].format;
 	}
-	u64 imageSize = sizeof(u32) * res.x * res.y;
-
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	CreateBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-	void *data;
-	appData.disp.mapMemory(stagingBufferMemory, 0, imageSize, 0, &data);
-	memcpy(data, pixels, static_cast<size_t>(imageSize));
-	appData.disp.unmapMemory(stagingBufferMemory);
-
-	Resource::Texture::FreeTextureData(pixels);
 
-	CreateImage(res, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, renderData.textureImage, renderData.textureImageMemory);
-
-	TransitionImageLayout(renderData.textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	CopyBufferToImage(stagingBuffer, renderData.textureImage, (u32)(res.x), (u32)(res.y));
-	TransitionImageLayout(renderData.textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	const u8 *data = nullptr;
+	u32 width, height;
+	Resource::TextureEncoding encoding = Resource::TEXTURE_RGBA8;
+	std::vector<u8> chain;
+	if (entry)
+	{
+		data = sceneData.assets.GetData(*entry);
+		width = entry->width;
+		height = entry->height;
+		renderData.textureMipLevels = entry->mipCount;
+		encoding = Resource::GetTextureEncoding(entry->type);
+	}
+	else
+	{
+		// Not in the asset pack, decoded and mipmapped here
+		IVec2 res;
+		u8 *pixels = Resource::Texture::ReadTexture(texturePath, res);
+		if (!pixels)
+		{
+			GameThread::SendErrorPopup("failed to load texture");
+			return false;
+		}
+		width = (u32)(res.x);
+		height = (u32)(res.y);
+		chain = Resource::TextureEncoder::BuildMipChain(pixels, width, height);
+		Resource::Texture::FreeTextureData(pixels);
+		renderData.textureMipLevels = Resource::TextureEncoder::GetMipCount(width, height);
+		data = chain.data();
+	}
+	LOG_INFO("Texture {}: {}x{}, {} mips, {}", texturePath, width, height, renderData.textureMipLevels, encodingNames[encoding]);
 
-	appData.disp.destroyBuffer(stagingBuffer, nullptr);
-	appData.disp.freeMemory(stagingBufferMemory, nullptr);
+	// The data is copied to the staging buffer while recording, it can be freed right after
+	return	CreateImage(IVec2((s32)(width), (s32)(height)), renderData.textureFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, renderData.textureImage, renderData.textureImageMemory, renderData.textureMipLevels) &&
+			UploadImage(data, renderData.textureImage, width, height, renderData.textureMipLevels, encoding);
+}
 
-	return true;
+bool RenderThread::IsCompressedFormatSupported(VkFormat format)
+{
+	if (!appData.textureCompressionBC)
+		return false;
+	const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(appData.device.physical_device, format, &properties);
+	return (properties.optimalTilingFeatures & required) == required;
 }
 
 bool RenderThread::CreateTextureImageView()
 {
-	renderData.textureImageView = CreateImageView(renderData.textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
+	renderData.textureImageView = CreateImageView(renderData.textureImage, renderData.textureFormat, VK_IMAGE_ASPECT_COLOR_BIT, renderData.textureMipLevels);
 	return renderData.textureImageView != nullptr;
 }
 
@@ -954,7 +1283,8 @@ bool RenderThread::CreateTextureSampler()
 	VkSamplerCreateInfo samplerInfo = {};
 	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
 	samplerInfo.magFilter = VK_FILTER_NEAREST;
-	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	// Texels stay sharp up close, the distant boids blend their mips instead of aliasing
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
 	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
@@ -967,7 +1297,7 @@ bool RenderThread::CreateTextureSampler()
 	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	samplerInfo.mipLodBias = 0.0f;
 	samplerInfo.minLod = 0.0f;
-	samplerInfo.maxLod = 0.0f;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
 	if (appData.disp.createSampler(&samplerInfo, nullptr, &renderData.textureSampler) != VK_SUCCESS)
 	{
@@ -978,7 +1308,7 @@ bool RenderThread::CreateTextureSampler()
 	return true;
 }
 
-VkImageView RenderThread::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags)
+VkImageView RenderThread::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, u32 mipLevels)
 {
 	VkImageViewCreateInfo viewInfo = {};
 	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -987,7 +1317,7 @@ VkImageView RenderThread::CreateImageView(VkImage image, VkFormat format, VkImag
 	viewInfo.format = format;
 	viewInfo.subresourceRange.aspectMask = aspectFlags;
 	viewInfo.subresourceRange.baseMipLevel = 0;
-	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.levelCount = mipLevels;
 	viewInfo.subresourceRange.baseArrayLayer = 0;
 	viewInfo.subresourceRange.layerCount = 1;
 
@@ -998,185 +1328,310 @@ VkImageView RenderThread::CreateImageView(VkImage image, VkFormat format, VkImag
 	return imageView;
 }
 
-VkCommandBuffer RenderThread::BeginSingleTimeCommands(VkCommandPool targetPool)
+bool RenderThread::CreateUploadResources()
 {
-	VkCommandBufferAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = targetPool;
-	allocInfo.commandBufferCount = 1;
+	if (!CreateBuffer(	UPLOAD_STAGING_SIZE,
+						VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+						VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+						renderData.stagingBuffer,
+						renderData.stagingBufferMemory))
+		return false;
 
-	VkCommandBuffer commandBuffer;
-	appData.disp.allocateCommandBuffers(&allocInfo, &commandBuffer);
-	
-	VkCommandBufferBeginInfo beginInfo = {};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-	appData.disp.beginCommandBuffer(commandBuffer, &beginInfo);
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 
-	return commandBuffer;
+	if (appData.disp.createSemaphore(&semaphoreInfo, nullptr, &renderData.uploadSemaphore) != VK_SUCCESS ||
+		appData.disp.createFence(&fenceInfo, nullptr, &renderData.uploadFence) != VK_SUCCESS)
+	{
+		GameThread::SendErrorPopup("failed to create upload sync objects");
+		return false;
+	}
+	return true;
 }
 
-void RenderThread::EndSingleTimeCommands(VkCommandBuffer commandBuffer, VkCommandPool targetPool, VkQueue targetQueue)
+bool RenderThread::BeginUploads()
 {
-	appData.disp.endCommandBuffer(commandBuffer);
+	const bool acquire = renderData.transferQueueFamily != renderData.graphicsQueueFamily;
+	VkCommandBuffer *commandBuffers[2] = { &renderData.uploadCommandBuffer, &renderData.acquireCommandBuffer };
+	const VkCommandPool pools[2] = { renderData.transfertCommandPool, renderData.commandPool };
 
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
-
-	appData.disp.queueSubmit(targetQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	appData.disp.queueWaitIdle(targetQueue);
-	appData.disp.freeCommandBuffers(targetPool, 1, &commandBuffer);
-}
+	for (u32 i = 0; i < (acquire ? 2u : 1u); i++)
+	{
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = pools[i];
+		allocInfo.commandBufferCount = 1;
 
-bool RenderThread::CreateDepthResources()
-{
-	VkFormat depthFormat = FindDepthFormat();
-	CreateImage(swapRes, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, renderData.depthImage, renderData.depthImageMemory);
-	renderData.depthImageView = CreateImageView(renderData.depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
+		if (appData.disp.allocateCommandBuffers(&allocInfo, commandBuffers[i]) != VK_SUCCESS ||
+			appData.disp.beginCommandBuffer(*commandBuffers[i], &beginInfo) != VK_SUCCESS)
+		{
+			GameThread::SendErrorPopup("failed to begin upload command buffers");
+			return false;
+		}
+	}
+	renderData.stagingHead = 0;
 	return true;
 }
 
-bool RenderThread::CreateVertexBuffer(const Resource::Mesh &m)
+bool RenderThread::ReserveStaging(VkDeviceSize size, VkDeviceSize &offset)
 {
-	const auto &vertices = m.GetVertices();
-
-	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	CreateBuffer(	bufferSize,
-					VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-					stagingBuffer,
-					stagingBufferMemory);
-
-	void *data;
-	appData.disp.mapMemory(stagingBufferMemory, 0, bufferSize, 0, &data);
-	std::memcpy(data, vertices.data(), bufferSize);
-	appData.disp.unmapMemory(stagingBufferMemory);
-
-	CreateBuffer(	bufferSize,
-					VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-					renderData.vertexBuffer,
-					renderData.vertexBufferMemory);
-	
-	CopyBuffer(stagingBuffer, renderData.vertexBuffer, bufferSize);
-
-	appData.disp.destroyBuffer(stagingBuffer, nullptr);
-	appData.disp.freeMemory(stagingBufferMemory, nullptr);
-	
+	offset = align(renderData.stagingHead, UPLOAD_ALIGNMENT);
+	if (offset + size > UPLOAD_STAGING_SIZE)
+	{
+		// The staging buffer is full, the batch is sent and a new one starts once the GPU has read it
+		if (!SubmitUploads() || !WaitUploads() || !BeginUploads())
+			return false;
+		offset = 0;
+	}
+	renderData.stagingHead = offset + size;
 	return true;
 }
 
-bool RenderThread::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+bool RenderThread::UploadBuffer(const void *data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset)
 {
-	VkCommandBuffer commandBuffer = BeginSingleTimeCommands(renderData.transfertCommandPool);
-	
-	VkBufferCopy copyRegion = {};
-	copyRegion.srcOffset = 0; // Optional
-	copyRegion.dstOffset = 0; // Optional
-	copyRegion.size = size;
-	appData.disp.cmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+	const u8 *source = static_cast<const u8 *>(data);
+	while (size != 0)
+	{
+		const VkDeviceSize chunkSize = size < UPLOAD_STAGING_SIZE ? size : UPLOAD_STAGING_SIZE;
+		VkDeviceSize stagingOffset;
+		if (!ReserveStaging(chunkSize, stagingOffset))
+			return false;
+		memcpy(renderData.stagingBufferMemory.mapped + stagingOffset, source, chunkSize);
 
-	EndSingleTimeCommands(commandBuffer, renderData.transfertCommandPool, renderData.transferQueue);
+		VkBufferCopy copyRegion = {};
+		copyRegion.srcOffset = stagingOffset;
+		copyRegion.dstOffset = dstOffset;
+		copyRegion.size = chunkSize;
+		appData.disp.cmdCopyBuffer(renderData.uploadCommandBuffer, renderData.stagingBuffer, dstBuffer, 1, &copyRegion);
 
+		source += chunkSize;
+		dstOffset += chunkSize;
+		size -= chunkSize;
+	}
 	return true;
 }
 
-bool RenderThread::TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout)
+bool RenderThread::UploadImage(const u8 *data, VkImage image, u32 width, u32 height, u32 mipCount, Resource::TextureEncoding encoding)
 {
-	VkCommandBuffer commandBuffer = BeginSingleTimeCommands(renderData.commandPool);
+	u32 blockSide, blockBytes;
+	Resource::TextureEncoder::GetBlockInfo(encoding, blockSide, blockBytes);
+	const VkDeviceSize maxRowPitch = (VkDeviceSize)((width + blockSide - 1) / blockSide) * blockBytes;
+	if (maxRowPitch > UPLOAD_STAGING_SIZE)
+	{
+		GameThread::SendErrorPopup("texture rows are larger than the staging buffer");
+		return false;
+	}
 
-	VkImageMemoryBarrier barrier = {};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.oldLayout = oldLayout;
-	barrier.newLayout = newLayout;
+	VkImageMemoryBarrier2KHR barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE_KHR;
+	barrier.srcAccessMask = VK_ACCESS_2_NONE_KHR;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT_KHR;
+	barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
 	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barrier.image = image;
 	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.levelCount = mipCount;
 	barrier.subresourceRange.baseArrayLayer = 0;
 	barrier.subresourceRange.layerCount = 1;
-	barrier.srcAccessMask = 0; // TODO
-	barrier.dstAccessMask = 0; // TODO
 
-	VkPipelineStageFlags sourceStage;
-	VkPipelineStageFlags destinationStage;
+	VkDependencyInfoKHR dependencyInfo = {};
+	dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+	dependencyInfo.imageMemoryBarrierCount = 1;
+	dependencyInfo.pImageMemoryBarriers = &barrier;
+	appData.disp.cmdPipelineBarrier2KHR(renderData.uploadCommandBuffer, &dependencyInfo);
+
+	// Levels larger than the staging buffer are copied a few rows of blocks at a time, over several batches
+	for (u32 level = 0; level < mipCount; level++)
+	{
+		const u32 levelWidth = width >> level ? width >> level : 1;
+		const u32 levelHeight = height >> level ? height >> level : 1;
+		const u32 blockRows = (levelHeight + blockSide - 1) / blockSide;
+		const VkDeviceSize rowPitch = (VkDeviceSize)((levelWidth + blockSide - 1) / blockSide) * blockBytes;
+		u32 row = 0;
+		while (row < blockRows)
+		{
+			const u32 maxRows = (u32)(UPLOAD_STAGING_SIZE / rowPitch);
+			const u32 rowCount = blockRows - row < maxRows ? blockRows - row : maxRows;
+			VkDeviceSize stagingOffset;
+			if (!ReserveStaging(rowPitch * rowCount, stagingOffset))
+				return false;
+			memcpy(renderData.stagingBufferMemory.mapped + stagingOffset, data + rowPitch * row, rowPitch * rowCount);
+
+			// The extent of the last blocks is clamped to the level, it is not a multiple of the block side
+			const u32 texelRow = row * blockSide;
+			const u32 texelRowCount = rowCount * blockSide < levelHeight - texelRow ? rowCount * blockSide : levelHeight - texelRow;
+			VkBufferImageCopy region = {};
+			region.bufferOffset = stagingOffset;
+			region.bufferRowLength = 0;
+			region.bufferImageHeight = 0;
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.mipLevel = level;
+			region.imageSubresource.baseArrayLayer = 0;
+			region.imageSubresource.layerCount = 1;
+			region.imageOffset = { 0, (s32)(texelRow), 0 };
+			region.imageExtent = { levelWidth, texelRowCount, 1 };
+			appData.disp.cmdCopyBufferToImage(renderData.uploadCommandBuffer, renderData.stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+			row += rowCount;
+		}
+		data += Resource::TextureEncoder::GetLevelSize(encoding, levelWidth, levelHeight);
+	}
+
+	// The image is exclusive to one family. On a transfer only queue it is released there with its final layout,
+	// then acquired by the graphics queue, both barriers do the same layout transition.
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT_KHR;
+	barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR;
+	barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	if (renderData.acquireCommandBuffer == VK_NULL_HANDLE)
+	{
+		appData.disp.cmdPipelineBarrier2KHR(renderData.uploadCommandBuffer, &dependencyInfo);
+		return true;
+	}
+
+	barrier.srcQueueFamilyIndex = renderData.transferQueueFamily;
+	barrier.dstQueueFamilyIndex = renderData.graphicsQueueFamily;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE_KHR;
+	barrier.dstAccessMask = VK_ACCESS_2_NONE_KHR;
+	appData.disp.cmdPipelineBarrier2KHR(renderData.uploadCommandBuffer, &dependencyInfo);
+
+	// Ordered after the release by the semaphore wait, which covers every stage
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR;
+	barrier.srcAccessMask = VK_ACCESS_2_NONE_KHR;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR;
+	barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR;
+	appData.disp.cmdPipelineBarrier2KHR(renderData.acquireCommandBuffer, &dependencyInfo);
+	return true;
+}
 
-	if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+bool RenderThread::SubmitUploads()
+{
+	PROFILE_ZONE("RenderThread::SubmitUploads");
+	const bool acquire = renderData.acquireCommandBuffer != VK_NULL_HANDLE;
+	if (appData.disp.endCommandBuffer(renderData.uploadCommandBuffer) != VK_SUCCESS ||
+		(acquire && appData.disp.endCommandBuffer(renderData.acquireCommandBuffer) != VK_SUCCESS))
 	{
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		GameThread::SendErrorPopup("failed to record upload command buffers");
+		return false;
+	}
 
-		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-	} else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	// Every copy of the batch in one transfer submit
+	VkSubmitInfo transferSubmit = {};
+	transferSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	transferSubmit.commandBufferCount = 1;
+	transferSubmit.pCommandBuffers = &renderData.uploadCommandBuffer;
+	if (acquire)
+	{
+		transferSubmit.signalSemaphoreCount = 1;
+		transferSubmit.pSignalSemaphores = &renderData.uploadSemaphore;
+	}
+	if (appData.disp.queueSubmit(renderData.transferQueue, 1, &transferSubmit, acquire ? VK_NULL_HANDLE : renderData.uploadFence) != VK_SUCCESS)
+	{
+		GameThread::SendErrorPopup("failed to submit uploads");
+		return false;
+	}
 
-		sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-	} else
+	if (acquire)
 	{
-		GameThread::SendErrorPopup("unsupported layout transition!");
+		const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		VkSubmitInfo acquireSubmit = {};
+		acquireSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		acquireSubmit.waitSemaphoreCount = 1;
+		acquireSubmit.pWaitSemaphores = &renderData.uploadSemaphore;
+		acquireSubmit.pWaitDstStageMask = &waitStage;
+		acquireSubmit.commandBufferCount = 1;
+		acquireSubmit.pCommandBuffers = &renderData.acquireCommandBuffer;
+		if (appData.disp.queueSubmit(renderData.graphicsQueue, 1, &acquireSubmit, renderData.uploadFence) != VK_SUCCESS)
+		{
+			GameThread::SendErrorPopup("failed to submit upload acquire barriers");
+			return false;
+		}
 	}
+	renderData.uploadsPending = true;
+	return true;
+}
 
-	appData.disp.cmdPipelineBarrier(
-		commandBuffer,
-		sourceStage, destinationStage,
-		0,
-		0, nullptr,
-		0, nullptr,
-		1, &barrier
-	);
+bool RenderThread::WaitUploads()
+{
+	PROFILE_ZONE("RenderThread::WaitUploads");
+	if (!renderData.uploadsPending)
+		return true;
 
-	EndSingleTimeCommands(commandBuffer, renderData.commandPool, renderData.graphicsQueue);
+	if (appData.disp.waitForFences(1, &renderData.uploadFence, VK_TRUE, UINT64_MAX) != VK_SUCCESS ||
+		appData.disp.resetFences(1, &renderData.uploadFence) != VK_SUCCESS)
+	{
+		GameThread::SendErrorPopup("failed to wait for the uploads");
+		return false;
+	}
 
+	appData.disp.freeCommandBuffers(renderData.transfertCommandPool, 1, &renderData.uploadCommandBuffer);
+	if (renderData.acquireCommandBuffer != VK_NULL_HANDLE)
+		appData.disp.freeCommandBuffers(renderData.commandPool, 1, &renderData.acquireCommandBuffer);
+	renderData.uploadCommandBuffer = VK_NULL_HANDLE;
+	renderData.acquireCommandBuffer = VK_NULL_HANDLE;
+	renderData.stagingHead = 0;
+	renderData.uploadsPending = false;
 	return true;
 }
 
-void RenderThread::CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
+bool RenderThread::CreateDepthResources()
 {
-	VkCommandBuffer commandBuffer = BeginSingleTimeCommands(renderData.transfertCommandPool);
+	VkFormat depthFormat = FindDepthFormat();
+	CreateImage(swapRes, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, renderData.depthImage, renderData.depthImageMemory);
+	renderData.depthImageView = CreateImageView(renderData.depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
 
-	VkBufferImageCopy region = {};
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;
-	region.bufferImageHeight = 0;
+	return true;
+}
 
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.mipLevel = 0;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = 1;
+bool RenderThread::CreateVertexBuffer(const Resource::Mesh &m)
+{
+	const auto &vertices = m.GetPackedVertices();
 
-	region.imageOffset = {0, 0, 0};
-	region.imageExtent = {
-		width,
-		height,
-		1
-	};
+	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
 
-	appData.disp.cmdCopyBufferToImage(
-		commandBuffer,
-		buffer,
-		image,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		1,
-		&region
-	);
+	if (!CreateBuffer(	bufferSize,
+						VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+						VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+						renderData.vertexBuffer,
+						renderData.vertexBufferMemory))
+		return false;
 
-	EndSingleTimeCommands(commandBuffer, renderData.transfertCommandPool, renderData.transferQueue);
+	return UploadBuffer(vertices.data(), bufferSize, renderData.vertexBuffer);
+}
+
+bool RenderThread::CreateIndexBuffer(const Resource::Mesh &m)
+{
+	const auto &indices = m.GetIndices();
+
+	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+
+	if (!CreateBuffer(	bufferSize,
+						VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+						VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+						renderData.indexBuffer,
+						renderData.indexBufferMemory))
+		return false;
+
+	LOG_DEBUG("Mesh: {} vertices of {} bytes, {} indices in {} sub meshes", m.GetPackedVertices().size(), sizeof(Resource::PackedVertex), indices.size(), m.GetSubMeshes().size());
+	return UploadBuffer(indices.data(), bufferSize, renderData.indexBuffer);
 }
 
 bool RenderThread::CreateCommandBuffers()
 {
+	PROFILE_ZONE("RenderThread::CreateCommandBuffers");
 	renderData.commandBuffers.resize(renderData.framebuffers.size());
 
 	VkCommandBufferAllocateInfo allocInfo = {};
@@ -1191,17 +1646,17 @@ bool RenderThread::CreateCommandBuffers()
 		return false;
 	}
 
-	VkCommandBufferAllocateInfo allocInfoTr = {};
-	allocInfoTr.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfoTr.commandPool = renderData.commandPool;
-	allocInfoTr.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfoTr.commandBufferCount = 1;
+	// bin0, bin2 and sim1 run one invocation per object, the neighbour pass depends on its shader
+	const Simulation::SimulationSizes &simSizes = appData.gm->GetSimulationSizes();
+	u32 neighbourGroupsX, neighbourGroupsY, objectGroupsX, objectGroupsY;
+	Simulation::SimulationSizes::GetDispatchSize(simSizes.GetNeighbourInvocationCount(), neighbourGroupsX, neighbourGroupsY);
+	Simulation::SimulationSizes::GetDispatchSize(simSizes.objectCount, objectGroupsX, objectGroupsY);
 
-	if (appData.disp.allocateCommandBuffers(&allocInfoTr, &renderData.transferCommandBuffer) != VK_SUCCESS)
-	{
-		GameThread::SendErrorPopup("failed to allocate transfer command buffer");
+	renderData.reorderCommandBuffer = VK_NULL_HANDLE;
+	if (simSizes.reorderInterval != 0 && !RecordReorderCommandBuffer(objectGroupsX, objectGroupsY))
+		return false;
+	if (!CreateQueryPools())
 		return false;
-	}
 
 	for (u32 i = 0; i < renderData.commandBuffers.size(); i++)
 	{
@@ -1219,9 +1674,10 @@ bool RenderThread::CreateCommandBuffers()
 		renderPassInfo.renderPass = renderData.renderPass;
 		renderPassInfo.framebuffer = renderData.framebuffers[i];
 		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = appData.swapchain.extent;
+		renderPassInfo.renderArea.extent = renderData.extent;
+		// The window lets the desktop show through, the offscreen frames are opaque
 		VkClearValue clearColors[2];
-		clearColors[0].color = {{0.0f, 0.0f, 0.0f, 0.0f}};
+		clearColors[0].color = {{0.0f, 0.0f, 0.0f, offscreen.frameCount != 0 ? 1.0f : 0.0f}};
 		clearColors[1].depthStencil = { 1.0f, 0 };
 		renderPassInfo.clearValueCount = 2;
 		renderPassInfo.pClearValues = clearColors;
@@ -1229,61 +1685,126 @@ bool RenderThread::CreateCommandBuffers()
 		VkViewport viewport = {};
 		viewport.x = 0.0f;
 		viewport.y = 0.0f;
-		viewport.width = (float)appData.swapchain.extent.width;
-		viewport.height = (float)appData.swapchain.extent.height;
+		viewport.width = (float)renderData.extent.width;
+		viewport.height = (float)renderData.extent.height;
 		viewport.minDepth = 0.0f;
 		viewport.maxDepth = 1.0f;
 
 		VkRect2D scissor = {};
 		scissor.offset = { 0, 0 };
-		scissor.extent = appData.swapchain.extent;
-
-		// Sort 0
-		appData.disp.cmdBindPipeline(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelines[0]);
-		appData.disp.cmdBindDescriptorSets(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelineLayout, 0, 1, &renderData.computeDescriptorSets[i], 0, 0);
+		scissor.extent = renderData.extent;
+
+		// The chunk counts are accumulated with atomics by bin0, and the visible instances by cull, they start from zero every frame.
+		// The previous frame still reads them in sim0 and in its draw, the clear has to wait for it. Through the second barrier,
+		// this also keeps the simulation from moving the objects while the previous frame draws them.
+		VkMemoryBarrier2KHR clearBarriers[2] = {};
+		clearBarriers[0].sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+		clearBarriers[0].srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR |
+			VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_COPY_BIT_KHR;
+		clearBarriers[0].srcAccessMask = VK_ACCESS_2_SHADER_READ_BIT_KHR;
+		clearBarriers[0].dstStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT_KHR;
+		clearBarriers[0].dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR;
+		clearBarriers[1].sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+		clearBarriers[1].srcStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT_KHR;
+		clearBarriers[1].srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR;
+		clearBarriers[1].dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR;
+		clearBarriers[1].dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT_KHR | VK_ACCESS_2_SHADER_WRITE_BIT_KHR;
+
+		VkDependencyInfoKHR clearDependencies[2] = {};
+		for (u32 j = 0; j < 2; j++)
+		{
+			clearDependencies[j].sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+			clearDependencies[j].memoryBarrierCount = 1;
+			clearDependencies[j].pMemoryBarriers = &clearBarriers[j];
+		}
 
-		appData.disp.cmdDispatch(renderData.commandBuffers[i], SORT_THREAD_COUNT, 1, 1);
+		ResetGpuQueries(renderData.commandBuffers[i], i);
+		appData.disp.cmdPipelineBarrier2KHR(renderData.commandBuffers[i], &clearDependencies[0]);
+		appData.disp.cmdFillBuffer(renderData.commandBuffers[i], renderData.computeBuffer, renderData.sizeObjects, simSizes.chunkCount * sizeof(u32), 0);
+		for (u32 lod = 0; lod < LOD_COUNT; lod++)
+			appData.disp.cmdFillBuffer(renderData.commandBuffers[i], renderData.cullBuffer, lod * CULL_COMMAND_STRIDE * sizeof(u32) + offsetof(VkDrawIndexedIndirectCommand, instanceCount), sizeof(u32), 0);
+		appData.disp.cmdPipelineBarrier2KHR(renderData.commandBuffers[i], &clearDependencies[1]);
 
 		VkMemoryBarrier2KHR memoryBarrier0 = {};
 		memoryBarrier0.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
 		memoryBarrier0.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
 		memoryBarrier0.srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT_KHR,
 		memoryBarrier0.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
-		memoryBarrier0.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT_KHR;
+		memoryBarrier0.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT_KHR | VK_ACCESS_2_SHADER_WRITE_BIT_KHR;
 
 		VkDependencyInfoKHR dependencyInfo0 = {};
 		dependencyInfo0.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
 		dependencyInfo0.memoryBarrierCount = 1;
 		dependencyInfo0.pMemoryBarriers = &memoryBarrier0;
 		//dependencyInfo0.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-		
+
+		// Bin 0, bin 1 and bin 2 share the descriptor set of sim 0
+		appData.disp.cmdBindDescriptorSets(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelineLayout, 0, 1, &renderData.computeDescriptorSets[i], 0, 0);
+
+		// Bin 0
+		appData.disp.cmdBindPipeline(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelines[0]);
+		BeginGpuPass(renderData.commandBuffers[i], i, GPU_PASS_BIN0);
+		appData.disp.cmdDispatch(renderData.commandBuffers[i], objectGroupsX, objectGroupsY, 1);
+		EndGpuPass(renderData.commandBuffers[i], i, GPU_PASS_BIN0);
 		appData.disp.cmdPipelineBarrier2KHR(renderData.commandBuffers[i], &dependencyInfo0);
 
-		// Sort 1
+		// Bin 1, a single group
 		appData.disp.cmdBindPipeline(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelines[1]);
-		appData.disp.cmdBindDescriptorSets(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelineLayout, 0, 1, &renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT], 0, 0);
-
-		appData.disp.cmdDispatch(renderData.commandBuffers[i], 1, 1, BLOCK_SIZE_Z);
+		BeginGpuPass(renderData.commandBuffers[i], i, GPU_PASS_BIN1);
+		appData.disp.cmdDispatch(renderData.commandBuffers[i], 1, 1, 1);
+		EndGpuPass(renderData.commandBuffers[i], i, GPU_PASS_BIN1);
 		appData.disp.cmdPipelineBarrier2KHR(renderData.commandBuffers[i], &dependencyInfo0);
 
-		// Sim 0
+		// Bin 2
 		appData.disp.cmdBindPipeline(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelines[2]);
-		appData.disp.cmdBindDescriptorSets(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelineLayout, 0, 1, &renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT * 2], 0, 0);
+		BeginGpuPass(renderData.commandBuffers[i], i, GPU_PASS_BIN2);
+		appData.disp.cmdDispatch(renderData.commandBuffers[i], objectGroupsX, objectGroupsY, 1);
+		EndGpuPass(renderData.commandBuffers[i], i, GPU_PASS_BIN2);
+		appData.disp.cmdPipelineBarrier2KHR(renderData.commandBuffers[i], &dependencyInfo0);
 
-		appData.disp.cmdDispatch(renderData.commandBuffers[i], 1, 1, BLOCK_SIZE_Z);
+		// Sim 0
+		appData.disp.cmdBindPipeline(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelines[3]);
+		BeginGpuPass(renderData.commandBuffers[i], i, GPU_PASS_SIM0);
+		appData.disp.cmdDispatch(renderData.commandBuffers[i], neighbourGroupsX, neighbourGroupsY, 1);
+		EndGpuPass(renderData.commandBuffers[i], i, GPU_PASS_SIM0);
 		appData.disp.cmdPipelineBarrier2KHR(renderData.commandBuffers[i], &dependencyInfo0);
 
 		// Sim 1
-		appData.disp.cmdBindPipeline(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelines[3]);
-		appData.disp.cmdBindDescriptorSets(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelineLayout, 0, 1, &renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT * 3], 0, 0);
+		appData.disp.cmdBindPipeline(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelines[4]);
+		appData.disp.cmdBindDescriptorSets(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelineLayout, 0, 1, &renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT], 0, 0);
 
-		appData.disp.cmdDispatch(renderData.commandBuffers[i], 1, 1, BLOCK_SIZE_Z);
+		BeginGpuPass(renderData.commandBuffers[i], i, GPU_PASS_SIM1);
+		appData.disp.cmdDispatch(renderData.commandBuffers[i], objectGroupsX, objectGroupsY, 1);
+		EndGpuPass(renderData.commandBuffers[i], i, GPU_PASS_SIM1);
+		appData.disp.cmdPipelineBarrier2KHR(renderData.commandBuffers[i], &dependencyInfo0);
+
+		// Cull, compacts the objects in the frustum into the instances of the indirect draw of their LOD
+		appData.disp.cmdBindPipeline(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelines[6]);
+		appData.disp.cmdBindDescriptorSets(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelineLayout, 0, 1, &renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT * 2], 0, 0);
+		BeginGpuPass(renderData.commandBuffers[i], i, GPU_PASS_CULL);
+		appData.disp.cmdDispatch(renderData.commandBuffers[i], objectGroupsX, objectGroupsY, 1);
+		EndGpuPass(renderData.commandBuffers[i], i, GPU_PASS_CULL);
+
+		// The objects and the culling output are read by the draw, and by the culling validation copy
+		VkMemoryBarrier2KHR drawBarrier = {};
+		drawBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+		drawBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR;
+		drawBarrier.srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT_KHR;
+		drawBarrier.dstStageMask = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_COPY_BIT_KHR;
+		drawBarrier.dstAccessMask = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT_KHR | VK_ACCESS_2_SHADER_READ_BIT_KHR | VK_ACCESS_2_TRANSFER_READ_BIT_KHR;
+
+		VkDependencyInfoKHR drawDependency = {};
+		drawDependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+		drawDependency.memoryBarrierCount = 1;
+		drawDependency.pMemoryBarriers = &drawBarrier;
+		appData.disp.cmdPipelineBarrier2KHR(renderData.commandBuffers[i], &drawDependency);
 
 
 		// Render
 		appData.disp.cmdSetViewport(renderData.commandBuffers[i], 0, 1, &viewport);
 		appData.disp.cmdSetScissor(renderData.commandBuffers[i], 0, 1, &scissor);
 
+		BeginGpuPass(renderData.commandBuffers[i], i, GPU_PASS_RENDER);
 		appData.disp.cmdBeginRenderPass(renderData.commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 		appData.disp.cmdBindPipeline(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, renderData.graphicsPipeline);
@@ -1291,12 +1812,65 @@ bool RenderThread::CreateCommandBuffers()
 		VkBuffer vertexBuffers[] = { renderData.vertexBuffer };
 		VkDeviceSize offsets[] = { 0 };
 		appData.disp.cmdBindVertexBuffers(renderData.commandBuffers[i], 0, 1, vertexBuffers, offsets);
+		appData.disp.cmdBindIndexBuffer(renderData.commandBuffers[i], renderData.indexBuffer, 0, VK_INDEX_TYPE_UINT16);
 
-		appData.disp.cmdBindDescriptorSets(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, renderData.pipelineLayout, 0, 1, &renderData.descriptorSets[i], 0, nullptr);
-
-		appData.disp.cmdDraw(renderData.commandBuffers[i], (u32)(sceneData.mesh.GetVertices().size()), OBJECT_COUNT, 0, 0);
+		// One draw per LOD, each with its own list of visible objects
+		for (u32 lod = 0; lod < LOD_COUNT; lod++)
+		{
+			const u32 listOffset = lod * simSizes.cullListCount * sizeof(u32);
+			appData.disp.cmdBindDescriptorSets(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, renderData.pipelineLayout, 0, 1, &renderData.descriptorSets[i], 1, &listOffset);
+			appData.disp.cmdDrawIndexedIndirect(renderData.commandBuffers[i], renderData.cullBuffer, lod * CULL_COMMAND_STRIDE * sizeof(u32), 1, sizeof(VkDrawIndexedIndirectCommand));
+		}
 
 		appData.disp.cmdEndRenderPass(renderData.commandBuffers[i]);
+		EndGpuPass(renderData.commandBuffers[i], i, GPU_PASS_RENDER);
+
+		if (!renderData.cullReadbackBuffers.empty())
+		{
+			VkBufferCopy cullRegion = {};
+			cullRegion.size = renderData.sizeCullBuf;
+			appData.disp.cmdCopyBuffer(renderData.commandBuffers[i], renderData.cullBuffer, renderData.cullReadbackBuffers[i], 1, &cullRegion);
+			VkBufferCopy objectsRegion = {};
+			objectsRegion.dstOffset = renderData.sizeCullBuf;
+			objectsRegion.size = renderData.sizeObjects;
+			appData.disp.cmdCopyBuffer(renderData.commandBuffers[i], renderData.computeBuffer, renderData.cullReadbackBuffers[i], 1, &objectsRegion);
+
+			VkMemoryBarrier2KHR cullReadbackBarrier = {};
+			cullReadbackBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+			cullReadbackBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT_KHR;
+			cullReadbackBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR;
+			cullReadbackBarrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT_KHR;
+			cullReadbackBarrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT_KHR;
+
+			VkDependencyInfoKHR cullReadbackDependency = {};
+			cullReadbackDependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+			cullReadbackDependency.memoryBarrierCount = 1;
+			cullReadbackDependency.pMemoryBarriers = &cullReadbackBarrier;
+			appData.disp.cmdPipelineBarrier2KHR(renderData.commandBuffers[i], &cullReadbackDependency);
+		}
+
+		// The render pass leaves offscreen images in the transfer layout, its last dependency covers the copy
+		if (!renderData.readbackBuffers.empty())
+		{
+			VkBufferImageCopy region = {};
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.layerCount = 1;
+			region.imageExtent = { renderData.extent.width, renderData.extent.height, 1 };
+			appData.disp.cmdCopyImageToBuffer(renderData.commandBuffers[i], renderData.swapchainImages[i], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, renderData.readbackBuffers[i], 1, &region);
+
+			VkMemoryBarrier2KHR readbackBarrier = {};
+			readbackBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+			readbackBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT_KHR;
+			readbackBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR;
+			readbackBarrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT_KHR;
+			readbackBarrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT_KHR;
+
+			VkDependencyInfoKHR readbackDependency = {};
+			readbackDependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+			readbackDependency.memoryBarrierCount = 1;
+			readbackDependency.pMemoryBarriers = &readbackBarrier;
+			appData.disp.cmdPipelineBarrier2KHR(renderData.commandBuffers[i], &readbackDependency);
+		}
 
 		if (appData.disp.endCommandBuffer(renderData.commandBuffers[i]) != VK_SUCCESS)
 		{
@@ -1307,18 +1881,292 @@ bool RenderThread::CreateCommandBuffers()
 	return true;
 }
 
-bool RenderThread::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+bool RenderThread::RecordReorderCommandBuffer(u32 objectGroupsX, u32 objectGroupsY)
+{
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = renderData.commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
+
+	if (appData.disp.allocateCommandBuffers(&allocInfo, &renderData.reorderCommandBuffer) != VK_SUCCESS)
+	{
+		GameThread::SendErrorPopup("failed to allocate reorder command buffer");
+		return false;
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	if (appData.disp.beginCommandBuffer(renderData.reorderCommandBuffer, &beginInfo) != VK_SUCCESS)
+	{
+		GameThread::SendErrorPopup("failed to begin recording reorder command buffer");
+		return false;
+	}
+
+	// The previous frame still draws the objects, and copies them with --validate-culling. Its binning output is what the reorder reads.
+	VkMemoryBarrier2KHR barriers[3] = {};
+	barriers[0].sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+	barriers[0].srcStageMask = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_COPY_BIT_KHR;
+	barriers[0].srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT_KHR;
+	barriers[0].dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR;
+	barriers[0].dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT_KHR | VK_ACCESS_2_SHADER_WRITE_BIT_KHR;
+	barriers[1].sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+	barriers[1].srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR;
+	barriers[1].srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT_KHR;
+	barriers[1].dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT_KHR;
+	barriers[1].dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT_KHR | VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR;
+	barriers[2].sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+	barriers[2].srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT_KHR;
+	barriers[2].srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR;
+	barriers[2].dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR;
+	barriers[2].dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT_KHR | VK_ACCESS_2_SHADER_WRITE_BIT_KHR;
+
+	VkDependencyInfoKHR dependencies[3] = {};
+	for (u32 j = 0; j < 3; j++)
+	{
+		dependencies[j].sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+		dependencies[j].memoryBarrierCount = 1;
+		dependencies[j].pMemoryBarriers = &barriers[j];
+	}
+
+	appData.disp.cmdPipelineBarrier2KHR(renderData.reorderCommandBuffer, &dependencies[0]);
+	appData.disp.cmdBindDescriptorSets(renderData.reorderCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelineLayout, 0, 1, &renderData.computeDescriptorSets[0], 0, 0);
+	appData.disp.cmdBindPipeline(renderData.reorderCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelines[5]);
+	appData.disp.cmdDispatch(renderData.reorderCommandBuffer, objectGroupsX, objectGroupsY, 1);
+	appData.disp.cmdPipelineBarrier2KHR(renderData.reorderCommandBuffer, &dependencies[1]);
+
+	VkBufferCopy copyRegion = {};
+	copyRegion.srcOffset = renderData.sizeObjects + renderData.sizeBinBuf;
+	copyRegion.dstOffset = 0;
+	copyRegion.size = renderData.sizeObjects;
+	appData.disp.cmdCopyBuffer(renderData.reorderCommandBuffer, renderData.computeBuffer, renderData.computeBuffer, 1, &copyRegion);
+	appData.disp.cmdPipelineBarrier2KHR(renderData.reorderCommandBuffer, &dependencies[2]);
+
+	if (appData.disp.endCommandBuffer(renderData.reorderCommandBuffer) != VK_SUCCESS)
+	{
+		GameThread::SendErrorPopup("failed to record reorder command buffer");
+		return false;
+	}
+	return true;
+}
+
+bool RenderThread::CreateQueryPools()
+{
+	DestroyQueryPools();
+	if (!gpuProfile)
+		return true;
+	if (appData.timestampMask == 0)
+	{
+		LOG_WARNING("The graphics queue does not support timestamps, GPU profiling is disabled");
+		gpuProfile = false;
+		return true;
+	}
+
+	const u32 count = (u32)(renderData.commandBuffers.size());
+	renderData.timestampPools.resize(count, VK_NULL_HANDLE);
+	renderData.statisticsPools.resize(appData.pipelineStatistics ? count : 0, VK_NULL_HANDLE);
+	renderData.queriesPending.assign(count, 0);
+
+	// A timestamp before and after each pass
+	VkQueryPoolCreateInfo timestampInfo = {};
+	timestampInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	timestampInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	timestampInfo.queryCount = GPU_PASS_COUNT * 2;
+
+	VkQueryPoolCreateInfo statisticsInfo = {};
+	statisticsInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	statisticsInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+	statisticsInfo.queryCount = GPU_PASS_COUNT;
+	statisticsInfo.pipelineStatistics = GPU_STATISTICS_FLAGS;
+
+	for (u32 i = 0; i < count; i++)
+	{
+		if (appData.disp.createQueryPool(&timestampInfo, nullptr, &renderData.timestampPools[i]) != VK_SUCCESS ||
+			(appData.pipelineStatistics && appData.disp.createQueryPool(&statisticsInfo, nullptr, &renderData.statisticsPools[i]) != VK_SUCCESS))
+		{
+			GameThread::SendErrorPopup("failed to create query pool");
+			return false;
+		}
+	}
+	return true;
+}
+
+void RenderThread::DestroyQueryPools()
+{
+	for (u32 i = 0; i < renderData.timestampPools.size(); i++)
+		appData.disp.destroyQueryPool(renderData.timestampPools[i], nullptr);
+	for (u32 i = 0; i < renderData.statisticsPools.size(); i++)
+		appData.disp.destroyQueryPool(renderData.statisticsPools[i], nullptr);
+	renderData.timestampPools.clear();
+	renderData.statisticsPools.clear();
+	renderData.queriesPending.clear();
+}
+
+void RenderThread::ResetGpuQueries(VkCommandBuffer commandBuffer, u32 image)
+{
+	if (renderData.timestampPools.empty())
+		return;
+	appData.disp.cmdResetQueryPool(commandBuffer, renderData.timestampPools[image], 0, GPU_PASS_COUNT * 2);
+	if (!renderData.statisticsPools.empty())
+		appData.disp.cmdResetQueryPool(commandBuffer, renderData.statisticsPools[image], 0, GPU_PASS_COUNT);
+}
+
+void RenderThread::BeginGpuPass(VkCommandBuffer commandBuffer, u32 image, GpuPass pass)
+{
+	if (renderData.timestampPools.empty())
+		return;
+	// Written once the previous commands and barriers are done, a top of pipe timestamp could be written before them
+	appData.disp.cmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, renderData.timestampPools[image], pass * 2);
+	if (!renderData.statisticsPools.empty())
+		appData.disp.cmdBeginQuery(commandBuffer, renderData.statisticsPools[image], pass, 0);
+}
+
+void RenderThread::EndGpuPass(VkCommandBuffer commandBuffer, u32 image, GpuPass pass)
+{
+	if (renderData.timestampPools.empty())
+		return;
+	if (!renderData.statisticsPools.empty())
+		appData.disp.cmdEndQuery(commandBuffer, renderData.statisticsPools[image], pass);
+	appData.disp.cmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, renderData.timestampPools[image], pass * 2 + 1);
+}
+
+void RenderThread::ReadGpuQueries(u32 image)
+{
+	if (renderData.queriesPending.empty() || !renderData.queriesPending[image])
+		return;
+	renderData.queriesPending[image] = 0;
+
+	// Only called once the fence of the last submission of this command buffer is signaled, so the results are
+	// read without VK_QUERY_RESULT_WAIT_BIT. If they are not available anyway, the frame is left out.
+	u64 timestamps[GPU_PASS_COUNT * 2];
+	if (appData.disp.getQueryPoolResults(renderData.timestampPools[image], 0, GPU_PASS_COUNT * 2, sizeof(timestamps), timestamps, sizeof(u64), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+		return;
+	const f64 tickToMs = appData.timestampPeriod / 1000000.0;
+	for (u32 i = 0; i < GPU_PASS_COUNT; i++)
+		gpuPassTimes[i].Add(((timestamps[i * 2 + 1] - timestamps[i * 2]) & appData.timestampMask) * tickToMs);
+	gpuFrameTimes.Add(((timestamps[GPU_PASS_COUNT * 2 - 1] - timestamps[0]) & appData.timestampMask) * tickToMs);
+
+	if (!renderData.statisticsPools.empty())
+		appData.disp.getQueryPoolResults(renderData.statisticsPools[image], 0, GPU_PASS_COUNT, sizeof(gpuPassStatistics), gpuPassStatistics, sizeof(gpuPassStatistics[0]), VK_QUERY_RESULT_64_BIT);
+}
+
+void RenderThread::LogGpuProfile()
+{
+	if (gpuFrameTimes.GetCount() == 0)
+		return;
+
+	LOG_INFO("GPU ms over {} frames: avg / p50 / p95 / p99", gpuFrameTimes.GetCount());
+	for (u32 i = 0; i <= GPU_PASS_COUNT; i++)
+	{
+		const Core::RollingStats &stats = i < GPU_PASS_COUNT ? gpuPassTimes[i] : gpuFrameTimes;
+		const char *name = i < GPU_PASS_COUNT ? gpuPassNames[i] : "frame";
+		const f64 average = stats.GetAverage();
+		const f64 p50 = stats.GetPercentile(0.5);
+		const f64 p95 = stats.GetPercentile(0.95);
+		const f64 p99 = stats.GetPercentile(0.99);
+		const u64 *counts = i < GPU_PASS_COUNT ? gpuPassStatistics[i] : nullptr;
+		if (!counts || renderData.statisticsPools.empty())
+			LOG_INFO("- {:-6} {:7.3f} / {:7.3f} / {:7.3f} / {:7.3f}", name, average, p50, p95, p99);
+		else if (i == GPU_PASS_RENDER)
+			LOG_INFO("- {:-6} {:7.3f} / {:7.3f} / {:7.3f} / {:7.3f}, {} vertex, {} primitives, {} fragment invocations",
+				name, average, p50, p95, p99, counts[0], counts[1], counts[2]);
+		else
+			LOG_INFO("- {:-6} {:7.3f} / {:7.3f} / {:7.3f} / {:7.3f}, {} invocations", name, average, p50, p95, p99, counts[3]);
+	}
+}
+
+void RenderThread::ValidateCulling(u32 image)
+{
+	if (renderData.cullReadbackPending.empty() || !renderData.cullReadbackPending[image])
+		return;
+	renderData.cullReadbackPending[image] = 0;
+	PROFILE_ZONE("RenderThread::ValidateCulling");
+
+	// The uniforms of the image are still those of the validated frame, they are updated right after
+	const FrameUniforms *uniforms = reinterpret_cast<const FrameUniforms*>(renderData.objectBuffersMapped[image]);
+	Frustum frustum;
+	frustum.left = uniforms->frustumPlanes[0];
+	frustum.right = uniforms->frustumPlanes[1];
+	frustum.bottom = uniforms->frustumPlanes[2];
+	frustum.top = uniforms->frustumPlanes[3];
+	frustum.front = uniforms->frustumPlanes[4];
+	frustum.back = uniforms->frustumPlanes[5];
+
+	const Simulation::SimulationSizes &sizes = appData.gm->GetSimulationSizes();
+	const u32 objectCount = sizes.objectCount;
+	const u8 *readback = renderData.cullReadbackBuffersMemory[image].mapped;
+	const u32 *state = reinterpret_cast<const u32*>(readback + renderData.sizeCullBuf);
+
+	// Flags the objects the GPU drew at any LOD, the CPU test of each object is compared to its flag
+	cpuVisibleObjects.assign(objectCount, 0);
+	u32 gpuVisible = 0;
+	for (u32 lod = 0; lod < LOD_COUNT; lod++)
+	{
+		const u32 *header = reinterpret_cast<const u32*>(readback) + lod * CULL_COMMAND_STRIDE;
+		const u32 instanceCount = header[offsetof(VkDrawIndexedIndirectCommand, instanceCount) / sizeof(u32)];
+		const u32 *visible = reinterpret_cast<const u32*>(readback) + CULL_HEADER_COUNT + lod * sizes.cullListCount;
+		const u32 gpuCount = instanceCount < objectCount ? instanceCount : objectCount;
+		for (u32 i = 0; i < gpuCount; i++)
+		{
+			if (visible[i] < objectCount)
+				cpuVisibleObjects[visible[i]] = 1;
+		}
+		gpuVisible += instanceCount;
+		if (lod == LOD_IMPOSTOR)
+			cullingValidation.impostors += instanceCount;
+	}
+	const AABB box = AABB(Vec3(), Vec3(OBJECT_HALF_EXTENT));
+	u32 cpuCount = 0;
+	u32 mismatches = 0;
+	for (u32 i = 0; i < objectCount; i++)
+	{
+		const Vec4 rotation = sizes.GetPackedRotation(state, i);
+		const Mat4 transform = Mat4::CreateTransformMatrix(sizes.GetPackedPosition(state, i).GetVector(), Quat(rotation.GetVector(), rotation.w));
+		const bool isVisible = box.IsOnFrustum(frustum, transform);
+		cpuCount += isVisible;
+		mismatches += isVisible != (cpuVisibleObjects[i] != 0);
+	}
+
+	cullingValidation.frames++;
+	cullingValidation.gpuVisible += gpuVisible;
+	cullingValidation.cpuVisible += cpuCount;
+	cullingValidation.mismatches += mismatches;
+}
+
+void RenderThread::LogCullingValidation()
+{
+	if (cullingValidation.frames == 0)
+		return;
+
+	const u32 objectCount = appData.gm->GetSimulationSizes().objectCount;
+	const f64 frames = cullingValidation.frames;
+	if (cullingValidation.mismatches == 0 && cullingValidation.gpuVisible == cullingValidation.cpuVisible)
+		LOG_INFO("Culling: {:.1f} of {} objects visible over {} frames ({:.1f} impostors), the CPU agrees",
+			cullingValidation.gpuVisible / frames, objectCount, cullingValidation.frames, cullingValidation.impostors / frames);
+	else
+		LOG_WARNING("Culling: {:.1f} of {} objects visible over {} frames ({:.1f} impostors), {:.1f} for the CPU, {:.1f} objects differ per frame",
+			cullingValidation.gpuVisible / frames, objectCount, cullingValidation.frames, cullingValidation.impostors / frames,
+			cullingValidation.cpuVisible / frames, cullingValidation.mismatches / frames);
+	cullingValidation = CullingValidation();
+}
+
+bool RenderThread::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Render::GpuAllocation& bufferMemory,
+	Render::AllocationStrategy strategy)
 {
 	VkBufferCreateInfo bufferInfo = {};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	bufferInfo.size = size;
 	bufferInfo.usage = usage;
-	bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
-	bufferInfo.queueFamilyIndexCount = 2;
-	auto transfer = appData.device.get_queue_index(vkb::QueueType::transfer);
-	auto graph = appData.device.get_queue_index(vkb::QueueType::graphics);
-	u32 queueFamilies[2] = {appData.device.get_queue_index(vkb::QueueType::graphics).value(), transfer.has_value() ? transfer.value() : graph.has_value()};
-	bufferInfo.pQueueFamilyIndices = queueFamilies;
+	// Shared by the transfer and graphics families, the uploads need no ownership transfer for the buffers
+	u32 queueFamilies[2] = { renderData.graphicsQueueFamily, renderData.transferQueueFamily };
+	if (queueFamilies[0] != queueFamilies[1])
+	{
+		bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		bufferInfo.queueFamilyIndexCount = 2;
+		bufferInfo.pQueueFamilyIndices = queueFamilies;
+	}
+	else
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
 	if (appData.disp.createBuffer(&bufferInfo, nullptr, &buffer) != VK_SUCCESS)
 	{
@@ -1326,30 +2174,25 @@ bool RenderThread::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkM
 		return false;
 	}
 
-	VkMemoryRequirements memRequirements;
-	appData.disp.getBufferMemoryRequirements(buffer, &memRequirements);
-
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
-
-	if (appData.disp.allocateMemory(&allocInfo, nullptr, &bufferMemory) != VK_SUCCESS)
+	if (!gpuAllocator.AllocateBuffer(buffer, properties, strategy, bufferMemory))
 	{
 		GameThread::SendErrorPopup("failed to allocate buffer memory!");
+		appData.disp.destroyBuffer(buffer, nullptr);
+		buffer = VK_NULL_HANDLE;
 		return false;
 	}
-
-	appData.disp.bindBufferMemory(buffer, bufferMemory, 0);
 	return true;
 }
 
 bool RenderThread::CreateSyncObjects()
 {
-	renderData.availableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	renderData.finishedSemaphore.resize(appData.swapchain.image_count);
+	// Offscreen frames are neither acquired nor presented, their fence is enough
+	const u32 imageSemaphoreCount = offscreen.frameCount != 0 ? 0 : appData.swapchain.image_count;
+	const u32 frameSemaphoreCount = offscreen.frameCount != 0 ? 0 : MAX_FRAMES_IN_FLIGHT;
+	renderData.availableSemaphores.resize(frameSemaphoreCount);
+	renderData.finishedSemaphore.resize(imageSemaphoreCount);
 	renderData.inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-	renderData.imageInFlight.resize(appData.swapchain.image_count, VK_NULL_HANDLE);
+	renderData.imageInFlight.resize(imageSemaphoreCount, VK_NULL_HANDLE);
 
 	VkSemaphoreCreateInfo semaphoreInfo = {};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -1358,7 +2201,7 @@ bool RenderThread::CreateSyncObjects()
 	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-	for (u32 i = 0; i < appData.swapchain.image_count; i++)
+	for (u32 i = 0; i < imageSemaphoreCount; i++)
 	{
 		if (appData.disp.createSemaphore(&semaphoreInfo, nullptr, &renderData.finishedSemaphore[i]) != VK_SUCCESS)
 		{
@@ -1369,7 +2212,7 @@ bool RenderThread::CreateSyncObjects()
 
 	for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		if (appData.disp.createSemaphore(&semaphoreInfo, nullptr, &renderData.availableSemaphores[i]) != VK_SUCCESS ||
+		if ((i < frameSemaphoreCount && appData.disp.createSemaphore(&semaphoreInfo, nullptr, &renderData.availableSemaphores[i]) != VK_SUCCESS) ||
 			appData.disp.createFence(&fenceInfo, nullptr, &renderData.inFlightFences[i]) != VK_SUCCESS)
 		{
 			GameThread::SendErrorPopup("failed to create sync objects");
@@ -1390,11 +2233,14 @@ bool RenderThread::CreateDescriptorPool()
 	VkDescriptorPoolSize poolSize2 = {};
 	poolSize2.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	poolSize2.descriptorCount = 256;
+	VkDescriptorPoolSize poolSize3 = {};
+	poolSize3.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	poolSize3.descriptorCount = 256;
 
-	VkDescriptorPoolSize pools[3] = {poolSize0, poolSize1, poolSize2};
+	VkDescriptorPoolSize pools[4] = {poolSize0, poolSize1, poolSize2, poolSize3};
 	VkDescriptorPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	poolInfo.poolSizeCount = 3;
+	poolInfo.poolSizeCount = 4;
 	poolInfo.pPoolSizes = pools;
 	poolInfo.maxSets = 256;
 
@@ -1425,11 +2271,12 @@ bool RenderThread::CreateDescriptorSets()
 	allocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
 	allocInfo.pSetLayouts = layouts.data();
 
-	std::vector<VkDescriptorSetLayout> layoutsCompute(MAX_FRAMES_IN_FLIGHT * 4, renderData.descriptorSetLayoutCompute);
+	// sim0, sim1 and cull sets of each frame
+	std::vector<VkDescriptorSetLayout> layoutsCompute(MAX_FRAMES_IN_FLIGHT * 3, renderData.descriptorSetLayoutCompute);
 	VkDescriptorSetAllocateInfo allocInfoCompute = {};
 	allocInfoCompute.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfoCompute.descriptorPool = renderData.descriptorPoolCompute;
-	allocInfoCompute.descriptorSetCount = MAX_FRAMES_IN_FLIGHT * 4;
+	allocInfoCompute.descriptorSetCount = MAX_FRAMES_IN_FLIGHT * 3;
 	allocInfoCompute.pSetLayouts = layoutsCompute.data();
 
 	renderData.descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
@@ -1439,39 +2286,74 @@ bool RenderThread::CreateDescriptorSets()
 		return false;
 	}
 
-	renderData.computeDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT*4);
+	renderData.computeDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT*3);
 	if (appData.disp.allocateDescriptorSets(&allocInfoCompute, renderData.computeDescriptorSets.data()) != VK_SUCCESS)
 	{
 		GameThread::SendErrorPopup("failed to allocate descriptor sets");
 		return false;
 	}
 
+	const Simulation::SimulationSizes &simSizes = appData.gm->GetSimulationSizes();
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
 		VkDescriptorBufferInfo bufferInfoUBO = {};
 		bufferInfoUBO.buffer = renderData.objectBuffers[i];
 		bufferInfoUBO.offset = 0;
-		bufferInfoUBO.range = sizeof(Mat4);
+		bufferInfoUBO.range = sizeof(FrameUniforms);
 
 		VkDescriptorBufferInfo bufferInfoLast = {};
 		bufferInfoLast.buffer = renderData.computeBuffer;
 		bufferInfoLast.offset = 0;
 		bufferInfoLast.range = renderData.sizeObjects;
 
-		VkDescriptorBufferInfo bufferInfoObjects = {};
-		bufferInfoObjects.buffer = renderData.computeBuffer;
-		bufferInfoObjects.offset = 0;
-		bufferInfoObjects.range = renderData.sizeObjects;
-
-		VkDescriptorBufferInfo bufferInfoMerge = {};
-		bufferInfoMerge.buffer = renderData.computeBuffer;
-		bufferInfoMerge.offset = renderData.sizeObjects;
-		bufferInfoMerge.range = renderData.sizeMergeBuf;
-
-		VkDescriptorBufferInfo bufferInfoSort = {};
-		bufferInfoSort.buffer = renderData.computeBuffer;
-		bufferInfoSort.offset = renderData.sizeObjects + renderData.sizeMergeBuf;
-		bufferInfoSort.range = renderData.sizeSortBuf;
+		// One binding per stream of the object state, the passes only declare the ones they read
+		VkDescriptorBufferInfo bufferInfoPositions = {};
+		bufferInfoPositions.buffer = renderData.computeBuffer;
+		bufferInfoPositions.offset = 0;
+		bufferInfoPositions.range = simSizes.stateVelocityOffset * sizeof(u32);
+
+		VkDescriptorBufferInfo bufferInfoVelocities = {};
+		bufferInfoVelocities.buffer = renderData.computeBuffer;
+		bufferInfoVelocities.offset = simSizes.stateVelocityOffset * sizeof(u32);
+		bufferInfoVelocities.range = (simSizes.stateAccelOffset - simSizes.stateVelocityOffset) * sizeof(u32);
+
+		VkDescriptorBufferInfo bufferInfoAccels = {};
+		bufferInfoAccels.buffer = renderData.computeBuffer;
+		bufferInfoAccels.offset = simSizes.stateAccelOffset * sizeof(u32);
+		bufferInfoAccels.range = (simSizes.stateRotationOffset - simSizes.stateAccelOffset) * sizeof(u32);
+
+		VkDescriptorBufferInfo bufferInfoRotations = {};
+		bufferInfoRotations.buffer = renderData.computeBuffer;
+		bufferInfoRotations.offset = simSizes.stateRotationOffset * sizeof(u32);
+		bufferInfoRotations.range = (simSizes.stateUintCount - simSizes.stateRotationOffset) * sizeof(u32);
+
+		VkDescriptorBufferInfo bufferInfoBins = {};
+		bufferInfoBins.buffer = renderData.computeBuffer;
+		bufferInfoBins.offset = renderData.sizeObjects;
+		bufferInfoBins.range = renderData.sizeBinBuf;
+
+		// Only read by the reorder pass, it points at the objects when reordering is disabled
+		VkDescriptorBufferInfo bufferInfoReorder = {};
+		bufferInfoReorder.buffer = renderData.computeBuffer;
+		bufferInfoReorder.offset = renderData.sizeReorderBuf ? renderData.sizeObjects + renderData.sizeBinBuf : 0;
+		bufferInfoReorder.range = renderData.sizeObjects;
+
+		VkDescriptorBufferInfo bufferInfoInstances = {};
+		bufferInfoInstances.buffer = renderData.computeBuffer;
+		bufferInfoInstances.offset = renderData.sizeObjects + renderData.sizeBinBuf + renderData.sizeReorderBuf;
+		bufferInfoInstances.range = renderData.sizeInstances;
+
+		VkDescriptorBufferInfo bufferInfoCull = {};
+		bufferInfoCull.buffer = renderData.cullBuffer;
+		bufferInfoCull.offset = 0;
+		bufferInfoCull.range = renderData.sizeCullBuf;
+
+		// The list of the first LOD, the draws of the others move it with a dynamic offset.
+		// The vertex shader indexes it with gl_InstanceIndex.
+		VkDescriptorBufferInfo bufferInfoVisible = {};
+		bufferInfoVisible.buffer = renderData.cullBuffer;
+		bufferInfoVisible.offset = CULL_HEADER_COUNT * sizeof(u32);
+		bufferInfoVisible.range = simSizes.cullListCount * sizeof(u32);
 
 		VkDescriptorImageInfo imageInfo = {};
 		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
@@ -1480,27 +2362,37 @@ bool RenderThread::CreateDescriptorSets()
 
 
 		VkWriteDescriptorSet descriptorWriteUBO = CreateWriteDescriptorSet(renderData.descriptorSets[i], 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &bufferInfoUBO);
-		VkWriteDescriptorSet descriptorWriteObjects = CreateWriteDescriptorSet(renderData.descriptorSets[i], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoObjects);
+		VkWriteDescriptorSet descriptorWriteInstances = CreateWriteDescriptorSet(renderData.descriptorSets[i], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoInstances);
 		VkWriteDescriptorSet descriptorWriteImage = CreateWriteDescriptorSet(renderData.descriptorSets[i], 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, nullptr, &imageInfo);
-
-		VkWriteDescriptorSet descriptorWriteSort0A = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i], 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoObjects);
-		VkWriteDescriptorSet descriptorWriteSort0B = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoSort);
-
-		VkWriteDescriptorSet descriptorWriteSort1A = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT], 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoSort);
-		VkWriteDescriptorSet descriptorWriteSort1B = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoMerge);
-
-		VkWriteDescriptorSet descriptorWriteSim0A = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT * 2], 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoObjects);
-		VkWriteDescriptorSet descriptorWriteSim0B = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT * 2], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoMerge);
-
-		VkWriteDescriptorSet descriptorWriteSim1A = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT * 3], 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoObjects);
-		VkWriteDescriptorSet descriptorWriteSim1B = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT * 3], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoLast);
-
-		VkWriteDescriptorSet descriptorArray[11] = {descriptorWriteUBO, descriptorWriteObjects, descriptorWriteImage,
-													descriptorWriteSort0A, descriptorWriteSort0B,
-													descriptorWriteSort1A, descriptorWriteSort1B,
-													descriptorWriteSim0A, descriptorWriteSim0B,
-													descriptorWriteSim1A, descriptorWriteSim1B};
-		appData.disp.updateDescriptorSets(11, descriptorArray, 0, nullptr);
+		VkWriteDescriptorSet descriptorWriteVisible = CreateWriteDescriptorSet(renderData.descriptorSets[i], 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, &bufferInfoVisible);
+
+		// Shared by the three binning passes, sim0 and the reorder pass
+		VkWriteDescriptorSet descriptorWriteSim0A = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i], 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoPositions);
+		VkWriteDescriptorSet descriptorWriteSim0B = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoBins);
+		VkWriteDescriptorSet descriptorWriteSim0C = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i], 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoReorder);
+
+		VkWriteDescriptorSet descriptorWriteSim1A = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT], 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoPositions);
+		VkWriteDescriptorSet descriptorWriteSim1B = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoLast);
+		VkWriteDescriptorSet descriptorWriteSim1C = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT], 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoInstances);
+
+		// The frame uniforms hold the frustum planes of the cull pass
+		VkWriteDescriptorSet descriptorWriteCullA = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT * 2], 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoPositions);
+		VkWriteDescriptorSet descriptorWriteCullB = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT * 2], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoCull);
+		VkWriteDescriptorSet descriptorWriteCullC = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT * 2], 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoUBO);
+
+		VkWriteDescriptorSet descriptorArray[22] = {descriptorWriteUBO, descriptorWriteInstances, descriptorWriteImage, descriptorWriteVisible,
+													descriptorWriteSim0A, descriptorWriteSim0B, descriptorWriteSim0C,
+													descriptorWriteSim1A, descriptorWriteSim1B, descriptorWriteSim1C,
+													descriptorWriteCullA, descriptorWriteCullB, descriptorWriteCullC};
+		// The velocity, acceleration and rotation streams are the same in the three compute sets
+		for (u32 set = 0; set < 3; set++)
+		{
+			const VkDescriptorSet computeSet = renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT * set];
+			descriptorArray[13 + set * 3] = CreateWriteDescriptorSet(computeSet, 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoVelocities);
+			descriptorArray[14 + set * 3] = CreateWriteDescriptorSet(computeSet, 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoAccels);
+			descriptorArray[15 + set * 3] = CreateWriteDescriptorSet(computeSet, 5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoRotations);
+		}
+		appData.disp.updateDescriptorSets(22, descriptorArray, 0, nullptr);
 	}
 
 	return true;
@@ -1518,7 +2410,7 @@ bool RenderThread::RecreateSwapchain()
 	{
 		appData.disp.destroyImageView(renderData.depthImageView, nullptr);
 		appData.disp.destroyImage(renderData.depthImage, nullptr);
-		appData.disp.freeMemory(renderData.depthImageMemory, nullptr);
+		gpuAllocator.Free(renderData.depthImageMemory);
 
 		appData.disp.destroyCommandPool(renderData.commandPool, nullptr);
 		appData.disp.destroyCommandPool(renderData.transfertCommandPool, nullptr);
@@ -1547,32 +2439,27 @@ bool RenderThread::RecreateSwapchain()
 
 bool RenderThread::UpdateUniformBuffer(u32 image)
 {
-	Vec4 *dataPtr = renderData.objectBuffersMapped[image];
+	PROFILE_ZONE("RenderThread::UpdateUniformBuffer");
+	FrameUniforms *uniforms = reinterpret_cast<FrameUniforms*>(renderData.objectBuffersMapped[image]);
 	const auto &mat = appData.gm->GetViewProjectionMatrix();
-	const Vec4 *matPtr = reinterpret_cast<const Vec4*>(mat.content);
-	for (u32 i = 0; i < 4; i++)
-	{
-		dataPtr[i] = matPtr[i];
-	}
-
+	uniforms->viewProjection = mat;
+	const Mat4 viewProjection = mat.TransposeMatrix();
+	const Frustum frustum = Frustum::FromViewProjection(viewProjection);
+	uniforms->frustumPlanes[0] = frustum.left;
+	uniforms->frustumPlanes[1] = frustum.right;
+	uniforms->frustumPlanes[2] = frustum.bottom;
+	uniforms->frustumPlanes[3] = frustum.top;
+	uniforms->frustumPlanes[4] = frustum.front;
+	uniforms->frustumPlanes[5] = frustum.back;
+	// The second row of the projection scales the view height to [-w, w], the viewport height covers it
+	const f32 projectionScale = Vec3(viewProjection.at(0, 1), viewProjection.at(1, 1), viewProjection.at(2, 1)).Length();
+	uniforms->lod = Vec4(projectionScale * renderData.extent.height / 2, 0, 0, 0);
+
+	if (!renderData.cullReadbackPending.empty())
+		renderData.cullReadbackPending[image] = 1;
 	return true;
 }
 
-u32 RenderThread::FindMemoryType(u32 typeFilter, VkMemoryPropertyFlags properties)
-{
-	VkPhysicalDeviceMemoryProperties memProperties;
-	appData.instDisp.getPhysicalDeviceMemoryProperties(appData.device.physical_device, &memProperties);
-	
-	for (u32 i = 0; i < memProperties.memoryTypeCount; i++)
-	{
-		if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
-			return i;
-	}
-
-	GameThread::SendErrorPopup("failed to find suitable memory type!");
-	return -1;
-}
-
 VkFormat RenderThread::FindSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
 {
 	for (VkFormat format : candidates)
@@ -1618,8 +2505,24 @@ bool RenderThread::HasStencilComponent(VkFormat format)
 	return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
 }
 
+void RenderThread::SetFrameCommandBuffers(VkSubmitInfo &submitInfo, VkCommandBuffer (&commandBuffers)[2], u32 imgIndex)
+{
+	// The reorder reads the binning of the previous frame, there is none before the first one
+	const u32 reorderInterval = appData.gm->GetSimulationSizes().reorderInterval;
+	commandBuffers[0] = renderData.reorderCommandBuffer;
+	commandBuffers[1] = renderData.commandBuffers[imgIndex];
+	const bool reorder = renderData.reorderCommandBuffer != VK_NULL_HANDLE && renderData.simulationFrame != 0 && renderData.simulationFrame % reorderInterval == 0;
+	submitInfo.commandBufferCount = reorder ? 2 : 1;
+	submitInfo.pCommandBuffers = reorder ? commandBuffers : commandBuffers + 1;
+	renderData.simulationFrame++;
+}
+
 bool RenderThread::DrawFrame()
 {
+	PROFILE_ZONE("RenderThread::DrawFrame");
+	if (offscreen.frameCount != 0)
+		return DrawOffscreenFrame();
+
 	if (resized)
 	{
 		HandleResize();
@@ -1653,8 +2556,11 @@ bool RenderThread::DrawFrame()
 		appData.disp.waitForFences(1, &renderData.imageInFlight[imgIndex], VK_TRUE, UINT64_MAX);
 	}
 	renderData.imageInFlight[imgIndex] = renderData.inFlightFences[renderData.currentFrame];
+	ReadGpuQueries(imgIndex);
+	ValidateCulling(imgIndex);
 
-	UpdateUniformBuffer(renderData.currentFrame);
+	// Read by the command buffer of the image, whose last submission is done
+	UpdateUniformBuffer(imgIndex);
 
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -1665,8 +2571,8 @@ bool RenderThread::DrawFrame()
 	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = waitStages;
 
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &renderData.commandBuffers[imgIndex];
+	VkCommandBuffer commandBuffers[2];
+	SetFrameCommandBuffers(submitInfo, commandBuffers, imgIndex);
 
 	VkSemaphore signalSemaphores[] = { renderData.finishedSemaphore[imgIndex] };
 	submitInfo.signalSemaphoreCount = 1;
@@ -1679,6 +2585,8 @@ bool RenderThread::DrawFrame()
 		GameThread::SendErrorPopup("failed to submit draw command buffer");
 		return false;
 	}
+	if (!renderData.queriesPending.empty())
+		renderData.queriesPending[imgIndex] = 1;
 
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1707,20 +2615,87 @@ bool RenderThread::DrawFrame()
 	return true;
 }
 
+bool RenderThread::DrawOffscreenFrame()
+{
+	// Frame slot i always renders into image i and its fence is the only wait.
+	// Once it is signaled, the frame rendered MAX_FRAMES_IN_FLIGHT frames ago can be saved.
+	const u32 slot = renderData.currentFrame;
+	appData.disp.waitForFences(1, &renderData.inFlightFences[slot], VK_TRUE, UINT64_MAX);
+	if (!SaveOffscreenFrame(slot))
+		return false;
+	ReadGpuQueries(slot);
+	ValidateCulling(slot);
+
+	UpdateUniformBuffer(slot);
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+	if (!renderData.readbackFrames.empty())
+		renderData.readbackFrames[slot] = renderData.simulationFrame;
+	VkCommandBuffer commandBuffers[2];
+	SetFrameCommandBuffers(submitInfo, commandBuffers, slot);
+
+	appData.disp.resetFences(1, &renderData.inFlightFences[slot]);
+
+	if (appData.disp.queueSubmit(renderData.graphicsQueue, 1, &submitInfo, renderData.inFlightFences[slot]) != VK_SUCCESS)
+	{
+		GameThread::SendErrorPopup("failed to submit draw command buffer");
+		return false;
+	}
+	if (!renderData.queriesPending.empty())
+		renderData.queriesPending[slot] = 1;
+
+	renderData.currentFrame = (renderData.currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+	return true;
+}
+
+bool RenderThread::SaveOffscreenFrame(u32 slot)
+{
+	PROFILE_ZONE("RenderThread::SaveOffscreenFrame");
+	if (renderData.readbackFrames.empty() || renderData.readbackFrames[slot] == UINT64_MAX)
+		return true;
+	const u64 frame = renderData.readbackFrames[slot];
+	renderData.readbackFrames[slot] = UINT64_MAX;
+	if (frame % offscreen.saveInterval != 0)
+		return true;
+
+	std::string number = std::to_string(frame);
+	if (number.size() < 6)
+		number.insert(0, 6 - number.size(), '0');
+	const std::string path = offscreen.directory + "/frame_" + number + ".png";
+	const u32 width = renderData.extent.width;
+	if (!stbi_write_png(path.c_str(), (s32)(width), (s32)(renderData.extent.height), 4, renderData.readbackBuffersMapped[slot], (s32)(width * 4)))
+	{
+		GameThread::SendErrorPopup("failed to write " + path);
+		return false;
+	}
+	return true;
+}
+
 void RenderThread::Cleanup()
 {
-	for (u32 i = 0; i < appData.swapchain.image_count; i++)
+	for (u32 i = 0; i < renderData.finishedSemaphore.size(); i++)
 	{
 		appData.disp.destroySemaphore(renderData.finishedSemaphore[i], nullptr);
 	}
-	for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	for (u32 i = 0; i < renderData.availableSemaphores.size(); i++)
 	{
 		appData.disp.destroySemaphore(renderData.availableSemaphores[i], nullptr);
+	}
+	for (u32 i = 0; i < renderData.inFlightFences.size(); i++)
+	{
 		appData.disp.destroyFence(renderData.inFlightFences[i], nullptr);
 	}
 
+	appData.disp.destroySemaphore(renderData.uploadSemaphore, nullptr);
+	appData.disp.destroyFence(renderData.uploadFence, nullptr);
+	appData.disp.destroyBuffer(renderData.stagingBuffer, nullptr);
+	gpuAllocator.Free(renderData.stagingBufferMemory);
+
 	appData.disp.destroyCommandPool(renderData.commandPool, nullptr);
 	appData.disp.destroyCommandPool(renderData.transfertCommandPool, nullptr);
+	DestroyQueryPools();
 
 	for (u32 i = 0; i < renderData.framebuffers.size(); i++)
 	{
@@ -1730,13 +2705,13 @@ void RenderThread::Cleanup()
 	for (u32 i = 0; i < renderData.objectBuffers.size(); i++)
 	{
 		appData.disp.destroyBuffer(renderData.objectBuffers[i], nullptr);
-		appData.disp.freeMemory(renderData.objectBuffersMemory[i], nullptr);
+		gpuAllocator.Free(renderData.objectBuffersMemory[i]);
 	}
 	appData.disp.destroyBuffer(renderData.computeBuffer, nullptr);
-	appData.disp.freeMemory(renderData.computeBufferMemory, nullptr);
+	gpuAllocator.Free(renderData.computeBufferMemory);
 
 	appData.disp.destroyPipeline(renderData.graphicsPipeline, nullptr);
-	for (u32 i = 0; i < 4; i++)
+	for (u32 i = 0; i < COMPUTE_PIPELINE_COUNT; i++)
 	{
 		appData.disp.destroyPipeline(renderData.computePipelines[i], nullptr);
 	}
@@ -1744,23 +2719,51 @@ void RenderThread::Cleanup()
 	appData.disp.destroyPipelineLayout(renderData.computePipelineLayout, nullptr);
 	appData.disp.destroyRenderPass(renderData.renderPass, nullptr);
 	appData.disp.destroyBuffer(renderData.vertexBuffer, nullptr);
+	appData.disp.destroyBuffer(renderData.indexBuffer, nullptr);
+	appData.disp.destroyBuffer(renderData.cullBuffer, nullptr);
+	for (u32 i = 0; i < renderData.cullReadbackBuffers.size(); i++)
+	{
+		appData.disp.destroyBuffer(renderData.cullReadbackBuffers[i], nullptr);
+		gpuAllocator.Free(renderData.cullReadbackBuffersMemory[i]);
+	}
 	appData.disp.destroyDescriptorPool(renderData.descriptorPool, nullptr);
 	appData.disp.destroyDescriptorPool(renderData.descriptorPoolCompute, nullptr);
 	appData.disp.destroyDescriptorSetLayout(renderData.descriptorSetLayoutRender, nullptr);
 	appData.disp.destroyDescriptorSetLayout(renderData.descriptorSetLayoutCompute, nullptr);
-	appData.disp.freeMemory(renderData.vertexBufferMemory, nullptr);
+	gpuAllocator.Free(renderData.vertexBufferMemory);
+	gpuAllocator.Free(renderData.indexBufferMemory);
+	gpuAllocator.Free(renderData.cullBufferMemory);
 	appData.disp.destroySampler(renderData.textureSampler, nullptr);
 	appData.disp.destroyImageView(renderData.textureImageView, nullptr);
 	appData.disp.destroyImage(renderData.textureImage, nullptr);
-	appData.disp.freeMemory(renderData.textureImageMemory, nullptr);
+	gpuAllocator.Free(renderData.textureImageMemory);
 
 	appData.disp.destroyImageView(renderData.depthImageView, nullptr);
 	appData.disp.destroyImage(renderData.depthImage, nullptr);
-	appData.disp.freeMemory(renderData.depthImageMemory, nullptr);
+	gpuAllocator.Free(renderData.depthImageMemory);
 
-	appData.swapchain.destroy_image_views(renderData.swapchainImageViews);
+	if (offscreen.frameCount != 0)
+	{
+		for (u32 i = 0; i < renderData.swapchainImages.size(); i++)
+		{
+			appData.disp.destroyImageView(renderData.swapchainImageViews[i], nullptr);
+			appData.disp.destroyImage(renderData.swapchainImages[i], nullptr);
+			gpuAllocator.Free(renderData.offscreenImagesMemory[i]);
+		}
+		for (u32 i = 0; i < renderData.readbackBuffers.size(); i++)
+		{
+			appData.disp.destroyBuffer(renderData.readbackBuffers[i], nullptr);
+			gpuAllocator.Free(renderData.readbackBuffersMemory[i]);
+		}
+	}
+	else
+		appData.swapchain.destroy_image_views(renderData.swapchainImageViews);
 
 	vkb::destroy_swapchain(appData.swapchain);
+	if (!pipelineCache.Save())
+		LOG_WARNING("Could not write the pipeline cache to {}", pipelineCachePath);
+	pipelineCache.Shutdown();
+	gpuAllocator.Shutdown();
 	vkb::destroy_device(appData.device);
 	vkb::destroy_surface(appData.instance, appData.surface);
 	vkb::destroy_instance(appData.instance);
@@ -0,0 +1,165 @@
+#include "Resource/AssetPack.hpp"
+#include "Core/Logger.hpp"
+#include "Core/Profiler.hpp"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace Resource;
+
+u64 Resource::HashAssetData(const u8 *data, u64 size)
+{
+	u64 hash = 0xcbf29ce484222325ull;
+	for (u64 i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+bool Resource::IsTextureAsset(AssetType type)
+{
+	return type == ASSET_TEXTURE_RGBA8 || type == ASSET_TEXTURE_BC1 || type == ASSET_TEXTURE_BC7;
+}
+
+TextureEncoding Resource::GetTextureEncoding(AssetType type)
+{
+	return type == ASSET_TEXTURE_BC1 ? TEXTURE_BC1 : (type == ASSET_TEXTURE_BC7 ? TEXTURE_BC7 : TEXTURE_RGBA8);
+}
+
+AssetPack::~AssetPack()
+{
+	Close();
+}
+
+bool AssetPack::Open(const std::string &path)
+{
+	PROFILE_ZONE("AssetPack::Open");
+	Close();
+#ifdef _WIN32
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		file = nullptr;
+		return false;
+	}
+	LARGE_INTEGER fileSize = {};
+	if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart >= (LONGLONG)(sizeof(AssetPackHeader)))
+	{
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping)
+			data = static_cast<const u8 *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		size = (u64)(fileSize.QuadPart);
+	}
+#else
+	const int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat fileStat = {};
+	if (fstat(fd, &fileStat) == 0 && fileStat.st_size >= (off_t)(sizeof(AssetPackHeader)))
+	{
+		void *view = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		data = view != MAP_FAILED ? static_cast<const u8 *>(view) : nullptr;
+		size = (u64)(fileStat.st_size);
+	}
+	// The mapping keeps its own reference to the file
+	close(fd);
+#endif
+	if (!data || !Validate())
+	{
+		LOG_ERROR("{} is not a valid asset pack", path);
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void AssetPack::Close()
+{
+#ifdef _WIN32
+	if (data)
+		UnmapViewOfFile(data);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file)
+		CloseHandle(file);
+	mapping = nullptr;
+	file = nullptr;
+#else
+	if (data)
+		munmap(const_cast<u8 *>(data), size);
+#endif
+	data = nullptr;
+	size = 0;
+	entries = nullptr;
+	names = nullptr;
+	entryCount = 0;
+}
+
+const AssetPackEntry *AssetPack::Find(std::string_view name) const
+{
+	// The packer sorts the entries by name
+	u32 first = 0;
+	u32 last = entryCount;
+	while (first < last)
+	{
+		const u32 middle = first + (last - first) / 2;
+		const std::string_view middleName = GetName(entries[middle]);
+		if (middleName == name)
+			return &entries[middle];
+		if (middleName < name)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+	return nullptr;
+}
+
+std::string_view AssetPack::GetName(const AssetPackEntry &entry) const
+{
+	return std::string_view(names + entry.nameOffset, entry.nameLength);
+}
+
+bool AssetPack::Validate()
+{
+	AssetPackHeader header;
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != ASSET_PACK_MAGIC || header.version != ASSET_PACK_VERSION)
+		return false;
+	const u64 namesOffset = sizeof(AssetPackHeader) + (u64)(header.entryCount) * sizeof(AssetPackEntry);
+	if (namesOffset + header.nameTableSize > size)
+		return false;
+
+	// The entries are read in place, the mapping is page aligned and the header keeps them 8 byte aligned
+	entries = reinterpret_cast<const AssetPackEntry *>(data + sizeof(AssetPackHeader));
+	names = reinterpret_cast<const char *>(data + namesOffset);
+	entryCount = header.entryCount;
+	for (u32 i = 0; i < entryCount; i++)
+	{
+		const AssetPackEntry &entry = entries[i];
+		if ((u64)(entry.nameOffset) + entry.nameLength > header.nameTableSize || entry.offset > size || entry.size > size - entry.offset)
+			return false;
+		if (IsTextureAsset(entry.type) && (entry.mipCount == 0 || entry.mipCount > TextureEncoder::GetMipCount(entry.width, entry.height) ||
+			TextureEncoder::GetChainSize(GetTextureEncoding(entry.type), entry.width, entry.height, entry.mipCount) != entry.size))
+			return false;
+		if (i > 0 && !(GetName(entries[i - 1]) < GetName(entry)))
+			return false;
+#ifndef NDEBUG
+		if (HashAssetData(GetData(entry), entry.size) != entry.hash)
+		{
+			LOG_ERROR("Asset {} does not match its hash", GetName(entry));
+			return false;
+		}
+#endif
+	}
+	return true;
+}
@@ -1,8 +1,43 @@
 #include "Resource/Mesh.hpp"
+#include "Core/Profiler.hpp"
+#include "Core/Logger.hpp"
+
+#include <cmath>
+#include <cstring>
 
 using namespace Resource;
 using namespace Maths;
 
+namespace
+{
+	u16 FloatToUnorm16(f32 value)
+	{
+		value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+		return (u16)(value * 65535.0f + 0.5f);
+	}
+
+	s16 FloatToSnorm16(f32 value)
+	{
+		value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+		return (s16)(lroundf(value * 32767.0f));
+	}
+
+	// Projects the unit normal on the octahedron |x| + |y| + |z| = 1, the lower half folded over the upper one
+	Vec2 EncodeOctahedral(Vec3 normal)
+	{
+		const f32 sum = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+		if (sum == 0.0f)
+			return Vec2(0, 0);
+		Vec2 result = Vec2(normal.x / sum, normal.y / sum);
+		if (normal.z < 0.0f)
+		{
+			const Vec2 folded = Vec2(1.0f - fabsf(result.y), 1.0f - fabsf(result.x));
+			result = Vec2(result.x >= 0.0f ? folded.x : -folded.x, result.y >= 0.0f ? folded.y : -folded.y);
+		}
+		return result;
+	}
+}
+
 Mesh::Mesh()
 {
 }
@@ -11,9 +46,10 @@ Mesh::~Mesh()
 {
 }
 
-void Mesh::CreateDefaultCube()
+bool Mesh::CreateDefaultCube()
 {
-	vertices.clear();
+	PROFILE_ZONE("Mesh::CreateDefaultCube");
+	std::vector<Vertex> triangles;
 
 	const u32 faceIndices[] = { 0, 1, 3, 0, 3, 2};
 	const u32 remapIndices[] = { 2, 1, 0, 0, 2, 1, 1, 0, 2 };
@@ -46,14 +82,103 @@ void Mesh::CreateDefaultCube()
 				uv = uv / 2;
 			else
 				uv = uv / 2 + Vec2(0.5f, 0.5f);
-			vertices.push_back(Vertex(vert, uv, color, normal));
+			triangles.push_back(Vertex(vert, uv, color, normal));
 			if (flip && (j == 2 || j == 5))
-				std::swap(vertices[vertices.size()-1],vertices[vertices.size()-2]);
+				std::swap(triangles[triangles.size()-1],triangles[triangles.size()-2]);
 		}
 	}
+	vertices.clear();
+	packedVertices.clear();
+	indices.clear();
+	subMeshes.clear();
+	return AppendIndexed(triangles, 1.0f);
+}
+
+bool Mesh::AddImpostorQuad()
+{
+	// Half side of the square with the mean projected area of the cube, a quarter of its surface
+	const f32 halfSize = sqrtf(6.0f) / 2;
+	std::vector<Vec3> positions;
+	std::vector<Vec3> normals;
+	std::vector<Vec2> uvs;
+	Util::GeneratePlane(&positions, &normals, &uvs);
+
+	std::vector<Vertex> triangles;
+	for (u32 i = 0; i < positions.size(); i++)
+	{
+		// Same texture quarter as the bottom face of the cube
+		triangles.push_back(Vertex(positions[i] * halfSize, uvs[i] / 2, Vec3(1), normals[i]));
+		// The plane is counter clockwise seen from its normal, the cube faces are clockwise
+		if (i % 3 == 2)
+			std::swap(triangles[triangles.size() - 1], triangles[triangles.size() - 2]);
+	}
+	return AppendIndexed(triangles, 0.0f);
 }
 
 const std::vector<Vertex>& Resource::Mesh::GetVertices() const
 {
 	return vertices;
 }
+
+const std::vector<PackedVertex>& Resource::Mesh::GetPackedVertices() const
+{
+	return packedVertices;
+}
+
+const std::vector<u16>& Resource::Mesh::GetIndices() const
+{
+	return indices;
+}
+
+const std::vector<SubMesh>& Resource::Mesh::GetSubMeshes() const
+{
+	return subMeshes;
+}
+
+PackedVertex Mesh::PackVertex(const Vertex &vertex, f32 w)
+{
+	PackedVertex result;
+	result.pos[0] = Util::FloatToHalf(vertex.pos.x);
+	result.pos[1] = Util::FloatToHalf(vertex.pos.y);
+	result.pos[2] = Util::FloatToHalf(vertex.pos.z);
+	result.pos[3] = Util::FloatToHalf(w);
+	result.uv[0] = FloatToUnorm16(vertex.uv.x);
+	result.uv[1] = FloatToUnorm16(vertex.uv.y);
+	const Vec2 normal = EncodeOctahedral(vertex.norm);
+	result.norm[0] = FloatToSnorm16(normal.x);
+	result.norm[1] = FloatToSnorm16(normal.y);
+	return result;
+}
+
+bool Mesh::AppendIndexed(const std::vector<Vertex> &triangles, f32 w)
+{
+	SubMesh subMesh;
+	subMesh.firstIndex = (u32)(indices.size());
+	subMesh.vertexOffset = (s32)(packedVertices.size());
+	indices.reserve(indices.size() + triangles.size());
+	for (const Vertex &vertex : triangles)
+	{
+		// Linear search, the meshes are a few dozen vertices
+		const PackedVertex packed = PackVertex(vertex, w);
+		u32 index = 0;
+		while (subMesh.vertexOffset + index < packedVertices.size() && memcmp(&packedVertices[subMesh.vertexOffset + index], &packed, sizeof(packed)) != 0)
+			index++;
+		if (subMesh.vertexOffset + index == packedVertices.size())
+		{
+			if (index > UINT16_MAX)
+			{
+				LOG_ERROR("Sub mesh {} has more than {} unique vertices, it does not fit 16 bits indices", subMeshes.size(), UINT16_MAX + 1);
+				vertices.resize(subMesh.vertexOffset);
+				packedVertices.resize(subMesh.vertexOffset);
+				indices.resize(subMesh.firstIndex);
+				return false;
+			}
+			vertices.push_back(vertex);
+			packedVertices.push_back(packed);
+		}
+		indices.push_back((u16)(index));
+	}
+	subMesh.indexCount = (u32)(indices.size()) - subMesh.firstIndex;
+	subMeshes.push_back(subMesh);
+	return true;
+}
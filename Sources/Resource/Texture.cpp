@@ -1,4 +1,5 @@
 #include "Resource/Texture.hpp"
+#include "Core/Profiler.hpp"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -16,6 +17,7 @@ Texture::~Texture()
 
 u8 *Texture::ReadTexture(const std::string &path, IVec2 &res)
 {
+	PROFILE_ZONE("Texture::ReadTexture");
 	s32 comp;
 	u8* data = stbi_load(path.c_str(), &res.x, &res.y, &comp, 4);
 	return data;
@@ -0,0 +1,384 @@
+#include "Resource/TextureEncoder.hpp"
+#include "Core/Profiler.hpp"
+
+#include <cmath>
+#include <cstring>
+
+using namespace Resource;
+
+namespace
+{
+	// Weights of the 16 BC7 palette entries, out of 64
+	const u32 BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	f32 SrgbToLinear(u8 value)
+	{
+		const f32 c = value / 255.0f;
+		return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	u8 LinearToSrgb(f32 value)
+	{
+		const f32 c = value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+		const f32 scaled = c * 255.0f + 0.5f;
+		return (u8)(scaled < 0 ? 0 : (scaled > 255 ? 255 : scaled));
+	}
+
+	// Principal axis of the texels, 'channels' of them (3 or 4), by power iteration on their covariance
+	void PrincipalAxis(const u8 (&texels)[16][4], u32 channels, f32 (&mean)[4], f32 (&axis)[4])
+	{
+		for (u32 c = 0; c < 4; c++)
+		{
+			mean[c] = 0;
+			for (u32 i = 0; i < 16; i++)
+				mean[c] += texels[i][c];
+			mean[c] /= 16;
+		}
+		f32 covariance[4][4] = {};
+		for (u32 i = 0; i < 16; i++)
+		{
+			for (u32 a = 0; a < channels; a++)
+				for (u32 b = 0; b < channels; b++)
+					covariance[a][b] += (texels[i][a] - mean[a]) * (texels[i][b] - mean[b]);
+		}
+		for (u32 c = 0; c < 4; c++)
+			axis[c] = c < channels ? 1.0f : 0.0f;
+		for (u32 iteration = 0; iteration < 8; iteration++)
+		{
+			f32 next[4] = {};
+			f32 length = 0;
+			for (u32 a = 0; a < channels; a++)
+			{
+				for (u32 b = 0; b < channels; b++)
+					next[a] += covariance[a][b] * axis[b];
+				length += next[a] * next[a];
+			}
+			// Flat block, any axis will do
+			if (length < 1e-6f)
+				break;
+			length = sqrtf(length);
+			for (u32 a = 0; a < channels; a++)
+				axis[a] = next[a] / length;
+		}
+	}
+
+	// Ends of the texels projected on the principal axis
+	void FindEndpoints(const u8 (&texels)[16][4], u32 channels, f32 (&low)[4], f32 (&high)[4])
+	{
+		f32 mean[4], axis[4];
+		PrincipalAxis(texels, channels, mean, axis);
+		f32 minT = 0, maxT = 0;
+		for (u32 i = 0; i < 16; i++)
+		{
+			f32 t = 0;
+			for (u32 c = 0; c < channels; c++)
+				t += (texels[i][c] - mean[c]) * axis[c];
+			minT = t < minT ? t : minT;
+			maxT = t > maxT ? t : maxT;
+		}
+		for (u32 c = 0; c < 4; c++)
+		{
+			low[c] = c < channels ? mean[c] + axis[c] * minT : mean[c];
+			high[c] = c < channels ? mean[c] + axis[c] * maxT : mean[c];
+			low[c] = low[c] < 0 ? 0 : (low[c] > 255 ? 255 : low[c]);
+			high[c] = high[c] < 0 ? 0 : (high[c] > 255 ? 255 : high[c]);
+		}
+	}
+
+	u32 Distance(const u8 *a, const u8 *b, u32 channels)
+	{
+		u32 distance = 0;
+		for (u32 c = 0; c < channels; c++)
+		{
+			const s32 d = (s32)(a[c]) - b[c];
+			distance += (u32)(d * d);
+		}
+		return distance;
+	}
+
+	// Writes the 'bitCount' low bits of 'value' at 'bit', blocks are little endian bit streams
+	void WriteBits(u8 *out, u32 &bit, u32 value, u32 bitCount)
+	{
+		for (u32 i = 0; i < bitCount; i++, bit++)
+		{
+			if (value & (1u << i))
+				out[bit / 8] |= (u8)(1u << (bit % 8));
+		}
+	}
+}
+
+u32 TextureEncoder::GetMipCount(u32 width, u32 height)
+{
+	u32 count = 1;
+	while (width > 1 || height > 1)
+	{
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+		count++;
+	}
+	return count;
+}
+
+void TextureEncoder::GetBlockInfo(TextureEncoding encoding, u32 &blockSide, u32 &blockBytes)
+{
+	blockSide = encoding == TEXTURE_RGBA8 ? 1 : 4;
+	blockBytes = encoding == TEXTURE_RGBA8 ? 4 : (encoding == TEXTURE_BC1 ? 8 : 16);
+}
+
+u64 TextureEncoder::GetLevelSize(TextureEncoding encoding, u32 width, u32 height)
+{
+	u32 blockSide, blockBytes;
+	GetBlockInfo(encoding, blockSide, blockBytes);
+	return (u64)((width + blockSide - 1) / blockSide) * ((height + blockSide - 1) / blockSide) * blockBytes;
+}
+
+u64 TextureEncoder::GetChainSize(TextureEncoding encoding, u32 width, u32 height, u32 mipCount)
+{
+	u64 size = 0;
+	for (u32 level = 0; level < mipCount; level++)
+	{
+		size += GetLevelSize(encoding, width, height);
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+	return size;
+}
+
+std::vector<u8> TextureEncoder::BuildMipChain(const u8 *pixels, u32 width, u32 height)
+{
+	PROFILE_ZONE("TextureEncoder::BuildMipChain");
+	const u32 mipCount = GetMipCount(width, height);
+	std::vector<u8> chain(GetChainSize(TEXTURE_RGBA8, width, height, mipCount));
+	memcpy(chain.data(), pixels, GetLevelSize(TEXTURE_RGBA8, width, height));
+
+	f32 toLinear[256];
+	for (u32 i = 0; i < 256; i++)
+		toLinear[i] = SrgbToLinear((u8)(i));
+
+	const u8 *source = chain.data();
+	u8 *destination = chain.data() + GetLevelSize(TEXTURE_RGBA8, width, height);
+	for (u32 level = 1; level < mipCount; level++)
+	{
+		const u32 nextWidth = width > 1 ? width / 2 : 1;
+		const u32 nextHeight = height > 1 ? height / 2 : 1;
+		for (u32 y = 0; y < nextHeight; y++)
+		{
+			for (u32 x = 0; x < nextWidth; x++)
+			{
+				// The last row or column of an odd level is dropped, like the GPU blits do
+				const u32 x0 = x * 2, x1 = x * 2 + 1 < width ? x * 2 + 1 : x * 2;
+				const u32 y0 = y * 2, y1 = y * 2 + 1 < height ? y * 2 + 1 : y * 2;
+				const u8 *texels[4] = { source + (y0 * width + x0) * 4, source + (y0 * width + x1) * 4,
+										source + (y1 * width + x0) * 4, source + (y1 * width + x1) * 4 };
+				u8 *out = destination + (y * nextWidth + x) * 4;
+				for (u32 c = 0; c < 3; c++)
+					out[c] = LinearToSrgb((toLinear[texels[0][c]] + toLinear[texels[1][c]] + toLinear[texels[2][c]] + toLinear[texels[3][c]]) * 0.25f);
+				out[3] = (u8)((texels[0][3] + texels[1][3] + texels[2][3] + texels[3][3] + 2) / 4);
+			}
+		}
+		source = destination;
+		destination += GetLevelSize(TEXTURE_RGBA8, nextWidth, nextHeight);
+		width = nextWidth;
+		height = nextHeight;
+	}
+	return chain;
+}
+
+std::vector<u8> TextureEncoder::EncodeChain(const u8 *chain, u32 width, u32 height, u32 mipCount, TextureEncoding encoding)
+{
+	PROFILE_ZONE("TextureEncoder::EncodeChain");
+	std::vector<u8> result(GetChainSize(encoding, width, height, mipCount));
+	if (encoding == TEXTURE_RGBA8)
+	{
+		memcpy(result.data(), chain, result.size());
+		return result;
+	}
+
+	u8 *out = result.data();
+	for (u32 level = 0; level < mipCount; level++)
+	{
+		for (u32 blockY = 0; blockY < height; blockY += 4)
+		{
+			for (u32 blockX = 0; blockX < width; blockX += 4)
+			{
+				// Blocks past the edge of the small levels repeat the last texels
+				u8 texels[16][4];
+				for (u32 i = 0; i < 16; i++)
+				{
+					const u32 x = blockX + i % 4 < width ? blockX + i % 4 : width - 1;
+					const u32 y = blockY + i / 4 < height ? blockY + i / 4 : height - 1;
+					memcpy(texels[i], chain + (y * width + x) * 4, 4);
+				}
+				if (encoding == TEXTURE_BC1)
+				{
+					EncodeBC1Block(texels, out);
+					out += 8;
+				}
+				else
+				{
+					EncodeBC7Block(texels, out);
+					out += 16;
+				}
+			}
+		}
+		chain += GetLevelSize(TEXTURE_RGBA8, width, height);
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+	return result;
+}
+
+bool TextureEncoder::IsOpaque(const u8 *pixels, u32 width, u32 height)
+{
+	for (u64 i = 0; i < (u64)(width) * height; i++)
+	{
+		if (pixels[i * 4 + 3] != 255)
+			return false;
+	}
+	return true;
+}
+
+void TextureEncoder::EncodeBC1Block(const u8 (&texels)[16][4], u8 *out)
+{
+	f32 low[4], high[4];
+	FindEndpoints(texels, 3, low, high);
+
+	// RGB565 endpoints, the first one larger for the four color mode
+	const auto pack = [](const f32 (&color)[4]) {
+		return (u16)(((u32)(color[0] * 31 / 255 + 0.5f) << 11) | ((u32)(color[1] * 63 / 255 + 0.5f) << 5) | (u32)(color[2] * 31 / 255 + 0.5f));
+	};
+	u16 color0 = pack(high);
+	u16 color1 = pack(low);
+	if (color0 < color1)
+	{
+		const u16 swap = color0;
+		color0 = color1;
+		color1 = swap;
+	}
+
+	u8 palette[4][4] = {};
+	const u16 colors[2] = { color0, color1 };
+	for (u32 i = 0; i < 2; i++)
+	{
+		const u32 r = (colors[i] >> 11) & 31, g = (colors[i] >> 5) & 63, b = colors[i] & 31;
+		palette[i][0] = (u8)((r << 3) | (r >> 2));
+		palette[i][1] = (u8)((g << 2) | (g >> 4));
+		palette[i][2] = (u8)((b << 3) | (b >> 2));
+	}
+	for (u32 c = 0; c < 3; c++)
+	{
+		palette[2][c] = (u8)((2 * palette[0][c] + palette[1][c] + 1) / 3);
+		palette[3][c] = (u8)((palette[0][c] + 2 * palette[1][c] + 1) / 3);
+	}
+
+	u32 indices = 0;
+	// Equal endpoints select the three color mode, where index 0 is still the first endpoint
+	if (color0 != color1)
+	{
+		for (u32 i = 0; i < 16; i++)
+		{
+			u32 best = 0;
+			u32 bestDistance = UINT32_MAX;
+			for (u32 p = 0; p < 4; p++)
+			{
+				const u32 distance = Distance(texels[i], palette[p], 3);
+				if (distance < bestDistance)
+				{
+					best = p;
+					bestDistance = distance;
+				}
+			}
+			indices |= best << (i * 2);
+		}
+	}
+	memcpy(out, &color0, 2);
+	memcpy(out + 2, &color1, 2);
+	memcpy(out + 4, &indices, 4);
+}
+
+void TextureEncoder::EncodeBC7Block(const u8 (&texels)[16][4], u8 *out)
+{
+	f32 endpoints[2][4];
+	FindEndpoints(texels, 4, endpoints[0], endpoints[1]);
+
+	// 7 bits per channel and a shared low bit per endpoint, the one closest to the ideal endpoint
+	u32 quantized[2][4];
+	u32 pBits[2];
+	u8 decoded[2][4];
+	for (u32 e = 0; e < 2; e++)
+	{
+		f32 bestError = 0;
+		for (u32 p = 0; p < 2; p++)
+		{
+			f32 error = 0;
+			u32 values[4];
+			for (u32 c = 0; c < 4; c++)
+			{
+				const f32 value = (endpoints[e][c] - p) / 2 + 0.5f;
+				values[c] = value < 0 ? 0 : (value > 127 ? 127 : (u32)(value));
+				const f32 difference = (f32)(values[c] * 2 + p) - endpoints[e][c];
+				error += difference * difference;
+			}
+			if (p == 0 || error < bestError)
+			{
+				bestError = error;
+				pBits[e] = p;
+				for (u32 c = 0; c < 4; c++)
+					quantized[e][c] = values[c];
+			}
+		}
+		for (u32 c = 0; c < 4; c++)
+			decoded[e][c] = (u8)(quantized[e][c] * 2 + pBits[e]);
+	}
+
+	u8 palette[16][4];
+	for (u32 i = 0; i < 16; i++)
+	{
+		for (u32 c = 0; c < 4; c++)
+			palette[i][c] = (u8)(((64 - BC7_WEIGHTS[i]) * decoded[0][c] + BC7_WEIGHTS[i] * decoded[1][c] + 32) >> 6);
+	}
+	u32 indices[16];
+	for (u32 i = 0; i < 16; i++)
+	{
+		u32 bestDistance = UINT32_MAX;
+		for (u32 p = 0; p < 16; p++)
+		{
+			const u32 distance = Distance(texels[i], palette[p], 4);
+			if (distance < bestDistance)
+			{
+				indices[i] = p;
+				bestDistance = distance;
+			}
+		}
+	}
+
+	// The high bit of the first index is implied to be 0, swapping the endpoints mirrors the indices
+	if (indices[0] >= 8)
+	{
+		for (u32 c = 0; c < 4; c++)
+		{
+			const u32 swap = quantized[0][c];
+			quantized[0][c] = quantized[1][c];
+			quantized[1][c] = swap;
+		}
+		const u32 swap = pBits[0];
+		pBits[0] = pBits[1];
+		pBits[1] = swap;
+		for (u32 i = 0; i < 16; i++)
+			indices[i] = 15 - indices[i];
+	}
+
+	memset(out, 0, 16);
+	u32 bit = 0;
+	WriteBits(out, bit, 1 << 6, 7);
+	for (u32 c = 0; c < 4; c++)
+	{
+		WriteBits(out, bit, quantized[0][c], 7);
+		WriteBits(out, bit, quantized[1][c], 7);
+	}
+	WriteBits(out, bit, pBits[0], 1);
+	WriteBits(out, bit, pBits[1], 1);
+	WriteBits(out, bit, indices[0], 3);
+	for (u32 i = 1; i < 16; i++)
+		WriteBits(out, bit, indices[i], 4);
+}
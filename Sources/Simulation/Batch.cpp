@@ -0,0 +1,153 @@
+#include "Simulation/Batch.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+
+typedef u32 uint;
+#include "../Assets/Shaders/shaderSimData.h"
+
+using namespace Simulation;
+
+namespace
+{
+	bool StartsWith(const std::string &text, const char *prefix, std::string &value)
+	{
+		const size_t length = strlen(prefix);
+		if (text.compare(0, length, prefix) != 0)
+			return false;
+		value = text.substr(length);
+		return true;
+	}
+
+	bool ParseU64(const std::string &text, u64 &out)
+	{
+		if (text.empty())
+			return false;
+		char *end = nullptr;
+		unsigned long long value = strtoull(text.c_str(), &end, 0);
+		if (*end != '\0')
+			return false;
+		out = value;
+		return true;
+	}
+
+	bool ParseU32(const std::string &text, u32 &out)
+	{
+		u64 value = 0;
+		if (!ParseU64(text, value) || value > 0xFFFFFFFFull)
+			return false;
+		out = (u32)(value);
+		return true;
+	}
+}
+
+bool Simulation::ParseBatchArgument(const std::string &arg, BatchArgs &args)
+{
+	std::string value;
+	if (StartsWith(arg, "--seed=", value))
+		return ParseU64(value, args.config.seed);
+	if (StartsWith(arg, "--ticks=", value))
+		return ParseU32(value, args.ticks);
+	if (StartsWith(arg, "--threads=", value))
+		return ParseU32(value, args.config.threadCount);
+	if (StartsWith(arg, "--reorder-every=", value))
+		return ParseU32(value, args.config.reorderInterval);
+	if (StartsWith(arg, "--checksum-every=", value))
+		return ParseU32(value, args.checksumInterval);
+	if (StartsWith(arg, "--boids=", value))
+		return ParseU32(value, args.config.objectCount) && args.config.objectCount > 0;
+	if (StartsWith(arg, "--world=", value))
+	{
+		size_t separator = value.find('x');
+		u32 width = 0;
+		u32 height = 0;
+		if (separator == std::string::npos || !ParseU32(value.substr(0, separator), width) || !ParseU32(value.substr(separator + 1), height))
+			return false;
+		// Below three cells of BOID_DIST_MAX per axis boids would see each other twice through the wrap
+		const u32 minSize = (u32)(ceilf(BOID_DIST_MAX)) * 3;
+		if (width < minSize || height < minSize)
+			return false;
+		args.config.worldSize = Maths::IVec2((s32)(width), (s32)(height));
+		return true;
+	}
+	if (StartsWith(arg, "--step=", value))
+	{
+		char *end = nullptr;
+		f32 step = strtof(value.c_str(), &end);
+		if (value.empty() || *end != '\0' || !(step > 0))
+			return false;
+		args.config.timeStep = step;
+		return true;
+	}
+	if (StartsWith(arg, "--kernel=", value))
+	{
+		if (value == "auto")
+		{
+			args.config.kernelLevel = KernelLevel::COUNT;
+			return true;
+		}
+		for (u8 i = 0; i < (u8)(KernelLevel::COUNT); i++)
+		{
+			std::string name = GetKernelLevelName((KernelLevel)(i));
+			for (char &c : name)
+				c = (char)(tolower(c));
+			std::string compact;
+			for (char c : name)
+			{
+				if (c != '-')
+					compact.push_back(c);
+			}
+			if (value == name || value == compact)
+			{
+				args.config.kernelLevel = (KernelLevel)(i);
+				return true;
+			}
+		}
+		return false;
+	}
+	return false;
+}
+
+s32 Simulation::RunBatch(const BatchArgs &args)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	BoidEngine engine;
+	Clock::time_point initStart = Clock::now();
+	engine.Init(args.config);
+	f64 initTime = std::chrono::duration<f64>(Clock::now() - initStart).count();
+
+	const BoidEngineConfig &config = engine.GetConfig();
+	if (config.kernelLevel != KernelLevel::COUNT && config.kernelLevel != engine.GetKernelLevel())
+		printf("Kernel %s is not supported by this CPU, falling back to %s\n", GetKernelLevelName(config.kernelLevel), GetKernelLevelName(engine.GetKernelLevel()));
+	printf("Boids batch: %u boids, world %dx%d, step %gs, seed %llu, %u worker threads, %s kernel, reorder every %u ticks\n",
+		config.objectCount, config.worldSize.x, config.worldSize.y, config.timeStep,
+		(unsigned long long)(config.seed), config.threadCount, GetKernelLevelName(engine.GetKernelLevel()), config.reorderInterval);
+	// The kernel is printed with every checksum, they can only be compared between runs using the same one
+	const char *kernelName = GetKernelLevelName(engine.GetKernelLevel());
+	printf("Init: %.3fs, initial checksum %016llx (%s)\n", initTime, (unsigned long long)(engine.ComputeChecksum()), kernelName);
+
+	f64 simTime = 0;
+	for (u32 i = 0; i < args.ticks; i++)
+	{
+		Clock::time_point start = Clock::now();
+		engine.Step();
+		simTime += std::chrono::duration<f64>(Clock::now() - start).count();
+
+		// Checksums are not part of the timing
+		if (args.checksumInterval != 0 && engine.GetTick() % args.checksumInterval == 0)
+			printf("Tick %llu: checksum %016llx (%s)\n", (unsigned long long)(engine.GetTick()), (unsigned long long)(engine.ComputeChecksum()), kernelName);
+	}
+
+	const f64 ticksPerSecond = simTime > 0 ? args.ticks / simTime : 0;
+	printf("%u ticks in %.3fs: %.1f ticks/s, %.3f ms/tick, %.1f M boid updates/s\n",
+		args.ticks, simTime, ticksPerSecond, args.ticks ? simTime * 1000 / args.ticks : 0.0,
+		ticksPerSecond * config.objectCount / 1000000.0);
+	printf("Final checksum %016llx (%s)\n", (unsigned long long)(engine.ComputeChecksum()), kernelName);
+	engine.Shutdown();
+	return 0;
+}
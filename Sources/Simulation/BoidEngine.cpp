@@ -0,0 +1,343 @@
+#include "Simulation/BoidEngine.hpp"
+#include "Core/Profiler.hpp"
+
+#include <cstring>
+
+typedef u32 uint;
+#include "../Assets/Shaders/shaderSimData.h"
+
+using namespace Simulation;
+using namespace Maths;
+
+BoidEngine::~BoidEngine()
+{
+	Shutdown();
+}
+
+void BoidEngine::Init(const BoidEngineConfig &configIn)
+{
+	config = configIn;
+	tick = 0;
+	cursorPressed = false;
+
+	// splitmix64 on the seed, so that close seeds still give unrelated sequences
+	u64 z = config.seed + 0x9E3779B97F4A7C15ull;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	rngState = (z ^ (z >> 31)) | 1;
+
+	kernelLevel = config.kernelLevel;
+	if (kernelLevel >= KernelLevel::COUNT || kernelLevel > DetectKernelLevel())
+		kernelLevel = DetectKernelLevel();
+	neighbourKernel = GetNeighbourKernel(kernelLevel);
+
+	// The 3x3 neighbourhood only covers the interaction radius if every cell, including the ones reached
+	// through the wrap, is at least BOID_DIST_MAX wide: round the count down and stretch the cells instead
+	const f32 minCellSize = Util::MaxF(config.cellSize, BOID_DIST_MAX);
+	cellCount.x = Util::MaxI((s32)(config.worldSize.x / minCellSize), Util::MinI(3, (s32)(config.worldSize.x / BOID_DIST_MAX)));
+	cellCount.y = Util::MaxI((s32)(config.worldSize.y / minCellSize), Util::MinI(3, (s32)(config.worldSize.y / BOID_DIST_MAX)));
+	cellCount.x = Util::MaxI(cellCount.x, 1);
+	cellCount.y = Util::MaxI(cellCount.y, 1);
+	cellSize = Vec2((f32)(config.worldSize.x) / cellCount.x, (f32)(config.worldSize.y) / cellCount.y);
+
+	const u32 count = config.objectCount;
+	positions.resize(count);
+	velocities.resize(count);
+	accels.assign(count, Vec2());
+	objectIds.resize(count);
+	objectSlots.resize(count);
+	reorderedIds.resize(count);
+	sortedPosX.resize(count);
+	sortedPosY.resize(count);
+	sortedVelX.resize(count);
+	sortedVelY.resize(count);
+	for (u32 i = 0; i < count; i++)
+	{
+		positions[i] = Vec2(NextFloat01() * config.worldSize.x, NextFloat01() * config.worldSize.y);
+		velocities[i] = (Vec2(NextFloat01(), NextFloat01()) * 2 - 1) * BOID_MAX_SPEED * 0.2f;
+		objectIds[i] = i;
+		objectSlots[i] = i;
+	}
+
+	jobSystem.Init(config.threadCount);
+}
+
+void BoidEngine::Shutdown()
+{
+	jobSystem.Shutdown();
+}
+
+u32 BoidEngine::NextU32()
+{
+	// xorshift64*
+	rngState ^= rngState >> 12;
+	rngState ^= rngState << 25;
+	rngState ^= rngState >> 27;
+	return (u32)((rngState * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+f32 BoidEngine::NextFloat01()
+{
+	return (NextU32() >> 8) * (1.0f / 16777216.0f);
+}
+
+void BoidEngine::SetCursor(Vec2 position, bool pressed)
+{
+	cursorPos = position;
+	cursorPressed = pressed;
+}
+
+u64 BoidEngine::GetTick() const
+{
+	return tick;
+}
+
+KernelLevel BoidEngine::GetKernelLevel() const
+{
+	return kernelLevel;
+}
+
+const BoidEngineConfig &BoidEngine::GetConfig() const
+{
+	return config;
+}
+
+const std::vector<Vec2> &BoidEngine::GetPositions() const
+{
+	return positions;
+}
+
+const std::vector<Vec2> &BoidEngine::GetVelocities() const
+{
+	return velocities;
+}
+
+const std::vector<u32> &BoidEngine::GetObjectIds() const
+{
+	return objectIds;
+}
+
+u64 BoidEngine::ComputeChecksum() const
+{
+	u64 hash = 0xCBF29CE484222325ull;
+	const std::vector<Vec2> *arrays[2] = { &positions, &velocities };
+	for (const std::vector<Vec2> *array : arrays)
+	{
+		for (u32 slot : objectSlots)
+		{
+			const Vec2 &v = (*array)[slot];
+			u32 bits[2];
+			memcpy(&bits[0], &v.x, sizeof(u32));
+			memcpy(&bits[1], &v.y, sizeof(u32));
+			for (u32 word : bits)
+			{
+				for (u32 b = 0; b < 4; b++)
+				{
+					hash ^= (word >> (b * 8)) & 0xFF;
+					hash *= 0x100000001B3ull;
+				}
+			}
+		}
+	}
+	return hash;
+}
+
+s32 BoidEngine::GetCell(IVec2 pos, IVec2 &dt) const
+{
+	if (pos.x < 0)
+	{
+		pos.x += cellCount.x;
+		dt.x = -config.worldSize.x;
+	}
+	else if (pos.x >= cellCount.x)
+	{
+		pos.x -= cellCount.x;
+		dt.x = config.worldSize.x;
+	}
+	if (pos.y < 0)
+	{
+		pos.y += cellCount.y;
+		dt.y = -config.worldSize.y;
+	}
+	else if (pos.y >= cellCount.y)
+	{
+		pos.y -= cellCount.y;
+		dt.y = config.worldSize.y;
+	}
+	return pos.x + pos.y * cellCount.x;
+}
+
+void BoidEngine::Step()
+{
+	PROFILE_ZONE("BoidEngine::Step");
+	const u32 count = config.objectCount;
+	grid.Build(jobSystem, positions.data(), count, cellCount, cellSize);
+
+	Core::JobCounter counter;
+	jobSystem.ParallelFor(counter, count, BOID_CHUNK, &BoidEngine::GatherJob, this);
+	jobSystem.Wait(counter);
+
+	// The gathered copies already are in grid order: write them back and rebuild the grid, which then
+	// lists every cell as a contiguous range of indices and keeps the gather reads sequential for a while
+	if (config.reorderInterval != 0 && tick % config.reorderInterval == 0)
+	{
+		jobSystem.ParallelFor(counter, count, BOID_CHUNK, &BoidEngine::ReorderJob, this);
+		jobSystem.Wait(counter);
+		objectIds.swap(reorderedIds);
+		grid.Build(jobSystem, positions.data(), count, cellCount, cellSize);
+	}
+
+	// Every boid only writes its own acceleration, in a fixed neighbour order: the job split does not matter
+	jobSystem.ParallelFor(counter, cellCount.x * cellCount.y, 1, &BoidEngine::CellUpdateJob, this);
+	jobSystem.Wait(counter);
+
+	jobSystem.ParallelFor(counter, count, BOID_CHUNK, &BoidEngine::PostUpdateJob, this);
+	jobSystem.Wait(counter);
+	tick++;
+}
+
+void BoidEngine::GatherJob(void *data, u32 begin, u32 end)
+{
+	PROFILE_ZONE("BoidEngine::GatherJob");
+	BoidEngine *self = static_cast<BoidEngine *>(data);
+	const u32 *sorted = self->grid.GetSortedIndices();
+	for (u32 i = begin; i < end; i++)
+	{
+		u32 boid = sorted[i];
+		self->sortedPosX[i] = self->positions[boid].x;
+		self->sortedPosY[i] = self->positions[boid].y;
+		self->sortedVelX[i] = self->velocities[boid].x;
+		self->sortedVelY[i] = self->velocities[boid].y;
+	}
+}
+
+void BoidEngine::CellUpdateJob(void *data, u32 begin, u32 end)
+{
+	PROFILE_ZONE("BoidEngine::CellUpdateJob");
+	BoidEngine *self = static_cast<BoidEngine *>(data);
+	for (u32 i = begin; i < end; i++)
+		self->ProcessCellUpdate(i % self->cellCount.x, i / self->cellCount.x);
+}
+
+void BoidEngine::PostUpdateJob(void *data, u32 begin, u32 end)
+{
+	PROFILE_ZONE("BoidEngine::PostUpdateJob");
+	BoidEngine *self = static_cast<BoidEngine *>(data);
+	self->ProcessPostUpdate(begin, end);
+}
+
+void BoidEngine::ReorderJob(void *data, u32 begin, u32 end)
+{
+	PROFILE_ZONE("BoidEngine::ReorderJob");
+	BoidEngine *self = static_cast<BoidEngine *>(data);
+	self->ProcessReorder(begin, end);
+}
+
+void BoidEngine::ProcessCellUpdate(u32 cx, u32 cy)
+{
+	const f32 deltaTime = config.timeStep;
+	const u32 *sorted = grid.GetSortedIndices();
+	const u32 cell1 = cx + cy * cellCount.x;
+	const u32 start1 = grid.GetCellStart(cell1);
+	const u32 end1 = start1 + grid.GetCellCount(cell1);
+
+	BoidSoA boids;
+	boids.posX = sortedPosX.data();
+	boids.posY = sortedPosY.data();
+	boids.velX = sortedVelX.data();
+	boids.velY = sortedVelY.data();
+
+	NeighbourQuery query;
+	query.maxDistSqr = BOID_DIST_MAX * BOID_DIST_MAX;
+	query.minDistSqr = BOID_DIST_MIN * BOID_DIST_MIN;
+	query.avoidScale = BOID_DIST_MIN * BOID_DIST_MIN * BOID_DIST_MIN;
+
+	for (u32 index1 = start1; index1 < end1; index1++)
+	{
+		u32 boid1 = sorted[index1];
+		query.self = index1;
+
+		NeighbourSums sums;
+		for (s32 i = -1; i <= 1; i++)
+		{
+			for (s32 j = -1; j <= 1; j++)
+			{
+				IVec2 dt;
+				s32 cellId = GetCell(IVec2(cx + i, cy + j), dt);
+
+				// delta = neighbour - (boid - dt), the wrap offset is folded into the query position
+				query.x = sortedPosX[index1] - dt.x;
+				query.y = sortedPosY[index1] - dt.y;
+				const u32 start2 = grid.GetCellStart(cellId);
+				neighbourKernel(boids, start2, start2 + grid.GetCellCount(cellId), query, sums);
+			}
+		}
+
+		const u32 count = sums.count;
+		const u32 avoidCount = sums.avoidCount;
+		const Vec2 globalPos = Vec2(sums.posX, sums.posY);
+		const Vec2 globalRot = Vec2(sums.velX, sums.velY);
+		const Vec2 avoidDir = Vec2(sums.avoidX, sums.avoidY);
+
+		if (count != 0)
+		{
+			accels[boid1] = (globalPos / (float)(count)) * 700 + (globalRot / (float)(count)) * 2500;
+			if (avoidCount != 0)
+				accels[boid1] += (avoidDir / (float)(avoidCount)) * 9000;
+			accels[boid1] *= deltaTime;
+		}
+		else
+			accels[boid1] = velocities[boid1].Normalize() * deltaTime;
+
+		if (cursorPressed)
+		{
+			Vec2 d = positions[boid1] - cursorPos;
+			if (d.Dot() < BOID_CURSOR_DIST * BOID_CURSOR_DIST)
+			{
+				float len = d.Length();
+				accels[boid1] += d / (len * len) * deltaTime * 60000000;
+			}
+		}
+	}
+}
+
+void BoidEngine::ProcessReorder(u32 begin, u32 end)
+{
+	const u32 *sorted = grid.GetSortedIndices();
+	for (u32 i = begin; i < end; i++)
+	{
+		positions[i] = Vec2(sortedPosX[i], sortedPosY[i]);
+		velocities[i] = Vec2(sortedVelX[i], sortedVelY[i]);
+		const u32 id = objectIds[sorted[i]];
+		reorderedIds[i] = id;
+		objectSlots[id] = i;
+	}
+}
+
+void BoidEngine::ProcessPostUpdate(u32 begin, u32 end)
+{
+	const f32 deltaTime = config.timeStep;
+	const Vec2 world = Vec2((f32)(config.worldSize.x), (f32)(config.worldSize.y));
+	for (u32 i = begin; i < end; i++)
+	{
+		Vec2 newVel = velocities[i] + accels[i] * deltaTime;
+		float len = newVel.Length();
+		if (len > BOID_MAX_SPEED)
+		{
+			newVel = newVel.Normalize() * BOID_MAX_SPEED;
+		}
+		velocities[i] = newVel;
+
+		Vec2 newPos = positions[i] + velocities[i] * deltaTime;
+		if (newPos.x < 0)
+			newPos.x += world.x;
+		else if (newPos.x >= world.x)
+			newPos.x -= world.x;
+		if (newPos.y < 0)
+			newPos.y += world.y;
+		else if (newPos.y >= world.y)
+			newPos.y -= world.y;
+
+		positions[i] = newPos;
+	}
+}
@@ -0,0 +1,113 @@
+#include "Simulation/BoidKernel.hpp"
+
+#include <math.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace Simulation;
+
+#ifdef _MSC_VER
+namespace
+{
+	bool HasCpuidBit(s32 leaf, s32 subLeaf, u32 reg, u32 bit)
+	{
+		s32 info[4] = {};
+		__cpuidex(info, leaf, subLeaf);
+		return (info[reg] >> bit) & 1;
+	}
+}
+#endif
+
+KernelLevel Simulation::DetectKernelLevel()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	s32 info[4] = {};
+	__cpuid(info, 0);
+	const s32 maxLeaf = info[0];
+	if (maxLeaf < 1 || !HasCpuidBit(1, 0, 2, 20) || !HasCpuidBit(1, 0, 2, 23))
+		return KernelLevel::SCALAR;
+
+	// AVX state has to be enabled by the OS (OSXSAVE, then XCR0), not only supported by the CPU
+	if (maxLeaf < 7 || !HasCpuidBit(1, 0, 2, 27) || !HasCpuidBit(1, 0, 2, 28))
+		return KernelLevel::SSE42;
+	const u64 xcr0 = _xgetbv(0);
+	if ((xcr0 & 0x6) != 0x6 || !HasCpuidBit(7, 0, 1, 5))
+		return KernelLevel::SSE42;
+	if ((xcr0 & 0xE0) != 0xE0 || !HasCpuidBit(7, 0, 1, 16))
+		return KernelLevel::AVX2;
+	return KernelLevel::AVX512;
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return KernelLevel::AVX512;
+	if (__builtin_cpu_supports("avx2"))
+		return KernelLevel::AVX2;
+	if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+		return KernelLevel::SSE42;
+	return KernelLevel::SCALAR;
+#else
+	return KernelLevel::SCALAR;
+#endif
+}
+
+NeighbourKernel Simulation::GetNeighbourKernel(KernelLevel level)
+{
+	switch (level)
+	{
+	case KernelLevel::SSE42:
+		return &AccumulateNeighboursSSE42;
+	case KernelLevel::AVX2:
+		return &AccumulateNeighboursAVX2;
+	case KernelLevel::AVX512:
+		return &AccumulateNeighboursAVX512;
+	default:
+		return &AccumulateNeighboursScalar;
+	}
+}
+
+const char *Simulation::GetKernelLevelName(KernelLevel level)
+{
+	switch (level)
+	{
+	case KernelLevel::SSE42:
+		return "SSE4.2";
+	case KernelLevel::AVX2:
+		return "AVX2";
+	case KernelLevel::AVX512:
+		return "AVX-512";
+	default:
+		return "Scalar";
+	}
+}
+
+void Simulation::AccumulateNeighboursScalar(const BoidSoA &boids, u32 begin, u32 end, const NeighbourQuery &query, NeighbourSums &sums)
+{
+	for (u32 i = begin; i < end; i++)
+	{
+		if (i == query.self)
+			continue;
+
+		f32 dx = boids.posX[i] - query.x;
+		f32 dy = boids.posY[i] - query.y;
+		f32 distSqr = dx * dx + dy * dy;
+		if (distSqr > query.maxDistSqr)
+			continue;
+
+		sums.posX += dx;
+		sums.posY += dy;
+		sums.velX += boids.velX[i];
+		sums.velY += boids.velY[i];
+		sums.count++;
+
+		if (distSqr < query.minDistSqr && distSqr > 0)
+		{
+			f32 dist = sqrtf(distSqr);
+			f32 factor = query.avoidScale / (dist * dist * dist);
+			sums.avoidX -= dx * factor;
+			sums.avoidY -= dy * factor;
+			sums.avoidCount++;
+		}
+	}
+}
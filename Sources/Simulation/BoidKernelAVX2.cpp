@@ -0,0 +1,99 @@
+#include "Simulation/BoidKernel.hpp"
+
+#ifdef BOID_KERNEL_X86
+#include <immintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define KERNEL_TARGET __attribute__((target("avx2,popcnt")))
+#else
+#define KERNEL_TARGET
+#endif
+
+using namespace Simulation;
+
+namespace
+{
+	KERNEL_TARGET f32 HorizontalSum(__m256 v)
+	{
+		__m128 low = _mm256_castps256_ps128(v);
+		__m128 high = _mm256_extractf128_ps(v, 1);
+		__m128 sum = _mm_add_ps(low, high);
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		return _mm_cvtss_f32(_mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1)));
+	}
+}
+
+KERNEL_TARGET void Simulation::AccumulateNeighboursAVX2(const BoidSoA &boids, u32 begin, u32 end, const NeighbourQuery &query, NeighbourSums &sums)
+{
+	const __m256 px = _mm256_set1_ps(query.x);
+	const __m256 py = _mm256_set1_ps(query.y);
+	const __m256 maxDistSqr = _mm256_set1_ps(query.maxDistSqr);
+	const __m256 minDistSqr = _mm256_set1_ps(query.minDistSqr);
+	const __m256 avoidScale = _mm256_set1_ps(query.avoidScale);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256i self = _mm256_set1_epi32((s32)(query.self));
+	const __m256i step = _mm256_set1_epi32(8);
+	__m256i lane = _mm256_add_epi32(_mm256_set1_epi32((s32)(begin)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+
+	__m256 sumPosX = zero;
+	__m256 sumPosY = zero;
+	__m256 sumVelX = zero;
+	__m256 sumVelY = zero;
+	__m256 sumAvoidX = zero;
+	__m256 sumAvoidY = zero;
+	u32 count = 0;
+	u32 avoidCount = 0;
+
+	u32 i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(boids.posX + i), px);
+		__m256 dy = _mm256_sub_ps(_mm256_loadu_ps(boids.posY + i), py);
+		__m256 distSqr = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+		__m256 isSelf = _mm256_castsi256_ps(_mm256_cmpeq_epi32(lane, self));
+		__m256 inRange = _mm256_andnot_ps(isSelf, _mm256_cmp_ps(distSqr, maxDistSqr, _CMP_LE_OQ));
+		lane = _mm256_add_epi32(lane, step);
+
+		s32 rangeMask = _mm256_movemask_ps(inRange);
+		if (rangeMask == 0)
+			continue;
+		count += _mm_popcnt_u32(rangeMask);
+		sumPosX = _mm256_add_ps(sumPosX, _mm256_and_ps(inRange, dx));
+		sumPosY = _mm256_add_ps(sumPosY, _mm256_and_ps(inRange, dy));
+		sumVelX = _mm256_add_ps(sumVelX, _mm256_and_ps(inRange, _mm256_loadu_ps(boids.velX + i)));
+		sumVelY = _mm256_add_ps(sumVelY, _mm256_and_ps(inRange, _mm256_loadu_ps(boids.velY + i)));
+
+		__m256 avoid = _mm256_and_ps(inRange, _mm256_and_ps(_mm256_cmp_ps(distSqr, minDistSqr, _CMP_LT_OQ), _mm256_cmp_ps(distSqr, zero, _CMP_GT_OQ)));
+		s32 avoidMask = _mm256_movemask_ps(avoid);
+		if (avoidMask == 0)
+			continue;
+		avoidCount += _mm_popcnt_u32(avoidMask);
+		__m256 dist = _mm256_sqrt_ps(distSqr);
+		__m256 factor = _mm256_and_ps(avoid, _mm256_div_ps(avoidScale, _mm256_mul_ps(_mm256_mul_ps(dist, dist), dist)));
+		sumAvoidX = _mm256_sub_ps(sumAvoidX, _mm256_mul_ps(dx, factor));
+		sumAvoidY = _mm256_sub_ps(sumAvoidY, _mm256_mul_ps(dy, factor));
+	}
+
+	sums.posX += HorizontalSum(sumPosX);
+	sums.posY += HorizontalSum(sumPosY);
+	sums.velX += HorizontalSum(sumVelX);
+	sums.velY += HorizontalSum(sumVelY);
+	sums.avoidX += HorizontalSum(sumAvoidX);
+	sums.avoidY += HorizontalSum(sumAvoidY);
+	sums.count += count;
+	sums.avoidCount += avoidCount;
+
+	// Leaving the 256 bit registers dirty makes the following SSE code pay a transition penalty
+	_mm256_zeroupper();
+
+	if (i < end)
+		AccumulateNeighboursScalar(boids, i, end, query, sums);
+}
+
+#else
+// Never selected by DetectKernelLevel, only here so that the dispatch table links
+void Simulation::AccumulateNeighboursAVX2(const BoidSoA &boids, u32 begin, u32 end, const NeighbourQuery &query, NeighbourSums &sums)
+{
+	AccumulateNeighboursScalar(boids, begin, end, query, sums);
+}
+#endif
@@ -0,0 +1,83 @@
+#include "Simulation/BoidKernel.hpp"
+
+#ifdef BOID_KERNEL_X86
+#include <immintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define KERNEL_TARGET __attribute__((target("avx512f,popcnt")))
+#else
+#define KERNEL_TARGET
+#endif
+
+using namespace Simulation;
+
+KERNEL_TARGET void Simulation::AccumulateNeighboursAVX512(const BoidSoA &boids, u32 begin, u32 end, const NeighbourQuery &query, NeighbourSums &sums)
+{
+	const __m512 px = _mm512_set1_ps(query.x);
+	const __m512 py = _mm512_set1_ps(query.y);
+	const __m512 maxDistSqr = _mm512_set1_ps(query.maxDistSqr);
+	const __m512 minDistSqr = _mm512_set1_ps(query.minDistSqr);
+	const __m512 avoidScale = _mm512_set1_ps(query.avoidScale);
+	const __m512 zero = _mm512_setzero_ps();
+	const __m512i self = _mm512_set1_epi32((s32)(query.self));
+	const __m512i step = _mm512_set1_epi32(16);
+	__m512i lane = _mm512_add_epi32(_mm512_set1_epi32((s32)(begin)), _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+
+	__m512 sumPosX = zero;
+	__m512 sumPosY = zero;
+	__m512 sumVelX = zero;
+	__m512 sumVelY = zero;
+	__m512 sumAvoidX = zero;
+	__m512 sumAvoidY = zero;
+	u32 count = 0;
+	u32 avoidCount = 0;
+
+	// Mask registers handle the tail as well, no scalar loop needed
+	for (u32 i = begin; i < end; i += 16)
+	{
+		const u32 remaining = end - i;
+		const __mmask16 loadMask = remaining >= 16 ? (__mmask16)(0xFFFF) : (__mmask16)((1u << remaining) - 1);
+		__m512 dx = _mm512_sub_ps(_mm512_maskz_loadu_ps(loadMask, boids.posX + i), px);
+		__m512 dy = _mm512_sub_ps(_mm512_maskz_loadu_ps(loadMask, boids.posY + i), py);
+		__m512 distSqr = _mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy));
+		__mmask16 notSelf = _mm512_cmpneq_epi32_mask(lane, self);
+		__mmask16 inRange = _mm512_mask_cmp_ps_mask(loadMask & notSelf, distSqr, maxDistSqr, _CMP_LE_OQ);
+		lane = _mm512_add_epi32(lane, step);
+		if (inRange == 0)
+			continue;
+
+		count += _mm_popcnt_u32(inRange);
+		sumPosX = _mm512_mask_add_ps(sumPosX, inRange, sumPosX, dx);
+		sumPosY = _mm512_mask_add_ps(sumPosY, inRange, sumPosY, dy);
+		sumVelX = _mm512_mask_add_ps(sumVelX, inRange, sumVelX, _mm512_maskz_loadu_ps(inRange, boids.velX + i));
+		sumVelY = _mm512_mask_add_ps(sumVelY, inRange, sumVelY, _mm512_maskz_loadu_ps(inRange, boids.velY + i));
+
+		__mmask16 avoid = _mm512_mask_cmp_ps_mask(inRange, distSqr, minDistSqr, _CMP_LT_OQ);
+		avoid = _mm512_mask_cmp_ps_mask(avoid, distSqr, zero, _CMP_GT_OQ);
+		if (avoid == 0)
+			continue;
+		avoidCount += _mm_popcnt_u32(avoid);
+		__m512 dist = _mm512_sqrt_ps(distSqr);
+		__m512 factor = _mm512_maskz_div_ps(avoid, avoidScale, _mm512_mul_ps(_mm512_mul_ps(dist, dist), dist));
+		sumAvoidX = _mm512_mask_sub_ps(sumAvoidX, avoid, sumAvoidX, _mm512_mul_ps(dx, factor));
+		sumAvoidY = _mm512_mask_sub_ps(sumAvoidY, avoid, sumAvoidY, _mm512_mul_ps(dy, factor));
+	}
+
+	sums.posX += _mm512_reduce_add_ps(sumPosX);
+	sums.posY += _mm512_reduce_add_ps(sumPosY);
+	sums.velX += _mm512_reduce_add_ps(sumVelX);
+	sums.velY += _mm512_reduce_add_ps(sumVelY);
+	sums.avoidX += _mm512_reduce_add_ps(sumAvoidX);
+	sums.avoidY += _mm512_reduce_add_ps(sumAvoidY);
+	sums.count += count;
+	sums.avoidCount += avoidCount;
+	_mm256_zeroupper();
+}
+
+#else
+// Never selected by DetectKernelLevel, only here so that the dispatch table links
+void Simulation::AccumulateNeighboursAVX512(const BoidSoA &boids, u32 begin, u32 end, const NeighbourQuery &query, NeighbourSums &sums)
+{
+	AccumulateNeighboursScalar(boids, begin, end, query, sums);
+}
+#endif
@@ -0,0 +1,95 @@
+#include "Simulation/BoidKernel.hpp"
+
+#ifdef BOID_KERNEL_X86
+#include <nmmintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define KERNEL_TARGET __attribute__((target("sse4.2,popcnt")))
+#else
+#define KERNEL_TARGET
+#endif
+
+using namespace Simulation;
+
+namespace
+{
+	KERNEL_TARGET f32 HorizontalSum(__m128 v)
+	{
+		__m128 high = _mm_movehl_ps(v, v);
+		__m128 sum = _mm_add_ps(v, high);
+		return _mm_cvtss_f32(_mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1)));
+	}
+}
+
+KERNEL_TARGET void Simulation::AccumulateNeighboursSSE42(const BoidSoA &boids, u32 begin, u32 end, const NeighbourQuery &query, NeighbourSums &sums)
+{
+	const __m128 px = _mm_set1_ps(query.x);
+	const __m128 py = _mm_set1_ps(query.y);
+	const __m128 maxDistSqr = _mm_set1_ps(query.maxDistSqr);
+	const __m128 minDistSqr = _mm_set1_ps(query.minDistSqr);
+	const __m128 avoidScale = _mm_set1_ps(query.avoidScale);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128i self = _mm_set1_epi32((s32)(query.self));
+	const __m128i step = _mm_set1_epi32(4);
+	__m128i lane = _mm_add_epi32(_mm_set1_epi32((s32)(begin)), _mm_setr_epi32(0, 1, 2, 3));
+
+	__m128 sumPosX = zero;
+	__m128 sumPosY = zero;
+	__m128 sumVelX = zero;
+	__m128 sumVelY = zero;
+	__m128 sumAvoidX = zero;
+	__m128 sumAvoidY = zero;
+	u32 count = 0;
+	u32 avoidCount = 0;
+
+	u32 i = begin;
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 dx = _mm_sub_ps(_mm_loadu_ps(boids.posX + i), px);
+		__m128 dy = _mm_sub_ps(_mm_loadu_ps(boids.posY + i), py);
+		__m128 distSqr = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+		__m128 isSelf = _mm_castsi128_ps(_mm_cmpeq_epi32(lane, self));
+		__m128 inRange = _mm_andnot_ps(isSelf, _mm_cmple_ps(distSqr, maxDistSqr));
+		lane = _mm_add_epi32(lane, step);
+
+		s32 rangeMask = _mm_movemask_ps(inRange);
+		if (rangeMask == 0)
+			continue;
+		count += _mm_popcnt_u32(rangeMask);
+		sumPosX = _mm_add_ps(sumPosX, _mm_and_ps(inRange, dx));
+		sumPosY = _mm_add_ps(sumPosY, _mm_and_ps(inRange, dy));
+		sumVelX = _mm_add_ps(sumVelX, _mm_and_ps(inRange, _mm_loadu_ps(boids.velX + i)));
+		sumVelY = _mm_add_ps(sumVelY, _mm_and_ps(inRange, _mm_loadu_ps(boids.velY + i)));
+
+		__m128 avoid = _mm_and_ps(inRange, _mm_and_ps(_mm_cmplt_ps(distSqr, minDistSqr), _mm_cmpgt_ps(distSqr, zero)));
+		s32 avoidMask = _mm_movemask_ps(avoid);
+		if (avoidMask == 0)
+			continue;
+		avoidCount += _mm_popcnt_u32(avoidMask);
+		// Masked lanes may hold infinities, they are cleared by the and below
+		__m128 dist = _mm_sqrt_ps(distSqr);
+		__m128 factor = _mm_and_ps(avoid, _mm_div_ps(avoidScale, _mm_mul_ps(_mm_mul_ps(dist, dist), dist)));
+		sumAvoidX = _mm_sub_ps(sumAvoidX, _mm_mul_ps(dx, factor));
+		sumAvoidY = _mm_sub_ps(sumAvoidY, _mm_mul_ps(dy, factor));
+	}
+
+	sums.posX += HorizontalSum(sumPosX);
+	sums.posY += HorizontalSum(sumPosY);
+	sums.velX += HorizontalSum(sumVelX);
+	sums.velY += HorizontalSum(sumVelY);
+	sums.avoidX += HorizontalSum(sumAvoidX);
+	sums.avoidY += HorizontalSum(sumAvoidY);
+	sums.count += count;
+	sums.avoidCount += avoidCount;
+
+	if (i < end)
+		AccumulateNeighboursScalar(boids, i, end, query, sums);
+}
+
+#else
+// Never selected by DetectKernelLevel, only here so that the dispatch table links
+void Simulation::AccumulateNeighboursSSE42(const BoidSoA &boids, u32 begin, u32 end, const NeighbourQuery &query, NeighbourSums &sums)
+{
+	AccumulateNeighboursScalar(boids, begin, end, query, sums);
+}
+#endif
@@ -0,0 +1,429 @@
+#include "Simulation/ComputeReference.hpp"
+#include "Core/Profiler.hpp"
+
+#include <chrono>
+#include <atomic>
+#include <cstring>
+
+typedef u32 uint;
+#include "../Assets/Shaders/shaderSimData.h"
+
+using namespace Simulation;
+using namespace Maths;
+
+namespace
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	const u32 CHUNK_GRAIN = 64;
+	const u32 OBJECT_GRAIN = 4096;
+	// Per boid neighbour evaluation costs about as much as a small chunk
+	const u32 BOID_GRAIN = 256;
+	const u32 LANE_GRAIN = 8;
+
+	f64 ElapsedMicros(Clock::time_point start)
+	{
+		return std::chrono::duration<f64, std::micro>(Clock::now() - start).count();
+	}
+
+	s32 GetCell(const SimulationSizes &sizes, IVec3 pos, Vec3 &dt)
+	{
+		const s32 side = (s32)(sizes.chunkCountSide);
+		const f32 size = (f32)(sizes.worldSize);
+		dt = Vec3();
+		if (pos.x < 0)
+		{
+			pos.x += side;
+			dt.x = -size;
+		}
+		else if (pos.x >= side)
+		{
+			pos.x -= side;
+			dt.x = size;
+		}
+		if (pos.y < 0)
+		{
+			pos.y += side;
+			dt.y = -size;
+		}
+		else if (pos.y >= side)
+		{
+			pos.y -= side;
+			dt.y = size;
+		}
+		if (pos.z < 0)
+		{
+			pos.z += side;
+			dt.z = -size;
+		}
+		else if (pos.z >= side)
+		{
+			pos.z -= side;
+			dt.z = size;
+		}
+		return pos.x + ((pos.z * side) + pos.y) * side;
+	}
+}
+
+ComputeReference::~ComputeReference()
+{
+	Shutdown();
+}
+
+void ComputeReference::Init(const SimulationSizes &simSizes, u32 workerCount)
+{
+	sizes = simSizes;
+	bins.assign(sizes.binBufferCount, 0);
+	laneSums.assign(SCAN_GROUP_SIZE, 0);
+	objects.assign(sizes.objectCount, Object());
+	reordered.assign(sizes.reorderInterval != 0 ? sizes.objectCount : 0, Object());
+	frame = 0;
+	jobSystem.Init(workerCount);
+}
+
+void ComputeReference::Shutdown()
+{
+	jobSystem.Shutdown();
+}
+
+void ComputeReference::SetObjects(const std::vector<Vec4> &data)
+{
+	for (u32 i = 0; i < sizes.objectCount && i * 4 + 3 < data.size(); i++)
+	{
+		Object &obj = objects[i];
+		obj.position = Vec3(data[i*4].x, data[i*4].y, data[i*4].z);
+		obj.padding0 = data[i*4].w;
+		obj.velocity = Vec3(data[i*4+1].x, data[i*4+1].y, data[i*4+1].z);
+		obj.padding1 = data[i*4+1].w;
+		obj.accel = Vec3(data[i*4+2].x, data[i*4+2].y, data[i*4+2].z);
+		obj.padding2 = data[i*4+2].w;
+		obj.rotation = data[i*4+3];
+	}
+}
+
+const std::vector<Object> &ComputeReference::GetObjects() const
+{
+	return objects;
+}
+
+const std::vector<u32> &ComputeReference::GetBins() const
+{
+	return bins;
+}
+
+const ComputeTimings &ComputeReference::GetTimings() const
+{
+	return timings;
+}
+
+f32 ComputeReference::MaxDifference(const Object *other, u32 count) const
+{
+	std::vector<u32> otherSlots(objects.size(), 0xFFFFFFFF);
+	for (u32 i = 0; i < count; i++)
+	{
+		const u32 id = GetObjectId(other[i]);
+		if (id < otherSlots.size())
+			otherSlots[id] = i;
+	}
+
+	f32 result = 0;
+	for (u32 i = 0; i < objects.size(); i++)
+	{
+		const u32 id = GetObjectId(objects[i]);
+		if (id >= otherSlots.size() || otherSlots[id] == 0xFFFFFFFF)
+			continue;
+		const Object &otherObject = other[otherSlots[id]];
+		Vec3 dp = objects[i].position - otherObject.position;
+		Vec3 dv = objects[i].velocity - otherObject.velocity;
+		result = Util::MaxF(result, Util::MaxF(fabsf(dp.x), Util::MaxF(fabsf(dp.y), fabsf(dp.z))));
+		result = Util::MaxF(result, Util::MaxF(fabsf(dv.x), Util::MaxF(fabsf(dv.y), fabsf(dv.z))));
+	}
+	return result;
+}
+
+void ComputeReference::Step()
+{
+	// Each stage ends with a join, like the pipeline barriers between the dispatches
+	Core::JobCounter counter;
+	Clock::time_point start = Clock::now();
+	timings.reorder = 0;
+	// Gathers with the binning of the previous frame, then the copy back over the objects
+	if (sizes.reorderInterval != 0 && frame != 0 && frame % sizes.reorderInterval == 0)
+	{
+		jobSystem.ParallelFor(counter, sizes.objectCount, OBJECT_GRAIN, &ComputeReference::ReorderJob, this);
+		jobSystem.Wait(counter);
+		objects.swap(reordered);
+		timings.reorder = ElapsedMicros(start);
+	}
+	frame++;
+
+	Bin();
+
+	start = Clock::now();
+	if (sizes.neighbourPass == NEIGHBOUR_PASS_BOID)
+		jobSystem.ParallelFor(counter, sizes.objectCount, BOID_GRAIN, &ComputeReference::Sim0BoidJob, this);
+	else
+		jobSystem.ParallelFor(counter, sizes.chunkCount, CHUNK_GRAIN, &ComputeReference::Sim0Job, this);
+	jobSystem.Wait(counter);
+	timings.sim0 = ElapsedMicros(start);
+
+	start = Clock::now();
+	jobSystem.ParallelFor(counter, sizes.objectCount, OBJECT_GRAIN, &ComputeReference::Sim1Job, this);
+	jobSystem.Wait(counter);
+	timings.sim1 = ElapsedMicros(start);
+}
+
+void ComputeReference::Bin()
+{
+	Core::JobCounter counter;
+	Clock::time_point start = Clock::now();
+	// vkCmdFillBuffer on the chunk counts
+	memset(bins.data() + BIN_CELL_COUNT_OFFSET, 0, sizeof(u32) * sizes.chunkCount);
+	jobSystem.ParallelFor(counter, sizes.objectCount, OBJECT_GRAIN, &ComputeReference::Bin0Job, this);
+	jobSystem.Wait(counter);
+	timings.bin0 = ElapsedMicros(start);
+
+	// The two halves of bin1 around its barrier, the lane totals are scanned by lane 0 in between
+	start = Clock::now();
+	jobSystem.ParallelFor(counter, SCAN_GROUP_SIZE, LANE_GRAIN, &ComputeReference::Bin1SumJob, this);
+	jobSystem.Wait(counter);
+	u32 total = 0;
+	for (u32 i = 0; i < SCAN_GROUP_SIZE; i++)
+	{
+		u32 value = laneSums[i];
+		laneSums[i] = total;
+		total += value;
+	}
+	jobSystem.ParallelFor(counter, SCAN_GROUP_SIZE, LANE_GRAIN, &ComputeReference::Bin1StartJob, this);
+	jobSystem.Wait(counter);
+	timings.bin1 = ElapsedMicros(start);
+
+	start = Clock::now();
+	jobSystem.ParallelFor(counter, sizes.objectCount, OBJECT_GRAIN, &ComputeReference::Bin2Job, this);
+	jobSystem.Wait(counter);
+	timings.bin2 = ElapsedMicros(start);
+}
+
+void ComputeReference::Bin0Job(void *data, u32 begin, u32 end)
+{
+	PROFILE_ZONE("ComputeReference::Bin0Job");
+	ComputeReference *self = static_cast<ComputeReference *>(data);
+	for (u32 i = begin; i < end; i++)
+		self->Bin0(i);
+}
+
+void ComputeReference::Bin1SumJob(void *data, u32 begin, u32 end)
+{
+	PROFILE_ZONE("ComputeReference::Bin1SumJob");
+	ComputeReference *self = static_cast<ComputeReference *>(data);
+	for (u32 i = begin; i < end; i++)
+		self->Bin1Sum(i);
+}
+
+void ComputeReference::Bin1StartJob(void *data, u32 begin, u32 end)
+{
+	PROFILE_ZONE("ComputeReference::Bin1StartJob");
+	ComputeReference *self = static_cast<ComputeReference *>(data);
+	for (u32 i = begin; i < end; i++)
+		self->Bin1Start(i);
+}
+
+void ComputeReference::Bin2Job(void *data, u32 begin, u32 end)
+{
+	PROFILE_ZONE("ComputeReference::Bin2Job");
+	ComputeReference *self = static_cast<ComputeReference *>(data);
+	for (u32 i = begin; i < end; i++)
+		self->Bin2(i);
+}
+
+void ComputeReference::Sim0Job(void *data, u32 begin, u32 end)
+{
+	PROFILE_ZONE("ComputeReference::Sim0Job");
+	ComputeReference *self = static_cast<ComputeReference *>(data);
+	for (u32 i = begin; i < end; i++)
+		self->Sim0(i);
+}
+
+void ComputeReference::Sim0BoidJob(void *data, u32 begin, u32 end)
+{
+	PROFILE_ZONE("ComputeReference::Sim0BoidJob");
+	ComputeReference *self = static_cast<ComputeReference *>(data);
+	for (u32 i = begin; i < end; i++)
+		self->Sim0Boid(i);
+}
+
+void ComputeReference::Sim1Job(void *data, u32 begin, u32 end)
+{
+	PROFILE_ZONE("ComputeReference::Sim1Job");
+	ComputeReference *self = static_cast<ComputeReference *>(data);
+	for (u32 i = begin; i < end; i++)
+		self->Sim1(i);
+}
+
+void ComputeReference::ReorderJob(void *data, u32 begin, u32 end)
+{
+	PROFILE_ZONE("ComputeReference::ReorderJob");
+	ComputeReference *self = static_cast<ComputeReference *>(data);
+	for (u32 i = begin; i < end; i++)
+		self->reordered[i] = self->objects[self->bins[self->sizes.binSortedOffset + i]];
+}
+
+void ComputeReference::Bin0(u32 id)
+{
+	const s32 chunkCountSide = (s32)(sizes.chunkCountSide);
+	Vec3 chunkPos = objects[id].position * (f32)(chunkCountSide) / (f32)(sizes.worldSize);
+	IVec3 cPos;
+	cPos.x = Util::IClamp((s32)(chunkPos.x), 0, chunkCountSide - 1);
+	cPos.y = Util::IClamp((s32)(chunkPos.y), 0, chunkCountSide - 1);
+	cPos.z = Util::IClamp((s32)(chunkPos.z), 0, chunkCountSide - 1);
+	u32 flatIndex = cPos.x + ((cPos.z * chunkCountSide) + cPos.y) * chunkCountSide;
+
+	bins[sizes.binObjectCellOffset + id] = flatIndex;
+	bins[sizes.binObjectSlotOffset + id] = std::atomic_ref<u32>(bins[BIN_CELL_COUNT_OFFSET + flatIndex]).fetch_add(1, std::memory_order_relaxed);
+}
+
+void ComputeReference::Bin1Sum(u32 lane)
+{
+	const u32 chunksPerLane = (sizes.chunkCount + SCAN_GROUP_SIZE - 1) / SCAN_GROUP_SIZE;
+	const u32 first = Util::MinU(lane * chunksPerLane, sizes.chunkCount);
+	const u32 last = Util::MinU(first + chunksPerLane, sizes.chunkCount);
+
+	u32 sum = 0;
+	for (u32 i = first; i < last; i++)
+	{
+		sum += bins[BIN_CELL_COUNT_OFFSET + i];
+	}
+	laneSums[lane] = sum;
+}
+
+void ComputeReference::Bin1Start(u32 lane)
+{
+	const u32 chunksPerLane = (sizes.chunkCount + SCAN_GROUP_SIZE - 1) / SCAN_GROUP_SIZE;
+	const u32 first = Util::MinU(lane * chunksPerLane, sizes.chunkCount);
+	const u32 last = Util::MinU(first + chunksPerLane, sizes.chunkCount);
+
+	u32 offset = laneSums[lane];
+	for (u32 i = first; i < last; i++)
+	{
+		bins[sizes.binCellStartOffset + i] = offset;
+		offset += bins[BIN_CELL_COUNT_OFFSET + i];
+	}
+}
+
+void ComputeReference::Bin2(u32 id)
+{
+	u32 cell = bins[sizes.binObjectCellOffset + id];
+	u32 slot = bins[sizes.binObjectSlotOffset + id];
+	bins[sizes.binSortedOffset + bins[sizes.binCellStartOffset + cell] + slot] = id;
+}
+
+void ComputeReference::Sim0(u32 index)
+{
+	const u32 side = sizes.chunkCountSide;
+	const IVec3 chunkPos = IVec3(index % side, (index / side) % side, index / (side * side));
+	const u32 bufferOffset = sizes.binSortedOffset + bins[sizes.binCellStartOffset + index];
+	const u32 objectCount = bins[BIN_CELL_COUNT_OFFSET + index];
+
+	for (u32 index1 = 0; index1 < objectCount; index1++)
+	{
+		UpdateAccel(bins[bufferOffset + index1], chunkPos);
+	}
+}
+
+void ComputeReference::Sim0Boid(u32 index)
+{
+	const u32 side = sizes.chunkCountSide;
+	const u32 boid1 = bins[sizes.binSortedOffset + index];
+	const u32 cell = bins[sizes.binObjectCellOffset + boid1];
+	UpdateAccel(boid1, IVec3(cell % side, (cell / side) % side, cell / (side * side)));
+}
+
+void ComputeReference::UpdateAccel(u32 boid1, IVec3 chunkPos)
+{
+	const f32 deltaTime = SIM_DELTA_TIME;
+
+	Vec3 globalPos;
+	Vec3 globalRot;
+	Vec3 avoidDir;
+	u32 count = 0;
+	u32 avoidCount = 0;
+
+	for (s32 i = -1; i <= 1; i++)
+	{
+		for (s32 j = -1; j <= 1; j++)
+		{
+			for (s32 k = -1; k <= 1; k++)
+			{
+				Vec3 dt;
+				s32 cellId = GetCell(sizes, IVec3(chunkPos.x + i, chunkPos.y + j, chunkPos.z + k), dt);
+
+				const u32 otherOffset = sizes.binSortedOffset + bins[sizes.binCellStartOffset + cellId];
+				u32 otherCount = bins[BIN_CELL_COUNT_OFFSET + cellId];
+				for (u32 index2 = 0; index2 < otherCount; index2++)
+				{
+					u32 boid2 = bins[otherOffset + index2];
+					if (boid1 == boid2)
+						continue;
+
+					Vec3 delta = objects[boid2].position - objects[boid1].position + dt;
+					f32 distSqr = delta.Dot();
+					if (distSqr > BOID_DIST_MAX * BOID_DIST_MAX)
+						continue;
+
+					globalPos += delta;
+					globalRot += objects[boid2].velocity;
+					count++;
+
+					if (distSqr < BOID_DIST_MIN * BOID_DIST_MIN && distSqr > 0)
+					{
+						f32 dist = sqrtf(distSqr);
+						avoidCount++;
+						avoidDir -= delta / (dist * dist * dist) * BOID_DIST_MIN * BOID_DIST_MIN * BOID_DIST_MIN;
+					}
+				}
+			}
+		}
+	}
+
+	// Only the accelerations are written, positions and velocities stay untouched until sim1
+	Object &obj = objects[boid1];
+	if (count != 0)
+	{
+		obj.accel = (globalPos / (f32)(count)) * 700 + (globalRot / (f32)(count)) * 2500;
+		if (avoidCount != 0)
+			obj.accel += (avoidDir / (f32)(avoidCount)) * 9000;
+		obj.accel *= deltaTime;
+	}
+	else
+		obj.accel = obj.velocity.Normalize() * deltaTime;
+}
+
+void ComputeReference::Sim1(u32 id)
+{
+	const f32 deltaTime = SIM_DELTA_TIME;
+	const f32 size = (f32)(sizes.worldSize);
+	Object &obj = objects[id];
+	Vec3 newVel = obj.velocity + obj.accel * deltaTime;
+	f32 len = newVel.Length();
+	if (len > BOID_MAX_SPEED)
+	{
+		newVel = newVel.Normalize() * BOID_MAX_SPEED;
+	}
+	obj.velocity = newVel;
+
+	Vec3 newPos = obj.position + obj.velocity * deltaTime;
+	if (newPos.x < 0)
+		newPos.x += size;
+	else if (newPos.x >= size)
+		newPos.x -= size;
+	if (newPos.y < 0)
+		newPos.y += size;
+	else if (newPos.y >= size)
+		newPos.y -= size;
+	if (newPos.z < 0)
+		newPos.z += size;
+	else if (newPos.z >= size)
+		newPos.z -= size;
+
+	obj.position = newPos;
+}
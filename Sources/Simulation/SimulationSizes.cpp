@@ -0,0 +1,177 @@
+#include "Simulation/SimulationSizes.hpp"
+
+#include <bit>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+typedef u32 uint;
+#include "../Assets/Shaders/shaderSimData.h"
+
+using namespace Simulation;
+
+namespace
+{
+	// Larger worlds get wider chunks instead, the binning buffer and the prefix sum grow with the chunk count
+	const u32 MAX_CHUNK_COUNT_SIDE = 64;
+	// The binning buffer holds three values per object and is indexed with 32 bits in the shaders
+	const u32 MAX_OBJECT_COUNT = 0x50000000;
+
+	bool ParseValue(const std::string &arg, const char *prefix, u32 &out)
+	{
+		const size_t length = strlen(prefix);
+		if (arg.compare(0, length, prefix) != 0)
+			return false;
+		const char *text = arg.c_str() + length;
+		char *end = nullptr;
+		unsigned long long value = strtoull(text, &end, 0);
+		if (*text == '\0' || *end != '\0' || value > 0xFFFFFFFFull)
+			return false;
+		out = (u32)(value);
+		return true;
+	}
+
+	bool ParseFlag(const std::string &arg, const char *name, bool &out)
+	{
+		if (arg != name)
+			return false;
+		out = true;
+		return true;
+	}
+
+	const char *const NEIGHBOUR_PASS_NAMES[NEIGHBOUR_PASS_COUNT] = { "cell", "tiled", "boid" };
+	const char *const NEIGHBOUR_PASS_SHADERS[NEIGHBOUR_PASS_COUNT] = { "Assets/Shaders/sim0.comp.spv", "Assets/Shaders/sim0tiled.comp.spv", "Assets/Shaders/sim0boid.comp.spv" };
+
+	bool ParseNeighbourPass(const std::string &arg, NeighbourPass &out)
+	{
+		const char *prefix = "--neighbour-pass=";
+		const size_t length = strlen(prefix);
+		if (arg.compare(0, length, prefix) != 0)
+			return false;
+		for (u32 i = 0; i < NEIGHBOUR_PASS_COUNT; i++)
+		{
+			if (arg.compare(length, std::string::npos, NEIGHBOUR_PASS_NAMES[i]) == 0)
+			{
+				out = (NeighbourPass)(i);
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+bool SimulationSizes::Init(u32 objects, u32 world, std::string &error)
+{
+	// With less than three chunks per side the 3x3x3 neighbourhood wraps onto the same chunk twice
+	const u32 minWorldSize = (u32)(ceilf(BOID_DIST_MAX)) * 3;
+	if (objects == 0 || objects > MAX_OBJECT_COUNT)
+	{
+		error = "boid count must be between 1 and " + std::to_string(MAX_OBJECT_COUNT);
+		return false;
+	}
+	if (world < minWorldSize)
+	{
+		error = "world size must be at least " + std::to_string(minWorldSize);
+		return false;
+	}
+
+	objectCount = objects;
+	worldSize = world;
+	chunkCountSide = (u32)(world / BOID_DIST_MAX);
+	if (chunkCountSide > MAX_CHUNK_COUNT_SIDE)
+		chunkCountSide = MAX_CHUNK_COUNT_SIDE;
+	chunkCount = chunkCountSide * chunkCountSide * chunkCountSide;
+	binCellStartOffset = chunkCount;
+	binSortedOffset = chunkCount * 2;
+	binObjectCellOffset = chunkCount * 2 + objectCount;
+	binObjectSlotOffset = chunkCount * 2 + objectCount * 2;
+	binBufferCount = (u64)(chunkCount) * 2 + (u64)(objectCount) * 3;
+	cullListCount = (objectCount + 63) / 64 * 64;
+	cullLodStateOffset = CULL_HEADER_COUNT + (u64)(cullListCount) * LOD_COUNT;
+	cullBufferCount = cullLodStateOffset + (objectCount + 31) / 32;
+	const u64 stateStreamCount = (objectCount + 63) / 64 * 64;
+	stateVectorUintCount = halfState ? 2 : 3;
+	stateVelocityOffset = stateStreamCount * 4;
+	stateAccelOffset = stateVelocityOffset + stateStreamCount * stateVectorUintCount;
+	stateRotationOffset = stateAccelOffset + stateStreamCount * stateVectorUintCount;
+	stateUintCount = stateRotationOffset + stateStreamCount * 4;
+	return true;
+}
+
+void SimulationSizes::GetSpecializationData(u32 (&data)[SPEC_COUNT]) const
+{
+	data[SPEC_OBJECT_COUNT] = objectCount;
+	data[SPEC_WORLD_SIZE] = worldSize;
+	data[SPEC_CHUNK_COUNT_SIDE] = chunkCountSide;
+	data[SPEC_STATE_HALF] = halfState ? 1 : 0;
+}
+
+std::vector<u32> SimulationSizes::PackState(const std::vector<Maths::Vec4> &objects) const
+{
+	std::vector<u32> state((size_t)(stateUintCount), 0);
+	const auto packVector = [&](u64 offset, u32 index, const Maths::Vec4 &value)
+	{
+		u32 *out = state.data() + offset + (u64)(index) * stateVectorUintCount;
+		if (halfState)
+		{
+			out[0] = Maths::Util::FloatToHalf(value.x) | ((u32)(Maths::Util::FloatToHalf(value.y)) << 16);
+			out[1] = Maths::Util::FloatToHalf(value.z);
+		}
+		else
+			memcpy(out, &value.x, sizeof(u32) * 3);
+	};
+	for (u32 i = 0; i < objectCount && (size_t)(i) * 4 + 3 < objects.size(); i++)
+	{
+		memcpy(state.data() + (u64)(i) * 4, &objects[i*4], sizeof(Maths::Vec4));
+		packVector(stateVelocityOffset, i, objects[i*4+1]);
+		packVector(stateAccelOffset, i, objects[i*4+2]);
+		memcpy(state.data() + stateRotationOffset + (u64)(i) * 4, &objects[i*4+3], sizeof(Maths::Vec4));
+	}
+	return state;
+}
+
+Maths::Vec4 SimulationSizes::GetPackedPosition(const u32 *state, u32 index) const
+{
+	const u32 *bits = state + (u64)(index) * 4;
+	return Maths::Vec4(std::bit_cast<f32>(bits[0]), std::bit_cast<f32>(bits[1]), std::bit_cast<f32>(bits[2]), std::bit_cast<f32>(bits[3]));
+}
+
+Maths::Vec4 SimulationSizes::GetPackedRotation(const u32 *state, u32 index) const
+{
+	const u32 *bits = state + stateRotationOffset + (u64)(index) * 4;
+	return Maths::Vec4(std::bit_cast<f32>(bits[0]), std::bit_cast<f32>(bits[1]), std::bit_cast<f32>(bits[2]), std::bit_cast<f32>(bits[3]));
+}
+
+u32 SimulationSizes::GetNeighbourInvocationCount() const
+{
+	switch (neighbourPass)
+	{
+	case NEIGHBOUR_PASS_TILED:
+		return chunkCount * COMPUTE_GROUP_SIZE;
+	case NEIGHBOUR_PASS_BOID:
+		return objectCount;
+	default:
+		return chunkCount;
+	}
+}
+
+const char *SimulationSizes::GetNeighbourShaderPath() const
+{
+	return NEIGHBOUR_PASS_SHADERS[neighbourPass < NEIGHBOUR_PASS_COUNT ? neighbourPass : NEIGHBOUR_PASS_CELL];
+}
+
+void SimulationSizes::GetDispatchSize(u32 invocationCount, u32 &groupsX, u32 &groupsY)
+{
+	const u32 groups = (invocationCount + COMPUTE_GROUP_SIZE - 1) / COMPUTE_GROUP_SIZE;
+	groupsX = groups < MAX_DISPATCH_GROUPS_X ? groups : MAX_DISPATCH_GROUPS_X;
+	if (groupsX == 0)
+		groupsX = 1;
+	groupsY = (groups + groupsX - 1) / groupsX;
+}
+
+bool Simulation::ParseSimulationArgument(const std::string &arg, SimulationSizes &sizes)
+{
+	return ParseValue(arg, "--boids=", sizes.objectCount) || ParseValue(arg, "--world-size=", sizes.worldSize) ||
+		ParseNeighbourPass(arg, sizes.neighbourPass) || ParseValue(arg, "--reorder-every=", sizes.reorderInterval) ||
+		ParseFlag(arg, "--half-state", sizes.halfState);
+}
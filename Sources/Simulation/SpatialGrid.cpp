@@ -0,0 +1,142 @@
+#include "Simulation/SpatialGrid.hpp"
+#include "Core/Profiler.hpp"
+
+#include <cstring>
+
+using namespace Simulation;
+using namespace Maths;
+
+void SpatialGrid::Build(Core::JobSystem &jobs, const Vec2 *positionsIn, u32 count, IVec2 cells, Vec2 size)
+{
+	PROFILE_ZONE("SpatialGrid::Build");
+	positions = positionsIn;
+	objectCount = count;
+	cellCount = cells;
+	cellSize = size;
+	totalCells = (u32)(cells.x * cells.y);
+
+	const u32 maxChunks = (jobs.GetWorkerCount() + 1) * 4;
+	chunkCount = Util::MaxU(Util::MinU((count + GRID_MIN_CHUNK_SIZE - 1) / GRID_MIN_CHUNK_SIZE, maxChunks), 1);
+	chunkSize = (count + chunkCount - 1) / chunkCount;
+	blockCount = (totalCells + GRID_CELL_BLOCK_SIZE - 1) / GRID_CELL_BLOCK_SIZE;
+
+	if (cellStart.size() < totalCells)
+	{
+		cellStart.resize(totalCells);
+		cellCounts.resize(totalCells);
+	}
+	if (sortedIndices.size() < count)
+	{
+		sortedIndices.resize(count);
+		objectCells.resize(count);
+	}
+	if (chunkOffsets.size() < (size_t)(chunkCount) * totalCells)
+		chunkOffsets.resize((size_t)(chunkCount) * totalCells);
+	if (blockOffsets.size() < blockCount)
+		blockOffsets.resize(blockCount);
+
+	Core::JobCounter counter;
+	jobs.ParallelFor(counter, chunkCount, 1, &SpatialGrid::HistogramJob, this);
+	jobs.Wait(counter);
+
+	jobs.ParallelFor(counter, blockCount, 1, &SpatialGrid::PrefixSumJob, this);
+	jobs.Wait(counter);
+
+	// Only one value per block of cells, not worth a job
+	u32 sum = 0;
+	for (u32 i = 0; i < blockCount; i++)
+	{
+		u32 total = blockOffsets[i];
+		blockOffsets[i] = sum;
+		sum += total;
+	}
+
+	jobs.ParallelFor(counter, blockCount, 1, &SpatialGrid::OffsetJob, this);
+	jobs.Wait(counter);
+
+	jobs.ParallelFor(counter, chunkCount, 1, &SpatialGrid::ScatterJob, this);
+	jobs.Wait(counter);
+}
+
+void SpatialGrid::HistogramJob(void *data, u32 begin, u32 end)
+{
+	PROFILE_ZONE("SpatialGrid::HistogramJob");
+	SpatialGrid *self = static_cast<SpatialGrid *>(data);
+	for (u32 chunk = begin; chunk < end; chunk++)
+	{
+		u32 *histogram = self->chunkOffsets.data() + (size_t)(chunk) * self->totalCells;
+		memset(histogram, 0, sizeof(u32) * self->totalCells);
+
+		const u32 first = chunk * self->chunkSize;
+		const u32 last = Util::MinU(first + self->chunkSize, self->objectCount);
+		for (u32 i = first; i < last; i++)
+		{
+			IVec2 cell = self->positions[i] / self->cellSize;
+			cell.x = Util::IClamp(cell.x, 0, self->cellCount.x - 1);
+			cell.y = Util::IClamp(cell.y, 0, self->cellCount.y - 1);
+			u32 flat = (u32)(cell.x + cell.y * self->cellCount.x);
+			self->objectCells[i] = flat;
+			histogram[flat]++;
+		}
+	}
+}
+
+void SpatialGrid::PrefixSumJob(void *data, u32 begin, u32 end)
+{
+	PROFILE_ZONE("SpatialGrid::PrefixSumJob");
+	SpatialGrid *self = static_cast<SpatialGrid *>(data);
+	const size_t stride = self->totalCells;
+	for (u32 block = begin; block < end; block++)
+	{
+		const u32 firstCell = block * GRID_CELL_BLOCK_SIZE;
+		const u32 lastCell = Util::MinU(firstCell + GRID_CELL_BLOCK_SIZE, self->totalCells);
+		u32 blockSum = 0;
+		for (u32 cell = firstCell; cell < lastCell; cell++)
+		{
+			// Each chunk writes after the objects of the previous chunks in the same cell
+			u32 cellSum = 0;
+			for (u32 chunk = 0; chunk < self->chunkCount; chunk++)
+			{
+				u32 &value = self->chunkOffsets[chunk * stride + cell];
+				u32 chunkTotal = value;
+				value = cellSum;
+				cellSum += chunkTotal;
+			}
+			self->cellCounts[cell] = cellSum;
+			self->cellStart[cell] = blockSum;
+			blockSum += cellSum;
+		}
+		self->blockOffsets[block] = blockSum;
+	}
+}
+
+void SpatialGrid::OffsetJob(void *data, u32 begin, u32 end)
+{
+	PROFILE_ZONE("SpatialGrid::OffsetJob");
+	SpatialGrid *self = static_cast<SpatialGrid *>(data);
+	for (u32 block = begin; block < end; block++)
+	{
+		const u32 firstCell = block * GRID_CELL_BLOCK_SIZE;
+		const u32 lastCell = Util::MinU(firstCell + GRID_CELL_BLOCK_SIZE, self->totalCells);
+		const u32 offset = self->blockOffsets[block];
+		for (u32 cell = firstCell; cell < lastCell; cell++)
+			self->cellStart[cell] += offset;
+	}
+}
+
+void SpatialGrid::ScatterJob(void *data, u32 begin, u32 end)
+{
+	PROFILE_ZONE("SpatialGrid::ScatterJob");
+	SpatialGrid *self = static_cast<SpatialGrid *>(data);
+	for (u32 chunk = begin; chunk < end; chunk++)
+	{
+		u32 *offsets = self->chunkOffsets.data() + (size_t)(chunk) * self->totalCells;
+		const u32 first = chunk * self->chunkSize;
+		const u32 last = Util::MinU(first + self->chunkSize, self->objectCount);
+		for (u32 i = first; i < last; i++)
+		{
+			u32 cell = self->objectCells[i];
+			self->sortedIndices[self->cellStart[cell] + offsets[cell]++] = i;
+		}
+	}
+}
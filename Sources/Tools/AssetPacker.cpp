@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Resource/AssetPack.hpp"
+#include "Resource/Texture.hpp"
+#include "Resource/TextureEncoder.hpp"
+
+namespace
+{
+	struct PendingAsset
+	{
+		std::string name;
+		Resource::AssetType type = Resource::ASSET_RAW;
+		u32 width = 0;
+		u32 height = 0;
+		u32 mipCount = 0;
+		std::vector<u8> payload;
+	};
+
+	bool ReadRaw(const std::filesystem::path &path, std::vector<u8> &out)
+	{
+		std::ifstream file = std::ifstream(path, std::ios_base::binary | std::ios_base::ate);
+		if (!file.is_open())
+			return false;
+		out.resize((size_t)(file.tellg()));
+		file.seekg(std::ios_base::beg);
+		return (bool)(file.read(reinterpret_cast<char *>(out.data()), out.size()));
+	}
+
+	// Adds the asset, or a texture and its compressed variants, to 'assets'
+	bool ReadAsset(const std::filesystem::path &path, const std::string &name, std::vector<PendingAsset> &assets)
+	{
+		std::string extension = path.extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)(tolower(c)); });
+		PendingAsset asset;
+		asset.name = name;
+		if (extension == ".spv")
+		{
+			if (!ReadRaw(path, asset.payload))
+				return false;
+			assets.push_back(std::move(asset));
+			return true;
+		}
+
+		// Decoded and mipmapped once here instead of on every launch
+		Maths::IVec2 res;
+		u8 *pixels = Resource::Texture::ReadTexture(path.string(), res);
+		if (!pixels)
+			return false;
+		asset.type = Resource::ASSET_TEXTURE_RGBA8;
+		asset.width = (u32)(res.x);
+		asset.height = (u32)(res.y);
+		asset.mipCount = Resource::TextureEncoder::GetMipCount(asset.width, asset.height);
+		asset.payload = Resource::TextureEncoder::BuildMipChain(pixels, asset.width, asset.height);
+		const bool opaque = Resource::TextureEncoder::IsOpaque(pixels, asset.width, asset.height);
+		Resource::Texture::FreeTextureData(pixels);
+
+		// The RGBA8 chain stays in the pack for the devices without BC support. BC1 has no alpha in the format used.
+		for (Resource::AssetType type : { Resource::ASSET_TEXTURE_BC7, Resource::ASSET_TEXTURE_BC1 })
+		{
+			if (type == Resource::ASSET_TEXTURE_BC1 && !opaque)
+				continue;
+			PendingAsset variant = asset;
+			variant.name += type == Resource::ASSET_TEXTURE_BC7 ? ".bc7" : ".bc1";
+			variant.type = type;
+			variant.payload = Resource::TextureEncoder::EncodeChain(asset.payload.data(), asset.width, asset.height, asset.mipCount,
+				Resource::GetTextureEncoding(type));
+			assets.push_back(std::move(variant));
+		}
+		assets.push_back(std::move(asset));
+		return true;
+	}
+
+	bool WritePack(const std::string &path, const std::vector<PendingAsset> &assets)
+	{
+		std::vector<Resource::AssetPackEntry> entries(assets.size());
+		std::string names;
+		for (u32 i = 0; i < assets.size(); i++)
+		{
+			entries[i].nameOffset = (u32)(names.size());
+			entries[i].nameLength = (u32)(assets[i].name.size());
+			names += assets[i].name;
+		}
+
+		u64 offset = sizeof(Resource::AssetPackHeader) + entries.size() * sizeof(Resource::AssetPackEntry) + names.size();
+		for (u32 i = 0; i < assets.size(); i++)
+		{
+			offset = (offset + Resource::ASSET_PACK_ALIGNMENT - 1) / Resource::ASSET_PACK_ALIGNMENT * Resource::ASSET_PACK_ALIGNMENT;
+			entries[i].offset = offset;
+			entries[i].size = assets[i].payload.size();
+			entries[i].hash = Resource::HashAssetData(assets[i].payload.data(), assets[i].payload.size());
+			entries[i].type = assets[i].type;
+			entries[i].width = assets[i].width;
+			entries[i].height = assets[i].height;
+			entries[i].mipCount = assets[i].mipCount;
+			offset += entries[i].size;
+		}
+
+		Resource::AssetPackHeader header = {};
+		header.magic = Resource::ASSET_PACK_MAGIC;
+		header.version = Resource::ASSET_PACK_VERSION;
+		header.entryCount = (u32)(entries.size());
+		header.nameTableSize = (u32)(names.size());
+
+		// The application may be running with the previous pack mapped, it is replaced in one step
+		const std::string tempPath = path + ".tmp";
+		{
+			std::ofstream file = std::ofstream(tempPath, std::ios_base::binary | std::ios_base::trunc);
+			if (!file.is_open())
+				return false;
+			file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+			file.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(Resource::AssetPackEntry));
+			file.write(names.data(), names.size());
+			const char padding[Resource::ASSET_PACK_ALIGNMENT] = {};
+			for (u32 i = 0; i < assets.size(); i++)
+			{
+				file.write(padding, entries[i].offset - (u64)(file.tellp()));
+				file.write(reinterpret_cast<const char *>(assets[i].payload.data()), assets[i].payload.size());
+			}
+			file.close();
+			if (file.fail())
+				return false;
+		}
+		std::error_code error;
+		std::filesystem::rename(tempPath, path, error);
+		return !error;
+	}
+}
+
+// Builds the asset pack loaded by the render thread: the compiled shaders, and the textures decoded to RGBA8 with their
+// mip chain, plus their BC7 and BC1 versions.
+// See the README for the command line.
+int main(int argc, char *argv[])
+{
+	const std::string assetsText = "--assets=";
+	const std::string outputText = "--output=";
+	std::string assetsPath = "Assets";
+	std::string outputPath = "Assets.pack";
+	for (s32 i = 1; i < argc; i++)
+	{
+		if (assetsText.compare(0, assetsText.size(), argv[i], assetsText.size()) == 0)
+			assetsPath = argv[i] + assetsText.size();
+		else if (outputText.compare(0, outputText.size(), argv[i], outputText.size()) == 0)
+			outputPath = argv[i] + outputText.size();
+		else
+		{
+			fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	std::error_code error;
+	std::vector<PendingAsset> assets;
+	for (const std::filesystem::directory_entry &entry : std::filesystem::recursive_directory_iterator(assetsPath, error))
+	{
+		std::string extension = entry.path().extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)(tolower(c)); });
+		if (!entry.is_regular_file() || (extension != ".spv" && extension != ".png" && extension != ".jpg"))
+			continue;
+
+		// Named like the paths the application loads, relative to its working directory
+		const std::string name = (std::filesystem::path(assetsPath).filename() / std::filesystem::relative(entry.path(), assetsPath)).generic_string();
+		const size_t firstAsset = assets.size();
+		if (!ReadAsset(entry.path(), name, assets))
+		{
+			fprintf(stderr, "Could not read %s\n", entry.path().string().c_str());
+			return 1;
+		}
+		for (size_t i = firstAsset; i < assets.size(); i++)
+			printf("%-44s %10zu bytes\n", assets[i].name.c_str(), assets[i].payload.size());
+	}
+	if (error)
+	{
+		fprintf(stderr, "Could not list %s: %s\n", assetsPath.c_str(), error.message().c_str());
+		return 1;
+	}
+
+	std::sort(assets.begin(), assets.end(), [](const PendingAsset &a, const PendingAsset &b) { return a.name < b.name; });
+	if (!WritePack(outputPath, assets))
+	{
+		fprintf(stderr, "Could not write %s\n", outputPath.c_str());
+		return 1;
+	}
+	printf("%zu assets written to %s\n", assets.size(), outputPath.c_str());
+	return 0;
+}